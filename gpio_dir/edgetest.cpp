@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  edgetest.cpp
+
+  Test of the para_edgecap edge-capture library.  Captures every edge
+    on one or more GPIO inputs and prints each edge with the time since
+    the previous edge on the same pin, i.e. the pulse width.
+
+  Build:
+  gcc -o edgetest edgetest.cpp para_edgecap.cpp para_gpio.cpp para_gpio.c -lstdc++ -pthread -Wall
+
+  Notes:
+    With -s no GPIOs are used, a simulated pin source produces a square
+    wave on each "pin" instead.  This exercises the capture thread, the
+    ring and the drain / overflow accounting on any Linux machine.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include "para_edgecap.h"
+
+void Usage() {
+
+  printf("Usage:  edgetest -h  (show this help)\n");
+  printf("        edgetest [-k] [-t S] [-d N] PP [QQ ...]\n");
+  printf("        edgetest -s [-t S] [-d N] [-p US]\n\n");
+
+  printf("    options:\n");
+  printf("        -k    : Use the GPIO character device (kernel timestamps)\n");
+  printf("        -t S  : Run for S seconds (default 10)\n");
+  printf("        -d N  : Ring depth in records (default 4096)\n");
+  printf("        -s    : Use a simulated source instead of GPIOs\n");
+  printf("        -p US : Simulated half-period in microseconds (default 500)\n");
+  printf("        -q    : Quiet, only print the statistics\n\n");
+
+  printf("        PP QQ ... : GPIO IDs to capture\n\n");
+
+  printf("Note: This application needs (probably root) access to /sys/class/gpio\n");
+  printf("\n");
+
+}
+
+// Square wave on 2 pins, pin 1 at half the rate of pin 0
+typedef struct {
+  unsigned long long nNext;
+  unsigned long long nHalfNS;
+  unsigned long long nCount;
+} simsource;
+
+static int SimSource(para_edge *pEdges, int nMax, int nTimeoutMS, int *pCount,
+                     void *pArg) {
+  simsource *pSim = (simsource *)pArg;
+  struct timespec ts;
+  unsigned long long now;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+  if(!pSim->nNext)
+    pSim->nNext = now;
+
+  for(*pCount = 0; *pCount < nMax && pSim->nNext <= now; pSim->nNext += pSim->nHalfNS) {
+
+    pSim->nCount++;
+    pEdges[*pCount].nTimeNS = pSim->nNext;
+    pEdges[*pCount].nPin = 0;
+    pEdges[*pCount].nValue = pSim->nCount & 1;
+    (*pCount)++;
+
+    if(!(pSim->nCount & 1) && *pCount < nMax) {
+      pEdges[*pCount].nTimeNS = pSim->nNext;
+      pEdges[*pCount].nPin = 1;
+      pEdges[*pCount].nValue = (pSim->nCount >> 1) & 1;
+      (*pCount)++;
+    }
+  }
+
+  if(*pCount)
+    return para_ok;
+
+  usleep(pSim->nHalfNS / 1000 < 1000 ? pSim->nHalfNS / 1000 : 1000);
+  return para_timeout;
+}
+
+int main(int argc, char *argv[]) {
+  int n, c, count, nPins=0, nSecs=10, nDepth=4096, nHalfUS=500;
+  int nIDs[MAXPINSPEROBJECT], sim=0, quiet=0, res;
+  simsource simsrc;
+  para_gpiobackend eBackend = para_bksysfs;
+  unsigned long long last[MAXPINSPEROBJECT], cap, ovf, lost, total=0;
+  para_edge edges[256];
+  time_t tEnd;
+  CParaGpio *gpio = NULL;
+  CParaEdgeCap *ecap;
+
+  printf("EDGETEST - Test of Parallella GPIO edge capture\n\n");
+
+  while ((c = getopt(argc, argv, "hkt:d:sp:q")) != -1) {
+    switch (c) {
+
+    case 'h':
+      Usage();
+      exit(0);
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 't':
+      nSecs = atoi(optarg);
+      break;
+
+    case 'd':
+      nDepth = atoi(optarg);
+      break;
+
+    case 's':
+      sim = 1;
+      break;
+
+    case 'p':
+      nHalfUS = atoi(optarg);
+      if(nHalfUS <= 0) {
+	fprintf(stderr, "Half-period must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'q':
+      quiet = 1;
+      break;
+
+    case '?':
+      if (isprint (optopt))
+	fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+      else
+	fprintf (stderr,
+		 "Unknown option character `\\x%x'.\n",
+		 optopt);
+      exit(1);
+
+    default:
+      fprintf(stderr, "Unexpected result from getopt?? (%d:%c)\n", c, c);
+      exit(1);
+    }
+  }
+
+  if(sim) {
+
+    printf("Using simulated source, %d us half-period\n", nHalfUS);
+    simsrc.nNext = 0;
+    simsrc.nCount = 0;
+    simsrc.nHalfNS = nHalfUS * 1000ULL;
+    ecap = new CParaEdgeCap();
+    if(ecap->Attach(SimSource, &simsrc, nDepth) != para_ok) {
+      fprintf(stderr, "Simulated source set-up failed, exiting\n");
+      exit(1);
+    }
+    nPins = 2;
+
+  } else {
+
+    for(nPins = 0; optind < argc && nPins < MAXPINSPEROBJECT; optind++)
+      nIDs[nPins++] = atoi(argv[optind]);
+
+    if(!nPins) {
+      Usage();
+      exit(1);
+    }
+
+    printf("Initializing object...\n");
+    gpio = new CParaGpio(nIDs, nPins, false, eBackend);
+    if(!gpio->IsOK() || gpio->SetDirection(para_dirin) != para_ok) {
+      fprintf(stderr, "GPIO object creation failed, exiting\n");
+      exit(1);
+    }
+
+    ecap = new CParaEdgeCap(gpio, (1ULL << nPins) - 1, nDepth);
+  }
+
+  for(n = 0; n < nPins; n++)
+    last[n] = 0;
+
+  if((res = ecap->Start()) != para_ok) {
+    fprintf(stderr, "Start() returned %d, exiting\n", res);
+    exit(1);
+  }
+
+  printf("Capturing for %d seconds...\n", nSecs);
+  tEnd = time(NULL) + nSecs;
+
+  while(time(NULL) < tEnd && ecap->GetError() == para_ok) {
+
+    ecap->Drain(edges, 256, &count);
+
+    for(n = 0; n < count; n++) {
+
+      c = edges[n].nPin;
+      if(!quiet) {
+	if(last[c])
+	  printf("%llu.%09llu pin %d -> %d  (%.3f us)\n",
+		 edges[n].nTimeNS / 1000000000ULL, edges[n].nTimeNS % 1000000000ULL,
+		 c, edges[n].nValue, (edges[n].nTimeNS - last[c]) / 1000.);
+	else
+	  printf("%llu.%09llu pin %d -> %d\n",
+		 edges[n].nTimeNS / 1000000000ULL, edges[n].nTimeNS % 1000000000ULL,
+		 c, edges[n].nValue);
+      }
+      last[c] = edges[n].nTimeNS;
+    }
+
+    total += count;
+
+    if(!count)
+      usleep(10000);
+  }
+
+  ecap->Stop();
+
+  // Pick up whatever is left
+  do {
+    ecap->Drain(edges, 256, &count);
+    total += count;
+  } while(count);
+
+  ecap->GetStats(&cap, &ovf, &lost);
+  printf("\nCaptured %llu, drained %llu, ring overflow %llu, kernel lost %llu\n",
+	 cap, total, ovf, lost);
+
+  if(ecap->GetError() != para_ok)
+    printf("Capture stopped with error %d\n", ecap->GetError());
+
+  printf("Closing\n");
+  delete ecap;
+  delete gpio;
+
+  return 0;
+}
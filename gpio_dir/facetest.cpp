@@ -36,7 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   Basic interface to a "PiFace Command and Control" board from a Parallella.
 
   Build:
-  gcc -o facetest facetest.cpp para_face.cpp para_spi.cpp para_gpio.cpp para_gpio.c -lstdc++ -Wall
+  gcc -o facetest facetest.cpp para_face.cpp para_spi.cpp para_gpio.cpp para_gpio.c -lstdc++ -lm -pthread -Wall
 
   Usage:
   See below for optional arguments.  Once running the program will present
@@ -52,15 +52,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ctype.h>
 #include <string.h>
 #include <ifaddrs.h>
+#include <time.h>
 
 #include "para_face.h"
 
 void Usage() {
 
   printf("Usage:  paratest -h  (show this help)\n");
-  printf("        paratest [PP QQ RR SS]\n\n");
+  printf("        paratest [-k | -x] [-b] [-i II] [PP QQ RR SS]\n\n");
 
   printf("    options:\n");
+  printf("        -k : Use the GPIO character device\n");
+  printf("        -x : Use the GPIO registers through /dev/mem (or $PARA_GPIOMEM)\n");
+  printf("        -b : Wait for the LCD busy flag instead of fixed delays\n");
+  printf("        -i : Report button events using MCP23S17 INTA on GPIO II\n");
   printf("        PP : Clock signal GPIO ID (default 65)\n");
   printf("        QQ : MOSI signal GPIO ID (default 66)\n");
   printf("        RR : MISO signal GPIO ID (default 68)\n");
@@ -96,29 +101,233 @@ void menu() {
   printf("\tw:\tWrite String\n");
   printf("\ti:\tShow IP info\n");
   printf("\tp:\tPushbutton status\n");
+  printf("\te:\tShow pushbutton events for 10 seconds (needs -i)\n");
+  printf("\tt:\tTime writing a screenful of characters\n");
+  printf("\tf:\tPresent 100 frames of a changing status screen\n");
+  printf("\tg:\tAnimate a bar graph and spinner with custom glyphs\n");
+  printf("\ta:\tQueue 100 frames with cursor and backlight changes in async mode\n");
+  printf("\tS:\tShow MCP23S17 traffic statistics\n");
 
   printf("\t<enter>: Repeat last command\n");
   printf("\t?:\tShow Menu\n");
   printf("\tq/Q:\tQuit\n\n");
 }
 
+static double Seconds() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats(CParaFace *pFace) {
+  para_facestats st;
+  unsigned cmd, home, clear;
+
+  pFace->GetStats(&st);
+  printf("MCP23S17: %llu writes, %llu skipped by the cache, %llu reads\n",
+	 st.nMcpWrites, st.nMcpSkipped, st.nMcpReads);
+  printf("          %llu bursts of %llu bytes\n", st.nBursts, st.nBurstBytes);
+  printf("LCD: %llu busy-flag reads, %llu timeouts", st.nBusyPolls, st.nBusyTimeouts);
+  pFace->GetLatencies(&cmd, &home, &clear);
+  printf(", latencies learned: command %uus, home %uus, clear %uus\n", cmd, home, clear);
+  printf("Buttons: %llu interrupts, %llu events, %llu dropped\n",
+	 st.nButtonInts, st.nButtonEvents, st.nEventsDropped);
+  printf("Glyphs: %llu hits, %llu misses, %llu evictions (%llu visible)\n",
+	 st.nGlyphHits, st.nGlyphMisses, st.nGlyphEvicts, st.nGlyphVisible);
+}
+
+// Print button events as they arrive for nSeconds
+void events(CParaFace *pFace, int nSeconds) {
+  para_faceevent ev;
+  double tEnd;
+  int res;
+
+  printf("Press some buttons...\n");
+  tEnd = Seconds() + nSeconds;
+
+  while(Seconds() < tEnd) {
+
+    res = pFace->GetButtonEvent(&ev, 100);
+    if(res == para_timeout)
+      continue;
+    check("face.GetButtonEvent()", res);
+
+    printf("%10.3f  button %d %s\n", ev.nTimeUS * 1e-6, ev.nButton,
+	   ev.bPressed ? "pressed" : "released");
+  }
+}
+
+// Write both lines nReps times, report characters per second
+void speed(CParaFace *pFace, int nReps) {
+  char line[2][17] = { "0123456789ABCDEF", "Parallella-PiFce" };
+  para_facestats st;
+  double t;
+  int n, r;
+
+  pFace->ResetStats();
+  t = Seconds();
+
+  for(n = 0; n < nReps; n++)
+    for(r = 0; r < 2; r++) {
+      check("face.SetCursor()", pFace->SetCursor(0, r));
+      check("face.Write()", pFace->Write(line[r]));
+    }
+
+  t = Seconds() - t;
+  pFace->GetStats(&st);
+
+  printf("%d characters in %.3f s, %.0f chars/s, %.1f SPI transactions/char\n",
+	 nReps * 32, t, nReps * 32 / t,
+	 (double)(st.nMcpWrites + st.nBursts + st.nMcpReads) / (nReps * 32));
+  stats(pFace);
+}
+
+// Present a status screen with a counting field, bytes per frame
+void frames(CParaFace *pFace, int nFrames) {
+  char screen[2][16], line[17];
+  para_facestats st;
+  double t;
+  int n, nBytes, nFirst = 0;
+
+  pFace->ResetStats();
+  t = Seconds();
+
+  for(n = 0; n < nFrames; n++) {
+    snprintf(line, sizeof(line), "Frame %10d", n);
+    memcpy(screen[0], line, 16);
+    snprintf(line, sizeof(line), "Status: %-8s", (n / 10) & 1 ? "busy" : "idle");
+    memcpy(screen[1], line, 16);
+    check("face.Present()", pFace->Present(screen, &nBytes));
+    if(!n)
+      nFirst = nBytes;
+  }
+
+  t = Seconds() - t;
+  pFace->GetStats(&st);
+
+  printf("%d frames in %.3f s, %.0f frames/s\n", nFrames, t, nFrames / t);
+  printf("First frame %d LCD bytes, average %.1f bytes/frame\n", nFirst,
+	 (double)st.nFrameBytes / st.nFrames);
+  stats(pFace);
+}
+
+// A bar graph on the top row and a pulsing dot below, 5 bar glyphs plus
+// 3 dot glyphs just fill CGRAM, so only the first use of each misses
+void glyphs(CParaFace *pFace, int nFrames) {
+  static const unsigned char dot[3][8] = {
+    { 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00 },
+    { 0x00, 0x00, 0x0E, 0x0E, 0x0E, 0x00, 0x00, 0x00 },
+    { 0x00, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00, 0x00 }
+  };
+  unsigned char bar[8];
+  char screen[2][16], line[32];
+  para_facestats st;
+  int n, col, px, code;
+
+  pFace->ResetStats();
+
+  for(n = 0; n < nFrames; n++) {
+
+    // 0-80 pixels of bar, rising and falling
+    px = n % 160 < 80 ? n % 160 : 160 - n % 160;
+
+    for(col = 0; col < 16; col++, px -= 5) {
+      if(px <= 0) {
+	screen[0][col] = ' ';
+	continue;
+      }
+      memset(bar, (0x1F << (5 - (px < 5 ? px : 5))) & 0x1F, 8);
+      check("face.GetGlyph()", pFace->GetGlyph(bar, &code));
+      screen[0][col] = code;
+    }
+
+    check("face.GetGlyph()", pFace->GetGlyph(dot[n % 3], &code));
+    snprintf(line, sizeof(line), "Working  %3d%%  ", n * 100 / nFrames);
+    memcpy(screen[1], line, 16);
+    screen[1][15] = code;
+
+    check("face.Present()", pFace->Present(screen));
+    usleep(20000);
+  }
+
+  pFace->GetStats(&st);
+  printf("%d frames, %.1f LCD bytes/frame\n", nFrames,
+	 (double)st.nFrameBytes / st.nFrames);
+  stats(pFace);
+}
+
+// Queue frames along with calls that will be superseded, report how long
+// the caller spent and how long the LCD took
+void async(CParaFace *pFace, int nFrames) {
+  char line[32];
+  para_facestats st;
+  double t, tQueue;
+  int n;
+
+  check("face.SetAsync()", pFace->SetAsync(true));
+  pFace->ResetStats();
+  t = Seconds();
+
+  for(n = 0; n < nFrames; n++) {
+    check("face.SetCursor()", pFace->SetCursor(0, 0));
+    snprintf(line, sizeof(line), "Frame %10d", n);
+    check("face.Write()", pFace->Write(line));
+    check("face.SetCursor()", pFace->SetCursor(0, 1));
+    snprintf(line, sizeof(line), "Status: %-8s", (n / 10) & 1 ? "busy" : "idle");
+    check("face.Write()", pFace->Write(line));
+    check("face.Backlight()", pFace->Backlight(n & 1));
+    check("face.Home()", pFace->Home());
+  }
+  check("face.Backlight()", pFace->Backlight(1));
+
+  tQueue = Seconds() - t;
+  check("face.Flush()", pFace->Flush());
+  t = Seconds() - t;
+  check("face.SetAsync()", pFace->SetAsync(false));
+  pFace->GetStats(&st);
+
+  printf("%d frames queued in %.3f ms, on the LCD after %.3f s\n",
+	 nFrames, tQueue * 1e3, t);
+  printf("%llu calls sent in %llu batches, %llu superseded, %llu LCD bytes of text\n",
+	 st.nAsyncCalls, st.nAsyncBatches, st.nAsyncSuperseded, st.nFrameBytes);
+  stats(pFace);
+}
+
 int main(int argc, char *argv[]) {
-  int nCLK=65, nMOSI=66, nMISO=68, nSS=64, run=1, c, m, n;
+  int nCLK=65, nMOSI=66, nMISO=68, nSS=64, nINT=-1, run=1, c, m, n;
   char str[256];
   unsigned rval=0;
   CParaFace face;
+  para_gpiobackend eBackend=para_bksysfs;
 
   printf("FACETEST - Basic test of Parallella -> PiFace CAD Interface\n\n");
 
-  while ((c = getopt(argc, argv, "h")) != -1) {
+  while ((c = getopt(argc, argv, "hkxbi:")) != -1) {
     switch (c) {
 
     case 'h':
       Usage();
       exit(0);
 
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'x':
+      eBackend = para_bkmmio;
+      break;
+
+    case 'b':
+      face.SetBusyWait(true);
+      break;
+
+    case 'i':
+      nINT = atoi(optarg);
+      break;
+
     case '?':
-      if (optopt == 'w')
+      if (optopt == 'i')
 	fprintf (stderr, "Option -%c requires an argument.\n", optopt);
       else if (isprint (optopt))
 	fprintf (stderr, "Unknown option `-%c'.\n", optopt);
@@ -149,11 +358,16 @@ int main(int argc, char *argv[]) {
 
   printf("Initializing object...\n");
 
+  check("face.SetBackend()", face.SetBackend(eBackend));
+
   check("face.AssignPins()", 
 	face.AssignPins(nCLK, nMOSI, nMISO, nSS));
 
   check("face.Init()", face.Init());
 
+  if(nINT >= 0)
+    check("face.StartButtons()", face.StartButtons(nINT));
+
   printf("Success\n");
 
   menu();
@@ -262,6 +476,39 @@ int main(int argc, char *argv[]) {
       printf("Button status: 0x%02X\n", rval);
       break;
 
+    case 'e':
+      if(nINT < 0) {
+	printf("Start with -i to use button events\n");
+	break;
+      }
+      events(&face, 10);
+      break;
+
+    case 't':
+      printf("One register write per EN edge:\n");
+      face.SetBurst(false);
+      speed(&face, 10);
+      printf("\nBurst writes:\n");
+      face.SetBurst(true);
+      speed(&face, 10);
+      break;
+
+    case 'f':
+      frames(&face, 100);
+      break;
+
+    case 'g':
+      glyphs(&face, 200);
+      break;
+
+    case 'a':
+      async(&face, 100);
+      break;
+
+    case 'S':
+      stats(&face);
+      break;
+
     case 'q':
     case 'Q':
       run = 0;
@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  gpiocap.cpp
+
+  Software logic analyzer for the Parallella GPIOs.  Samples a group of
+    GPIO inputs at a fixed rate, as fast as possible, or on every edge,
+    optionally around a trigger condition, and writes the capture as a
+    Value Change Dump (VCD) file.
+
+  Build:
+  gcc -o gpiocap gpiocap.cpp para_gpiocap.cpp para_gpio.cpp para_gpio.c -lstdc++ -pthread -Wall
+
+  Notes:
+    With -m and PARA_GPIOMEM set to a 4kB file, no GPIO hardware is
+    needed, the pins read whatever is in the file's DATA_RO registers.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include "para_gpiocap.h"
+
+void Usage() {
+
+  printf("Usage:  gpiocap -h  (show this help)\n");
+  printf("        gpiocap [-k | -m] [-f HZ | -e] [-t P=L] [-b N] [-a N] [-d N]\n");
+  printf("                [-s S] [-o RING] [-w VCD] PP [QQ ...]\n\n");
+
+  printf("    options:\n");
+  printf("        -k      : Use the GPIO character device (needed for -e with\n");
+  printf("                  kernel timestamps)\n");
+  printf("        -m      : Use the GPIO registers through /dev/mem (or $PARA_GPIOMEM)\n");
+  printf("        -f HZ   : Sample rate (default 0 = as fast as possible)\n");
+  printf("        -e      : Sample on every edge instead of at a fixed rate\n");
+  printf("        -t P=L  : Trigger when pin P (0 = first PP) is at level L\n");
+  printf("        -b N    : Keep N samples before the trigger (default 1000)\n");
+  printf("        -a N    : Stop N samples after the trigger (default 10000)\n");
+  printf("        -d N    : Ring size in samples (default 65536)\n");
+  printf("        -s S    : Give up after S seconds (default 10)\n");
+  printf("        -o RING : Keep the ring in the memory-mapped file RING\n");
+  printf("        -w VCD  : Output file (default gpiocap.vcd)\n\n");
+
+  printf("        PP QQ ... : GPIO IDs to capture\n\n");
+
+  printf("Note: This application needs (probably root) access to /sys/class/gpio\n");
+  printf("\n");
+
+}
+
+int main(int argc, char *argv[]) {
+  int c, nPins=0, nIDs[MAXPINSPEROBJECT], nPre=1000, nPost=10000, nDepth=0;
+  int nTrigPin=-1, nTrigLevel=1, nSecs=10, res;
+  long long nPeriodNS=0;
+  double fRate;
+  const char *strRing=NULL, *strVCD="gpiocap.vcd";
+  para_gpiobackend eBackend = para_bksysfs;
+  unsigned long long samples, dropped, gap;
+  CParaGpio *gpio;
+  CParaGpioCap *cap;
+
+  printf("GPIOCAP - Parallella GPIO logic analyzer\n\n");
+
+  while ((c = getopt(argc, argv, "hkmf:et:b:a:d:s:o:w:")) != -1) {
+    switch (c) {
+
+    case 'h':
+      Usage();
+      exit(0);
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'm':
+      eBackend = para_bkmmio;
+      break;
+
+    case 'f':
+      fRate = atof(optarg);
+      if(fRate < 0.) {
+	fprintf(stderr, "Sample rate must not be negative, exiting\n");
+	exit(1);
+      }
+      nPeriodNS = fRate > 0. ? (long long)(1e9 / fRate) : 0;
+      break;
+
+    case 'e':
+      nPeriodNS = PARA_CAPEDGES;
+      break;
+
+    case 't':
+      if(sscanf(optarg, "%d=%d", &nTrigPin, &nTrigLevel) != 2 ||
+	 nTrigPin < 0 || nTrigPin >= MAXPINSPEROBJECT) {
+	fprintf(stderr, "Trigger must be given as PIN=LEVEL, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'b':
+      nPre = atoi(optarg);
+      break;
+
+    case 'a':
+      nPost = atoi(optarg);
+      break;
+
+    case 'd':
+      nDepth = atoi(optarg);
+      break;
+
+    case 's':
+      nSecs = atoi(optarg);
+      break;
+
+    case 'o':
+      strRing = optarg;
+      break;
+
+    case 'w':
+      strVCD = optarg;
+      break;
+
+    case '?':
+      if (isprint (optopt))
+	fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+      else
+	fprintf (stderr,
+		 "Unknown option character `\\x%x'.\n",
+		 optopt);
+      exit(1);
+
+    default:
+      fprintf(stderr, "Unexpected result from getopt?? (%d:%c)\n", c, c);
+      exit(1);
+    }
+  }
+
+  for(nPins = 0; optind < argc && nPins < MAXPINSPEROBJECT; optind++)
+    nIDs[nPins++] = atoi(argv[optind]);
+
+  if(!nPins) {
+    Usage();
+    exit(1);
+  }
+
+  gpio = new CParaGpio(nIDs, nPins, false, eBackend);
+  if(!gpio->IsOK()) {
+    fprintf(stderr, "Object creation failed, exiting\n");
+    delete gpio;
+    exit(2);
+  }
+
+  res = gpio->SetDirection(para_dirin);
+  if(res != para_ok) {
+    fprintf(stderr, "SetDirection() failed with code %d, exiting\n", res);
+    delete gpio;
+    exit(3);
+  }
+
+  cap = new CParaGpioCap(gpio, (nPins < 64 ? 1ULL << nPins : 0ULL) - 1);
+
+  if(nTrigPin >= 0) {
+    cap->SetTrigger(1ULL << nTrigPin, (unsigned long long)(nTrigLevel & 1) << nTrigPin,
+		    nPre, nPost);
+    printf("Trigger on pin %d = %d, %d samples before & %d after\n",
+	   nTrigPin, nTrigLevel & 1, nPre, nPost);
+  }
+
+  if(nPeriodNS == PARA_CAPEDGES)
+    printf("Capturing %d pins on edges", nPins);
+  else if(nPeriodNS)
+    printf("Capturing %d pins every %lld ns", nPins, nPeriodNS);
+  else
+    printf("Capturing %d pins as fast as possible", nPins);
+  printf(" for up to %d seconds\n", nSecs);
+
+  res = cap->Start(nPeriodNS, strRing, nDepth);
+  if(res != para_ok) {
+    fprintf(stderr, "Start() failed with code %d, exiting\n", res);
+    delete cap;
+    delete gpio;
+    exit(4);
+  }
+
+  if(cap->Wait(nSecs * 1000) == para_timeout)
+    printf("%s\n", nTrigPin >= 0 && !cap->IsTriggered() ?
+	   "Timed out without a trigger" : "Time limit reached");
+
+  cap->Stop();
+
+  if(cap->GetError() != para_ok)
+    fprintf(stderr, "Capture stopped with code %d\n", cap->GetError());
+
+  cap->GetStats(&samples, &dropped, &gap);
+  printf("%llu samples, %llu dropped, longest gap %llu ns\n", samples, dropped, gap);
+  if(dropped)
+    printf("WARNING: samples were dropped, try a lower rate\n");
+
+  res = cap->WriteVCD(strVCD);
+  if(res == para_ok)
+    printf("Wrote %s\n", strVCD);
+
+  delete cap;
+  delete gpio;
+
+  return 0;
+}
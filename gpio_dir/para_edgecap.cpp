@@ -0,0 +1,284 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_edgecap.cpp
+  See the header file para_edgecap.h for description & usage info.
+
+*/
+
+#include "para_edgecap.h"
+
+#define EDGECAPBATCH    64   // records fetched from the source at once
+#define EDGECAPTIMEOUT  100  // msec, how often the thread checks for Stop()
+
+CParaEdgeCap::CParaEdgeCap() {
+
+  m_pGpio = NULL;
+  m_nMask = 0;
+  m_pfnSource = NULL;
+  m_pSourceArg = NULL;
+  m_pRing = NULL;
+  m_nSize = 0;
+  m_nHead = m_nTail = 0;
+  m_nCaptured = m_nOverflow = 0;
+  m_nError = para_ok;
+  m_nStop = 0;
+  m_bRunning = false;
+}
+
+CParaEdgeCap::CParaEdgeCap(CParaGpio *pGpio, unsigned long long nMask,
+                           int nDepth/*=4096*/) {
+
+  m_pGpio = NULL;
+  m_nMask = 0;
+  m_pfnSource = NULL;
+  m_pSourceArg = NULL;
+  m_pRing = NULL;
+  m_nSize = 0;
+  m_nHead = m_nTail = 0;
+  m_nCaptured = m_nOverflow = 0;
+  m_nError = para_ok;
+  m_nStop = 0;
+  m_bRunning = false;
+
+  Attach(pGpio, nMask, nDepth);
+}
+
+CParaEdgeCap::~CParaEdgeCap() {
+
+  Stop();
+  free(m_pRing);
+}
+
+int CParaEdgeCap::Attach(CParaGpio *pGpio, unsigned long long nMask,
+                         int nDepth/*=4096*/) {
+  int res;
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  res = AllocRing(nDepth);
+  if(res)
+    return res;
+
+  m_pGpio = pGpio;
+  m_nMask = nMask;
+  m_pfnSource = NULL;
+  m_pSourceArg = NULL;
+
+  return para_ok;
+}
+
+int CParaEdgeCap::Attach(para_edgesrc pfnSource, void *pArg,
+                         int nDepth/*=4096*/) {
+  int res;
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  if(pfnSource == NULL)
+    return para_badarg;
+
+  res = AllocRing(nDepth);
+  if(res)
+    return res;
+
+  m_pGpio = NULL;
+  m_nMask = 0;
+  m_pfnSource = pfnSource;
+  m_pSourceArg = pArg;
+
+  return para_ok;
+}
+
+int CParaEdgeCap::Start() {
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  if(m_pRing == NULL)
+    return para_notopen;
+
+  m_nStop = 0;
+  m_nError = para_ok;
+
+  if(pthread_create(&m_thread, NULL, ThreadProc, this))
+    return para_outofmemory;
+
+  m_bRunning = true;
+
+  return para_ok;
+}
+
+int CParaEdgeCap::Stop() {
+
+  if(!m_bRunning)
+    return para_ok;
+
+  __atomic_store_n(&m_nStop, 1, __ATOMIC_RELEASE);
+  pthread_join(m_thread, NULL);
+  m_bRunning = false;
+
+  return para_ok;
+}
+
+int CParaEdgeCap::Drain(para_edge *pEdges, int nMax, int *pCount) {
+  unsigned head, tail;
+  int n;
+
+  if(pEdges == NULL || pCount == NULL || nMax < 0)
+    return para_badarg;
+
+  *pCount = 0;
+
+  if(m_pRing == NULL)
+    return para_notopen;
+
+  // Acquire pairs with the release in Run(), the records are complete
+  head = __atomic_load_n(&m_nHead, __ATOMIC_ACQUIRE);
+  tail = m_nTail;
+
+  for(n = 0; n < nMax && tail != head; n++, tail++)
+    pEdges[n] = m_pRing[tail & (m_nSize - 1)];
+
+  // Release hands the slots back to the capture thread
+  __atomic_store_n(&m_nTail, tail, __ATOMIC_RELEASE);
+  *pCount = n;
+
+  return para_ok;
+}
+
+int CParaEdgeCap::GetStats(unsigned long long *pCaptured,
+                           unsigned long long *pOverflow,
+                           unsigned long long *pLost) {
+
+  if(pCaptured)
+    *pCaptured = __atomic_load_n(&m_nCaptured, __ATOMIC_RELAXED);
+  if(pOverflow)
+    *pOverflow = __atomic_load_n(&m_nOverflow, __ATOMIC_RELAXED);
+  if(pLost)
+    *pLost = GetSourceLost();
+
+  return para_ok;
+}
+
+// Internal functions
+void *CParaEdgeCap::ThreadProc(void *pArg) {
+
+  ((CParaEdgeCap *)pArg)->Run();
+
+  return NULL;
+}
+
+void CParaEdgeCap::Run() {
+  para_edge buf[EDGECAPBATCH];
+  unsigned head, tail;
+  int n, count, res;
+
+  head = m_nHead;
+
+  while(!__atomic_load_n(&m_nStop, __ATOMIC_ACQUIRE)) {
+
+    res = Source(buf, EDGECAPBATCH, EDGECAPTIMEOUT, &count);
+
+    if(res == para_timeout)
+      continue;
+
+    if(res != para_ok) {
+      __atomic_store_n(&m_nError, res, __ATOMIC_RELEASE);
+      break;
+    }
+
+    tail = __atomic_load_n(&m_nTail, __ATOMIC_ACQUIRE);
+
+    for(n = 0; n < count; n++) {
+
+      if(head - tail >= m_nSize) {
+	// Full, re-check in case Drain() freed some space meanwhile
+	tail = __atomic_load_n(&m_nTail, __ATOMIC_ACQUIRE);
+	if(head - tail >= m_nSize) {
+	  __atomic_fetch_add(&m_nOverflow, count - n, __ATOMIC_RELAXED);
+	  break;
+	}
+      }
+
+      m_pRing[head & (m_nSize - 1)] = buf[n];
+      head++;
+    }
+
+    // Publish the whole batch at once
+    __atomic_store_n(&m_nHead, head, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&m_nCaptured, n, __ATOMIC_RELAXED);
+  }
+}
+
+int CParaEdgeCap::AllocRing(int nDepth) {
+  unsigned size;
+
+  if(nDepth <= 0)
+    return para_badarg;
+
+  for(size = 1; size < (unsigned)nDepth; size <<= 1)
+    ;
+
+  free(m_pRing);
+  m_pRing = (para_edge *)malloc(size * sizeof(para_edge));
+  if(m_pRing == NULL) {
+    m_nSize = 0;
+    return para_outofmemory;
+  }
+
+  m_nSize = size;
+  m_nHead = m_nTail = 0;
+  m_nCaptured = m_nOverflow = 0;
+
+  return para_ok;
+}
+
+int CParaEdgeCap::Source(para_edge *pEdges, int nMax, int nTimeoutMS,
+                         int *pCount) {
+
+  if(m_pfnSource)
+    return m_pfnSource(pEdges, nMax, nTimeoutMS, pCount, m_pSourceArg);
+
+  if(m_pGpio == NULL) {
+    *pCount = 0;
+    return para_notopen;
+  }
+
+  return m_pGpio->ReadEdges(m_nMask, pEdges, nMax, nTimeoutMS, pCount);
+}
+
+unsigned long long CParaEdgeCap::GetSourceLost() {
+
+  return (m_pGpio && !m_pfnSource) ? m_pGpio->GetLostEdges() : 0;
+}
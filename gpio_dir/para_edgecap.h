@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_edgecap.h
+
+  Header file for the para_edgecap library, which records every edge on
+  a group of CParaGpio pins from a background thread.  Each edge is
+  stored with a CLOCK_MONOTONIC nanosecond timestamp, the pin (bit
+  number within the CParaGpio object) and the level after the edge, in
+  a single-producer / single-consumer lock-free ring.  The application
+  drains the ring whenever it likes without ever blocking the capture.
+
+  Member functions:
+
+    Except for the constructors, all functions return 0 (success) or an
+      error code from para_gpio.h.
+
+    CParaEdgeCap() - Constructs an object not yet attached to any pins.
+
+    CParaEdgeCap(CParaGpio *pGpio, unsigned long long nMask, int nDepth=4096) -
+      Constructs an object capturing the pins of pGpio selected by nMask.
+      nDepth is the number of records the ring holds, rounded up to a
+      power of two.  The pins should be set as inputs before Start().
+
+    Attach(CParaGpio *pGpio, unsigned long long nMask, int nDepth=4096) -
+      Same as the constructor, for an object created empty.  Not
+      allowed while running.
+
+    Attach(para_edgesrc pfnSource, void *pArg, int nDepth=4096) - Same,
+      but the edges come from pfnSource instead of GPIO pins, see
+      Simulated pin sources below.
+
+    Start() - Starts the capture thread.
+
+    Stop() - Stops the capture thread, waiting for it to exit (up to
+      ~100ms).  Records already in the ring may still be drained.
+      Called automatically when the object is destroyed.
+
+    Drain(para_edge *pEdges, int nMax, int *pCount) - Copies up to nMax
+      of the oldest records into pEdges and removes them from the ring,
+      returning the number copied in *pCount.  Never blocks, *pCount is
+      0 if nothing is waiting.  Only one thread may call Drain.
+
+    GetStats(unsigned long long *pCaptured, unsigned long long *pOverflow,
+        unsigned long long *pLost) - Returns the number of records put
+      into the ring, the number dropped because the ring was full, and
+      the number dropped by the kernel before we could read them.  Any
+      pointer may be NULL.
+
+    GetError() - Returns the error that stopped the capture thread, or
+      para_ok while it is running normally.
+
+  Simulated pin sources:
+
+    The thread normally gets its edges from CParaGpio::ReadEdges().
+      After Attach(pfnSource, pArg) it calls pfnSource(pEdges, nMax,
+      nTimeoutMS, pCount, pArg) instead, to feed the ring from something
+      else, e.g. a simulation, without any GPIO hardware.  pfnSource
+      must wait no longer than nTimeoutMS for edges and return
+      para_timeout if there were none.  It's called from the capture
+      thread, so pArg must stay valid until Stop().  Such a source
+      reports no kernel losses in GetStats().
+
+  Caveats:
+
+    Edge capture depends on the CParaGpio backend: para_bkcdev uses the
+      kernel's timestamped event queue, para_bksysfs timestamps each
+      wake-up and may merge pulses shorter than the wake-up latency,
+      para_bkmmio is not supported.
+
+*/
+
+#ifndef PARA_EDGECAP_H
+#define PARA_EDGECAP_H
+
+#include <pthread.h>
+#include "para_gpio.h"
+
+typedef int (*para_edgesrc)(para_edge *pEdges, int nMax, int nTimeoutMS,
+                            int *pCount, void *pArg);
+
+class CParaEdgeCap {
+ protected:
+  CParaGpio *m_pGpio;
+  unsigned long long m_nMask;
+  para_edgesrc m_pfnSource;  // NULL to read m_pGpio
+  void *m_pSourceArg;
+  para_edge *m_pRing;
+  unsigned m_nSize;     // power of two
+  unsigned m_nHead;     // written only by the capture thread
+  unsigned m_nTail;     // written only by Drain()
+  unsigned long long m_nCaptured;
+  unsigned long long m_nOverflow;
+  int  m_nError;
+  int  m_nStop;
+  bool m_bRunning;
+  pthread_t m_thread;
+
+  static void *ThreadProc(void *pArg);
+  void Run();
+  int Source(para_edge *pEdges, int nMax, int nTimeoutMS, int *pCount);
+  unsigned long long GetSourceLost();
+  int AllocRing(int nDepth);
+
+ public:
+  CParaEdgeCap();
+  CParaEdgeCap(CParaGpio *pGpio, unsigned long long nMask, int nDepth=4096);
+  ~CParaEdgeCap();
+  int Attach(CParaGpio *pGpio, unsigned long long nMask, int nDepth=4096);
+  int Attach(para_edgesrc pfnSource, void *pArg, int nDepth=4096);
+  int Start();
+  int Stop();
+  int Drain(para_edge *pEdges, int nMax, int *pCount);
+  int GetStats(unsigned long long *pCaptured, unsigned long long *pOverflow,
+               unsigned long long *pLost);
+  int GetError() { return __atomic_load_n(&m_nError, __ATOMIC_ACQUIRE); }
+};
+
+#endif  // PARA_EDGECAP_H
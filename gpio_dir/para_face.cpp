@@ -38,6 +38,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "para_face.h"
 #include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+static unsigned long long FaceNowUS() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
 CParaFace::CParaFace() {
 
@@ -51,6 +61,25 @@ CParaFace::CParaFace() {
   m_bCursor = false;
   m_bBlink = false;
   m_bOn = false;
+
+  m_nMcpValid = 0;
+  m_bBank1 = false;
+  m_bBurst = true;
+  m_bBusyWait = false;
+  m_bLcdReady = false;
+  m_nBusyTimeoutUS = FACEBUSYUS;
+  m_nBusyFails = 0;
+  memset(m_nLearnUS, 0, sizeof(m_nLearnUS));
+  m_nPollUS = 0;
+  m_nXferUS = 0;
+  m_nScreenValid = 0;
+  m_nAddr = -1;
+  m_bCGAddr = false;
+  m_nGlyphValid = 0;
+  m_nGlyphTick = 0;
+  m_eBackend = para_bksysfs;
+  InitThreads();
+  ResetStats();
   
 }
 
@@ -66,10 +95,44 @@ CParaFace::CParaFace(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder/*
   m_bCursor = false;
   m_bBlink = false;
   m_bOn = false;
+
+  m_nMcpValid = 0;
+  m_bBank1 = false;
+  m_bBurst = true;
+  m_bBusyWait = false;
+  m_bLcdReady = false;
+  m_nBusyTimeoutUS = FACEBUSYUS;
+  m_nBusyFails = 0;
+  memset(m_nLearnUS, 0, sizeof(m_nLearnUS));
+  m_nPollUS = 0;
+  m_nXferUS = 0;
+  m_nScreenValid = 0;
+  m_nAddr = -1;
+  m_bCGAddr = false;
+  m_nGlyphValid = 0;
+  m_nGlyphTick = 0;
+  m_eBackend = para_bksysfs;
+  InitThreads();
+  ResetStats();
 }
 
 CParaFace::~CParaFace() {
 
+  SetAsync(false);
+  StopButtons();
+
+  // Leave the MCP23S17 in the power-on BANK = 0 map for other PiFace
+  // code, clearing IOCON (0x05 in BANK = 1)
+  if(m_bBank1) {
+    McpSet(FACEMCP_IOCON, 0x00);
+    m_bBank1 = false;
+  }
+
+  pthread_cond_destroy(&m_condQDone);
+  pthread_cond_destroy(&m_condQWork);
+  pthread_mutex_destroy(&m_qmutex);
+  pthread_cond_destroy(&m_condEvent);
+  pthread_mutex_destroy(&m_mutex);
 }
 
 int CParaFace::AssignPins(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder/*=false*/) {
@@ -84,13 +147,34 @@ int CParaFace::AssignPins(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOr
 }
 
 int CParaFace::Init() {
+  unsigned long long t0;
+  unsigned val;
   int res;
 
+  if(m_bAsync)
+    return para_alreadyopen;
+
   // Set-up the SPI object
   res = spi.AssignPins(m_nCLK, m_nMOSI, m_nMISO, m_nCE, m_bPorcuOrder);
   if(res) return res;
 
-  // Set-up the MCP23S17, we assume IOCON.BANK = 0 (reset value)
+  m_nMcpValid = 0;  // The chip may hold anything
+  m_bBank1 = false;
+  m_bLcdReady = false;
+  m_nScreenValid = 0;  // nor do we know what the LCD shows
+  m_nAddr = -1;
+  m_bCGAddr = false;
+  m_nGlyphValid = 0;  // or what's in CGRAM
+
+  // Set-up the MCP23S17.  An earlier run may have left it in BANK = 1,
+  // where 0x05 is IOCON, so clearing 0x05 returns it to BANK = 0.  In
+  // BANK = 0 it's GPINTENB, which should be 0 anyway.
+  res = McpSet(FACEMCP_GPINTENB, 0x00);
+  if(res) return res;
+  res = McpSet(FACEMCP_IOCON, FACEIOCON_BANK | FACEIOCON_SEQOP);
+  if(res) return res;
+  m_bBank1 = true;  // Now the address pointer holds for bursts
+
   // Set Port A as inputs
   res = McpSet(FACEMCP_IODIRA, 0xFF);
   if(res) return res;
@@ -116,38 +200,77 @@ int CParaFace::Init() {
 
   res = LcdSendIR(0x20, 1);  // NOW we can set 4-bit mode safely
   if(res) return res;
+  m_bLcdReady = true;  // and read the busy flag
+
+  if(m_bBusyWait) {
+
+    // Time one status read, it's the granularity of every wait
+    t0 = FaceNowUS();
+    res = LcdGetStatus(NULL);
+    if(res) return res;
+    m_nPollUS = FaceNowUS() - t0;
+
+    // and one register read, the least the next LCD byte can take
+    t0 = FaceNowUS();
+    res = McpGet(FACEMCP_GPIOA, &val);
+    if(res) return res;
+    m_nXferUS = FaceNowUS() - t0;
+    memset(m_nLearnUS, 0, sizeof(m_nLearnUS));
+  }
+
   res = LcdSendIR(0x28);  // Set lsbs for 2-line 5x8 mode
   if(res) return res;
   res = LcdSendIR(0x06);  // Auto-increment the DDRAM address
   if(res) return res;
 
+  if(m_bBusyWait) {
+    res = Home();  // learn the slow one too
+    if(res) return res;
+  }
+
   return para_ok;
 }
 
 int CParaFace::Backlight(bool bOn) {
-  unsigned val;
 
-  val = bOn ? FACELCD_LED : 0;
-  m_bBacklight = bOn;
+  if(m_bAsync) {
+    QueueLock();
+    if(m_pend.nFlags & FACEQ_BACKLIGHT)
+      m_stats.nAsyncSuperseded++;
+    m_pend.nFlags |= FACEQ_BACKLIGHT;
+    m_pend.bBacklight = bOn;
+    QueueKick();
+    return para_ok;
+  }
 
-  return McpSet(FACEMCP_GPIOB, val);
+  return SetLed(bOn);
 }
 
 int CParaFace::Display(bool bOn) {
-  unsigned val;
 
-  m_bOn = bOn;
+  if(m_bAsync) {
+    QueueLock();
+    m_bOn = bOn;
+    QueueDisplay();
+    QueueKick();
+    return para_ok;
+  }
 
-  val = 0x08 // Display on/off control
-    | (m_bOn ? 0x04 : 0)
-    | (m_bCursor ? 0x02 : 0)
-    | (m_bBlink ? 0x01 : 0);
+  m_bOn = bOn;
 
-  return LcdSendIR(val);
+  return LcdSendIR(DisplayCmd());
 }
 
 int CParaFace::Blink(bool bOn) {
 
+  if(m_bAsync) {
+    QueueLock();
+    m_bBlink = bOn;
+    QueueDisplay();
+    QueueKick();
+    return para_ok;
+  }
+
   m_bBlink = bOn;
 
   return Display(m_bOn);
@@ -155,38 +278,63 @@ int CParaFace::Blink(bool bOn) {
 
 int CParaFace::Cursor(bool bOn) {
 
+  if(m_bAsync) {
+    QueueLock();
+    m_bCursor = bOn;
+    QueueDisplay();
+    QueueKick();
+    return para_ok;
+  }
+
   m_bCursor = bOn;
 
   return Display(m_bOn);
 }
 
 int CParaFace::Clear() {
-  int res;
-
-  res = LcdSendIR(1);
 
-  if(res == para_ok)
-    usleep(5000);  // TODO: Add wait for BF here, DS doesn't say how long this takes!
+  if(m_bAsync) {
+    QueueLock();
+    m_stats.nAsyncSuperseded += __builtin_popcount(m_pend.nCells)
+      + ((m_pend.nFlags & FACEQ_CLEAR) ? 1 : 0);
+    m_pend.nFlags |= FACEQ_CLEAR;
+    m_pend.nCells = 0;
+    m_pend.nAddr = 0;
+    memset(m_cQScreen, ' ', sizeof(m_cQScreen));
+    m_nQScreenValid = ~0U;
+    QueueKick();
+    return para_ok;
+  }
 
-  return res;
+  return LcdSendIR(1, 2, FACEWAIT_CLEAR);  // DS doesn't say how long this takes!
 }
 
 int CParaFace::GetCursor(int *pnCol, int *pnRow) {
+  int res, addr = m_nAddr;
+
+  if(m_bAsync) {
+    QueueLock();
+    addr = m_pend.nAddr;
+    pthread_mutex_unlock(&m_qmutex);
+  } else if(addr < 0 || m_bCGAddr) {
+    res = LcdGetStatus(NULL, &addr);
+    if(res) return res;
+  }
 
-  // TODO: Add this!
+  if(pnRow)
+    *pnRow = addr >= 0x40 ? 1 : 0;
+  if(pnCol)
+    *pnCol = addr & 0x3F;
 
   return para_ok;
 }
 
 int CParaFace::Home() {
-  int res;
-
-  res = LcdSendIR(2);
 
-  if(res == para_ok)
-    usleep(2000);
+  if(m_bAsync)
+    return SetCursor(0, 0);
 
-  return res;
+  return LcdSendIR(2, 2, FACEWAIT_HOME);
 }
  
 int CParaFace::SetCursor(int nCol, int nRow) {
@@ -194,12 +342,30 @@ int CParaFace::SetCursor(int nCol, int nRow) {
 
   val = 0x80 | (nRow << 6) | nCol;
 
+  if(m_bAsync) {
+    QueueLock();
+    if(m_pend.nFlags & FACEQ_CURSOR)
+      m_stats.nAsyncSuperseded++;
+    m_pend.nFlags |= FACEQ_CURSOR;
+    m_pend.nAddr = val & 0x7F;
+    QueueKick();
+    return para_ok;
+  }
+
   return LcdSendIR(val);
 }
 
 int CParaFace::Write(char *str) {
   int res, n;
 
+  if(m_bAsync) {
+    QueueLock();
+    for(n=0; str[n]; n++)
+      QueueCell(str[n]);
+    QueueKick();
+    return para_ok;
+  }
+
   for(n=0; str[n]; n++) {
 
     res = LcdSendDR(str[n]);
@@ -209,112 +375,811 @@ int CParaFace::Write(char *str) {
   return para_ok;
 }
 
+int CParaFace::Present(const char screen[2][16], int *pnBytes/*=NULL*/) {
+  int res, nBytes = 0;
+
+  if(screen == NULL)
+    return para_badarg;
+
+  if(m_bAsync) {
+    QueueLock();
+    m_stats.nAsyncSuperseded += __builtin_popcount(m_pend.nCells);
+    memcpy(m_pend.cCells, screen, sizeof(m_pend.cCells));
+    m_pend.nCells = ~0U;
+    memcpy(m_cQScreen, screen, sizeof(m_cQScreen));
+    m_nQScreenValid = ~0U;
+    m_stats.nFrames++;
+    QueueKick();
+    if(pnBytes)
+      *pnBytes = 0;
+    return para_ok;
+  }
+
+  res = PresentCells(screen, ~0U, &nBytes);
+
+  m_stats.nFrames++;
+  m_stats.nFrameBytes += nBytes;
+  if(pnBytes)
+    *pnBytes = nBytes;
+
+  return res;
+}
+
+int CParaFace::GetGlyph(const unsigned char bitmap[8], int *pnCode) {
+  unsigned char rows[8];
+  int n, res;
+
+  if(bitmap == NULL || pnCode == NULL)
+    return para_badarg;
+
+  for(n = 0; n < 8; n++)
+    rows[n] = bitmap[n] & 0x1F;  // only 5 pixels are shown
+
+  if(!m_bAsync) {
+    n = GlyphHit(rows);
+    if(n >= 0) {
+      *pnCode = n;
+      return para_ok;
+    }
+    return GlyphMiss(rows, pnCode);
+  }
+
+  // The cache is the caller-side view, the load is queued
+  QueueLock();
+  n = GlyphHit(rows);
+  if(n >= 0) {
+    pthread_mutex_unlock(&m_qmutex);
+    *pnCode = n;
+    return para_ok;
+  }
+  res = GlyphMiss(rows, pnCode);
+  QueueKick();
+
+  return res;
+}
+
 int CParaFace::GetButtons(unsigned *pButtons) {
 
+  // Reading GPIOA would release INTA under the button thread
+  if(m_bRunning) {
+    pthread_mutex_lock(&m_mutex);
+    *pButtons = m_nButtons;
+    pthread_mutex_unlock(&m_mutex);
+    return para_ok;
+  }
+
   return McpGet(FACEMCP_GPIOA, pButtons);
 }
 
+int CParaFace::StartButtons(int nIntGpio, para_facecb pfnEvent/*=NULL*/, void *pArg/*=NULL*/,
+                            unsigned nDebounceMS/*=FACEDEBOUNCEMS*/) {
+  para_edge edge;
+  unsigned val;
+  int res, count;
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  // INTA is active-low push-pull by default, an input to us
+  m_intGpio.Close();
+  res = m_intGpio.SetBackend(m_eBackend);
+  if(res) goto startfail;
+  res = m_intGpio.AddPin(nIntGpio);
+  if(res) goto startfail;
+  res = m_intGpio.SetDirection(para_dirin);
+  if(res) goto startfail;
+
+  // Start collecting edges before INTA can next fall, see ButtonRun().
+  // Only para_bkmmio, which has no edge detection, falls back to polling.
+  res = m_intGpio.ReadEdges(1, &edge, 1, 0, &count);
+  if(res == para_timeout ||
+     (res == para_noaccess && m_eBackend == para_bkmmio))
+    res = para_ok;
+  if(res) goto startfail;
+
+  m_pfnEvent = pfnEvent;
+  m_pEventArg = pArg;
+  m_nDebounceMS = nDebounceMS;
+  m_nEvHead = m_nEvTail = 0;
+
+  // Interrupt on any change from the previous level
+  res = McpSet(FACEMCP_INTCONA, 0x00);
+  if(res) goto startfail;
+  res = McpSet(FACEMCP_GPINTENA, 0xFF);
+  if(res) goto startfail;
+
+  // Start from the present levels, which also clears anything pending
+  res = McpGet(FACEMCP_INTCAPA, &val);
+  if(res) goto startfail;
+  res = McpGet(FACEMCP_GPIOA, &val);
+  if(res) goto startfail;
+  m_nButtons = val;
+
+  m_nStop = 0;
+
+  if(pthread_create(&m_thread, NULL, ButtonProc, this)) {
+    res = para_outofmemory;
+    goto startfail;
+  }
+
+  m_bRunning = true;
+
+  return para_ok;
+
+ startfail:
+  McpSet(FACEMCP_GPINTENA, 0x00);
+  m_intGpio.Close();
+
+  return res;
+}
+
+int CParaFace::StopButtons() {
+
+  if(!m_bRunning)
+    return para_ok;
+
+  __atomic_store_n(&m_nStop, 1, __ATOMIC_RELEASE);
+  pthread_join(m_thread, NULL);
+  m_bRunning = false;
+  m_intGpio.Close();
+
+  return McpSet(FACEMCP_GPINTENA, 0x00);
+}
+
+int CParaFace::GetButtonEvent(para_faceevent *pEvent, int nTimeoutMS/*=0*/) {
+  struct timespec ts;
+  unsigned long long tEnd;
+  int res = 0;
+
+  if(pEvent == NULL)
+    return para_badarg;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  tEnd = ts.tv_sec * 1000000000ULL + ts.tv_nsec + nTimeoutMS * 1000000ULL;
+  ts.tv_sec = tEnd / 1000000000ULL;
+  ts.tv_nsec = tEnd % 1000000000ULL;
+
+  pthread_mutex_lock(&m_mutex);
+  while(m_nEvHead == m_nEvTail && nTimeoutMS && res != ETIMEDOUT) {
+    if(nTimeoutMS < 0)
+      pthread_cond_wait(&m_condEvent, &m_mutex);
+    else
+      res = pthread_cond_timedwait(&m_condEvent, &m_mutex, &ts);
+  }
+
+  if(m_nEvHead == m_nEvTail) {
+    pthread_mutex_unlock(&m_mutex);
+    return para_timeout;
+  }
+
+  *pEvent = m_events[m_nEvTail++ & (FACEEVENTQ - 1)];
+  pthread_mutex_unlock(&m_mutex);
+
+  return para_ok;
+}
+
+void CParaFace::SetBusyWait(bool bOn, unsigned nTimeoutUS/*=FACEBUSYUS*/) {
+
+  m_bBusyWait = bOn;
+  m_nBusyTimeoutUS = nTimeoutUS;
+  m_nBusyFails = 0;
+}
+
+int CParaFace::GetLatencies(unsigned *pCmdUS, unsigned *pHomeUS, unsigned *pClearUS) {
+
+  pthread_mutex_lock(&m_mutex);
+  if(pCmdUS)
+    *pCmdUS = m_nLearnUS[FACEWAIT_CMD];
+  if(pHomeUS)
+    *pHomeUS = m_nLearnUS[FACEWAIT_HOME];
+  if(pClearUS)
+    *pClearUS = m_nLearnUS[FACEWAIT_CLEAR];
+  pthread_mutex_unlock(&m_mutex);
+
+  return para_ok;
+}
+
+int CParaFace::SetAsync(bool bOn) {
+  int res;
+
+  if(bOn == m_bAsync)
+    return para_ok;
+
+  if(bOn) {
+
+    // Calls are queued against a known cursor address
+    if(m_nAddr < 0 || m_bCGAddr) {
+      res = LcdSendIR(0x80);
+      if(res) return res;
+    }
+
+    memset(&m_pend, 0, sizeof(m_pend));
+    m_pend.nAddr = m_nAddr;
+    memcpy(m_cQScreen, m_cScreen, sizeof(m_cQScreen));
+    m_nQScreenValid = m_nScreenValid;
+    m_nQSeq = m_nQDone = 0;
+    m_nQError = para_ok;
+    m_nQStop = 0;
+
+    if(pthread_create(&m_qthread, NULL, DisplayProc, this))
+      return para_outofmemory;
+
+    m_bAsync = true;
+
+    return para_ok;
+  }
+
+  // The thread sends what's left before it stops
+  pthread_mutex_lock(&m_qmutex);
+  m_nQStop = 1;
+  pthread_cond_signal(&m_condQWork);
+  pthread_mutex_unlock(&m_qmutex);
+
+  pthread_join(m_qthread, NULL);
+  m_bAsync = false;
+
+  res = m_nQError;
+  m_nQError = para_ok;
+
+  return res;
+}
+
+int CParaFace::Fence(unsigned long long *pnFence) {
+
+  if(pnFence == NULL)
+    return para_badarg;
+
+  QueueLock();
+  *pnFence = m_nQSeq;
+  pthread_mutex_unlock(&m_qmutex);
+
+  return para_ok;
+}
+
+int CParaFace::WaitFence(unsigned long long nFence, int nTimeoutMS/*=-1*/) {
+  struct timespec ts;
+  unsigned long long tEnd;
+  int res = 0;
+
+  if(!m_bAsync)
+    return para_ok;  // nothing is queued
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  tEnd = ts.tv_sec * 1000000000ULL + ts.tv_nsec + nTimeoutMS * 1000000ULL;
+  ts.tv_sec = tEnd / 1000000000ULL;
+  ts.tv_nsec = tEnd % 1000000000ULL;
+
+  QueueLock();
+  while(m_nQDone < nFence && nTimeoutMS && res != ETIMEDOUT) {
+    if(nTimeoutMS < 0)
+      pthread_cond_wait(&m_condQDone, &m_qmutex);
+    else
+      res = pthread_cond_timedwait(&m_condQDone, &m_qmutex, &ts);
+  }
+
+  if(m_nQDone < nFence) {
+    pthread_mutex_unlock(&m_qmutex);
+    return para_timeout;
+  }
+
+  res = m_nQError;
+  m_nQError = para_ok;
+  pthread_mutex_unlock(&m_qmutex);
+
+  return res;
+}
+
+int CParaFace::Flush(int nTimeoutMS/*=-1*/) {
+  unsigned long long nFence;
+
+  Fence(&nFence);
+
+  return WaitFence(nFence, nTimeoutMS);
+}
+
+int CParaFace::GetStats(para_facestats *pStats) {
+
+  if(pStats == NULL)
+    return para_badarg;
+
+  pthread_mutex_lock(&m_mutex);
+  pthread_mutex_lock(&m_qmutex);
+  *pStats = m_stats;
+  pthread_mutex_unlock(&m_qmutex);
+  pthread_mutex_unlock(&m_mutex);
+
+  return para_ok;
+}
+
+void CParaFace::ResetStats() {
+
+  pthread_mutex_lock(&m_mutex);
+  pthread_mutex_lock(&m_qmutex);
+  memset(&m_stats, 0, sizeof(m_stats));
+  pthread_mutex_unlock(&m_qmutex);
+  pthread_mutex_unlock(&m_mutex);
+}
+
 // Internal functions
+int CParaFace::DisplayCmd() {
+
+  return 0x08 // Display on/off control
+    | (m_bOn ? 0x04 : 0)
+    | (m_bCursor ? 0x02 : 0)
+    | (m_bBlink ? 0x01 : 0);
+}
+
+int CParaFace::SetLed(bool bOn) {
+  unsigned val;
+
+  // Leave the LCD lines as they are if we know them
+  val = (m_nMcpValid & (1 << FACEMCP_GPIOB)) ?
+    m_nMcpRegs[FACEMCP_GPIOB] & ~FACELCD_LED : 0;
+  val |= bOn ? FACELCD_LED : 0;
+  m_bBacklight = bOn;
+
+  return McpSet(FACEMCP_GPIOB, val);
+}
+
 int CParaFace::McpSet(int nReg, unsigned nData) {
   unsigned val;
+  int res;
+
+  nData &= 0xFF;
+
+  pthread_mutex_lock(&m_mutex);
+
+  // Skip the write if the register already holds this
+  if(McpHas(nReg, nData)) {
+    m_stats.nMcpSkipped++;
+    pthread_mutex_unlock(&m_mutex);
+    return para_ok;
+  }
 
   val = (FACEMCPWR << 16)
-    | (nReg << 8)
+    | (McpAddr(nReg) << 8)
     | nData;
 
-  return spi.Xfer(24, val);
+  res = spi.Xfer(24, val);
+  m_stats.nMcpWrites++;
+
+  if(res)
+    m_nMcpValid &= ~(1 << nReg);
+  else {
+    m_nMcpRegs[nReg] = nData;
+    m_nMcpValid |= 1 << nReg;
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+
+  return res;
 }
 
 int CParaFace::McpGet(int nReg, unsigned *pData) {
   int res;
   unsigned val;
 
-  val = (FACEMCPWR << 16)
-    | (nReg << 8);
+  pthread_mutex_lock(&m_mutex);
+
+  val = (FACEMCPRD << 16)
+    | (McpAddr(nReg) << 8);
 
   res = spi.Xfer(24, val, pData);
+  m_stats.nMcpReads++;
+
+  pthread_mutex_unlock(&m_mutex);
 
   *pData &= 0xFF;
 
   return res;
 }
 
-int CParaFace::LcdSendIR(int nByte, int nCycles/*=2*/) {
-  int res;
-  unsigned val;
+// Write nLen bytes to one register with enable held, needs byte mode
+int CParaFace::McpBurst(int nReg, const unsigned char *pData, int nLen) {
+  uint8_t tx[2 + FACEBURSTMAX];
+  int n, res;
+
+  if(nLen <= 0)
+    return para_ok;
+  if(nLen > FACEBURSTMAX)
+    return para_outofrange;
+
+  if(!m_bBank1) {  // pointer would move on, one at a time
+    for(n = 0; n < nLen; n++) {
+      res = McpSet(nReg, pData[n]);
+      if(res) return res;
+    }
+    return para_ok;
+  }
 
-  val = m_bBacklight ? FACELCD_LED : 0;  // RS=RW=E=0
-  res = McpSet(FACEMCP_GPIOB, val);
-  if(res) return res;
-  res = McpSet(FACEMCP_IODIRB, 0);  // all outputs on for write
-  if(res) return res;
+  tx[0] = FACEMCPWR;
+  tx[1] = McpAddr(nReg);
+  memcpy(tx + 2, pData, nLen);
 
-  val |= ((nByte >> 4) & 0x0F) | FACELCD_EN;
-  res = McpSet(FACEMCP_GPIOB, val);
-  if(res) return res;
+  pthread_mutex_lock(&m_mutex);
 
-  val ^= FACELCD_EN;  // de-assert E
-  res = McpSet(FACEMCP_GPIOB, val);
-  if(res) return res;
+  res = spi.Transfer(tx, NULL, nLen + 2);
+  m_stats.nBursts++;
+  m_stats.nBurstBytes += nLen;
 
-  if(nCycles == 2) {
+  if(res)
+    m_nMcpValid &= ~(1 << nReg);
+  else {
+    m_nMcpRegs[nReg] = pData[nLen - 1];
+    m_nMcpValid |= 1 << nReg;
+  }
 
-    val &= 0xF0;  // clear data bits
-    val |= (nByte & 0x0F) | FACELCD_EN;
-    res = McpSet(FACEMCP_GPIOB, val);
-    if(res) return res;
+  pthread_mutex_unlock(&m_mutex);
+
+  return res;
+}
+
+// Chip address of register nReg (a BANK = 0 address) in the current bank
+int CParaFace::McpAddr(int nReg) {
+
+  if(!m_bBank1)
+    return nReg;
+
+  return ((nReg & 1) << 4) | (nReg >> 1);
+}
+
+// True if register nReg is known to hold nData
+bool CParaFace::McpHas(int nReg, unsigned nData) {
+
+  return (m_nMcpValid & (1 << nReg)) && m_nMcpRegs[nReg] == (nData & 0xFF);
+}
+
+// Data lines as last written, so a set-up write of RS/RW alone doesn't
+// need to change them (they only matter while E is high)
+unsigned CParaFace::LcdData() {
 
-    val ^= FACELCD_EN;  // de-assert E
-    res = McpSet(FACEMCP_GPIOB, val);
+  if(!(m_nMcpValid & (1 << FACEMCP_GPIOB)))
+    return 0;
+
+  return m_nMcpRegs[FACEMCP_GPIOB] & 0x0F;
+}
+
+// Clock nByte into the LCD with RS / RW / LED from nCtrl, one or both
+// nibbles.  E is pulsed by a burst of GPIOB writes if enabled.
+int CParaFace::LcdStrobe(unsigned nCtrl, int nByte, int nCycles) {
+  unsigned char seq[5];
+  int n = 0, i, res;
+
+  if(!m_bBurst || !McpHas(FACEMCP_IODIRB, 0)) {
+    res = McpSet(FACEMCP_GPIOB, nCtrl | LcdData());  // only if RS/RW/LED change
+    if(res) return res;
+    res = McpSet(FACEMCP_IODIRB, 0);  // all outputs on for write
     if(res) return res;
+  } else if(!McpHas(FACEMCP_GPIOB, nCtrl | LcdData()))
+    seq[n++] = nCtrl | LcdData();  // set-up goes first in the burst
+
+  seq[n++] = nCtrl | ((nByte >> 4) & 0x0F) | FACELCD_EN;
+  seq[n++] = nCtrl | ((nByte >> 4) & 0x0F);  // de-assert E
+
+  if(nCycles == 2) {
+    seq[n++] = nCtrl | (nByte & 0x0F) | FACELCD_EN;
+    seq[n++] = nCtrl | (nByte & 0x0F);  // de-assert E
   }
 
-  usleep(50);  // This is enough for anything EXCEPT "HOME" (1.52ms)
+  if(m_bBurst)
+    return McpBurst(FACEMCP_GPIOB, seq, n);
+
+  for(i = 0; i < n; i++) {
+    res = McpSet(FACEMCP_GPIOB, seq[i]);
+    if(res) return res;
+  }
 
   return para_ok;
 }
 
+int CParaFace::LcdSendIR(int nByte, int nCycles/*=2*/, int nWait/*=FACEWAIT_CMD*/) {
+  int res;
+
+  res = LcdStrobe(m_bBacklight ? FACELCD_LED : 0, nByte, nCycles);  // RS=RW=0
+  if(res) {
+    m_nAddr = -1;
+    return res;
+  }
+
+  if(nCycles == 2)
+    LcdTrack(nByte);
+
+  return LcdWait(nWait);
+}
+
 int CParaFace::LcdSendDR(int nByte) {
   int res;
-  unsigned val;
 
-  val = m_bBacklight ? FACELCD_LED : 0;  // RS=RW=E=0
-  val |= FACELCD_RS;
+  res = LcdStrobe((m_bBacklight ? FACELCD_LED : 0) | FACELCD_RS, nByte, 2);
+  if(res) {
+    m_nAddr = -1;
+    return res;
+  }
 
-  res = McpSet(FACEMCP_GPIOB, val);
-  if(res) return res;
-  res = McpSet(FACEMCP_IODIRB, 0);  // all outputs on for write
-  if(res) return res;
+  // Follow DDRAM writes, 2-line mode wraps 0x27 -> 0x40 -> 0x67 -> 0x00
+  if(!m_bCGAddr && m_nAddr >= 0) {
+    if((m_nAddr & 0x3F) < 16) {
+      m_cScreen[m_nAddr >> 6][m_nAddr & 0x3F] = nByte;
+      m_nScreenValid |= 1U << ((m_nAddr >> 6) * 16 + (m_nAddr & 0x3F));
+    }
+    m_nAddr = m_nAddr == 0x27 ? 0x40 : m_nAddr == 0x67 ? 0x00 : m_nAddr + 1;
+  }
 
-  val |= ((nByte >> 4) & 0x0F) | FACELCD_EN;
-  res = McpSet(FACEMCP_GPIOB, val);
-  if(res) return res;
+  return LcdWait(FACEWAIT_CMD);  // same as any short command
+}
 
-  val ^= FACELCD_EN;  // de-assert E
-  res = McpSet(FACEMCP_GPIOB, val);
-  if(res) return res;
+// Follow the effect of command nCmd on the address counter and screen
+void CParaFace::LcdTrack(int nCmd) {
+
+  if(nCmd & 0x80) {         // Set DDRAM address
+    m_nAddr = nCmd & 0x7F;
+    m_bCGAddr = false;
+  } else if(nCmd & 0x40) {  // Set CGRAM address
+    m_bCGAddr = true;
+  } else if(nCmd & 0x20) {  // Function set
+  } else if(nCmd & 0x10) {  // Cursor / display shift
+    if(nCmd & 0x08)
+      m_nScreenValid = 0;
+    m_nAddr = -1;
+  } else if(nCmd & 0x08) {  // Display control
+  } else if(nCmd & 0x04) {  // Entry mode, we only follow increment
+    if((nCmd & 0x03) != 0x02) {
+      m_nScreenValid = 0;
+      m_nAddr = -1;
+    }
+  } else if(nCmd & 0x02) {  // Home
+    m_nAddr = 0;
+    m_bCGAddr = false;
+  } else if(nCmd & 0x01) {  // Clear
+    memset(m_cScreen, ' ', sizeof(m_cScreen));
+    m_nScreenValid = ~0U;
+    m_nAddr = 0;
+    m_bCGAddr = false;
+  }
+}
 
-  val &= 0xF0;  // clear data bits
-  val |= (nByte & 0x0F) | FACELCD_EN;
-  res = McpSet(FACEMCP_GPIOB, val);
+// Write the cells of screen selected by nMask that differ from the display
+int CParaFace::PresentCells(const char screen[2][16], unsigned nMask, int *pnBytes) {
+  int nFirst, nCost[2];
+
+  // Work out which row to do first, then do it that way
+  PresentRows(screen, nMask, 0, false, &nCost[0]);
+  PresentRows(screen, nMask, 1, false, &nCost[1]);
+  nFirst = nCost[1] < nCost[0] ? 1 : 0;
+
+  return PresentRows(screen, nMask, nFirst, true, pnBytes);
+}
+
+// Bring the cells in nMask up to date starting with row nFirst, or with
+// bSend false just count the bytes it would take
+int CParaFace::PresentRows(const char screen[2][16], unsigned nMask, int nFirst, bool bSend,
+                           int *pnBytes) {
+  int res, r, row, col, addr = m_bCGAddr ? -1 : m_nAddr;
+
+  *pnBytes = 0;
+
+  for(r = 0; r < 2; r++) {
+
+    row = r ? 1 - nFirst : nFirst;
+
+    for(col = 0; col < 16; col++) {
+
+      if(!(nMask & (1U << (row * 16 + col))))
+	continue;
+
+      if((m_nScreenValid & (1U << (row * 16 + col))) &&
+	 m_cScreen[row][col] == screen[row][col])
+	continue;
+
+      if(addr != row * 0x40 + col) {
+	(*pnBytes)++;
+	if(bSend) {
+	  res = LcdSendIR(0x80 | (row << 6) | col);  // not SetCursor(), it may queue
+	  if(res) return res;
+	}
+	addr = row * 0x40 + col;
+      }
+
+      (*pnBytes)++;
+      if(bSend) {
+	res = LcdSendDR((unsigned char)screen[row][col]);
+	if(res) return res;
+      }
+      addr++;
+    }
+  }
+
+  return para_ok;
+}
+
+// Slot holding bitmap, -1 if none
+int CParaFace::GlyphHit(const unsigned char bitmap[8]) {
+  int n;
+
+  m_nGlyphTick++;
+
+  for(n = 0; n < FACEGLYPHS; n++)
+    if((m_nGlyphValid & (1 << n)) && !memcmp(m_cGlyphs[n], bitmap, 8)) {
+      m_nGlyphUsed[n] = m_nGlyphTick;
+      m_stats.nGlyphHits++;
+      return n;
+    }
+
+  return -1;
+}
+
+// Load bitmap, which isn't in CGRAM, into the best slot for it, or in
+// async mode queue the load
+int CParaFace::GlyphMiss(const unsigned char bitmap[8], int *pnCode) {
+  unsigned vis;
+  int n, res, addr, slot = -1;
+
+  m_stats.nGlyphMisses++;
+
+  // An empty slot, else the oldest off the screen, else just the oldest
+  for(n = 0; n < FACEGLYPHS && slot < 0; n++)
+    if(!(m_nGlyphValid & (1 << n)))
+      slot = n;
+
+  if(slot < 0) {
+
+    vis = GlyphsVisible();
+
+    for(n = 0; n < FACEGLYPHS; n++)
+      if(!(vis & (1 << n)) &&
+	 (slot < 0 || m_nGlyphUsed[n] < m_nGlyphUsed[slot]))
+	slot = n;
+
+    if(slot < 0) {
+      slot = 0;
+      for(n = 1; n < FACEGLYPHS; n++)
+	if(m_nGlyphUsed[n] < m_nGlyphUsed[slot])
+	  slot = n;
+      m_stats.nGlyphVisible++;
+    }
+
+    m_stats.nGlyphEvicts++;
+  }
+
+  m_nGlyphUsed[slot] = m_nGlyphTick;
+  *pnCode = slot;
+
+  if(m_bAsync) {
+    if(m_pend.nGlyphs & (1 << slot))
+      m_stats.nAsyncSuperseded++;
+    memcpy(m_pend.cGlyphs[slot], bitmap, 8);
+    m_pend.nGlyphs |= 1 << slot;
+    memcpy(m_cGlyphs[slot], bitmap, 8);
+    m_nGlyphValid |= 1 << slot;
+    return para_ok;
+  }
+
+  m_nGlyphValid &= ~(1 << slot);
+  addr = m_bCGAddr ? -1 : m_nAddr;
+
+  res = GlyphLoad(slot, bitmap);
   if(res) return res;
 
-  val ^= FACELCD_EN;  // de-assert E
-  res = McpSet(FACEMCP_GPIOB, val);
+  memcpy(m_cGlyphs[slot], bitmap, 8);
+  m_nGlyphValid |= 1 << slot;
+
+  // Writes go to DDRAM again, to the cursor position if we knew it
+  return LcdSendIR(0x80 | (addr < 0 ? 0 : addr));
+}
+
+// Bit per CGRAM slot shown in a known cell of the screen
+unsigned CParaFace::GlyphsVisible() {
+  char (*screen)[16] = m_bAsync ? m_cQScreen : m_cScreen;
+  unsigned valid = m_bAsync ? m_nQScreenValid : m_nScreenValid;
+  unsigned vis = 0;
+  int n;
+
+  for(n = 0; n < 32; n++)
+    if((valid & (1U << n)) &&
+       (unsigned char)screen[n >> 4][n & 15] < 16)
+      vis |= 1 << (screen[n >> 4][n & 15] & 7);
+
+  return vis;
+}
+
+// Write bitmap to CGRAM slot nSlot, leaving the address counter there
+int CParaFace::GlyphLoad(int nSlot, const unsigned char bitmap[8]) {
+  int n, res;
+
+  res = LcdSendIR(0x40 | (nSlot << 3));  // Set CGRAM address
   if(res) return res;
 
-  usleep(50);  // This is enough for any write to DDRAM
+  for(n = 0; n < 8; n++) {
+    res = LcdSendDR(bitmap[n]);
+    if(res) return res;
+  }
 
   return para_ok;
 }
 
+// Wait for the LCD to finish a command of class nWait, see Timing in
+// para_face.h
+int CParaFace::LcdWait(int nWait) {
+  static const unsigned nFixedUS[3] = {
+    50,    // enough for anything EXCEPT "HOME" (1.52ms)
+    2000,
+    5000
+  };
+  unsigned long long t0, t;
+  unsigned learn;
+  int res, busy, nPolls = 0;
+
+  if(!m_bBusyWait || !m_bLcdReady) {
+    usleep(nFixedUS[nWait]);
+    return para_ok;
+  }
+
+  // Stats and learned times are shared with GetStats() / GetLatencies()
+  pthread_mutex_lock(&m_mutex);
+  learn = m_nLearnUS[nWait];
+  pthread_mutex_unlock(&m_mutex);
+
+  // Once learned an ordinary command isn't polled, it's usually over
+  // before the next byte gets to the chip
+  if(nWait == FACEWAIT_CMD && learn) {
+    if(learn > m_nXferUS)
+      usleep(learn - m_nXferUS);
+    return para_ok;
+  }
+
+  t0 = FaceNowUS();
+
+  if(learn > m_nPollUS)
+    usleep(learn - m_nPollUS);
+
+  do {
+
+    res = LcdGetStatus(&busy);
+    pthread_mutex_lock(&m_mutex);
+    m_stats.nBusyPolls++;
+    pthread_mutex_unlock(&m_mutex);
+    nPolls++;
+    if(res)
+      break;
+
+    if(!busy) {
+
+      // Shave the learned time if it was ready at once, else use this one
+      t = FaceNowUS() - t0;
+      if(nPolls == 1 && learn)
+	learn -= learn / 8;
+      else if(nPolls == 1 && t > nFixedUS[nWait])
+	learn = nFixedUS[nWait];  // ready at once, t is just the poll
+      else
+	learn = t;
+      pthread_mutex_lock(&m_mutex);
+      m_nLearnUS[nWait] = learn;
+      m_nBusyFails = 0;
+      pthread_mutex_unlock(&m_mutex);
+      return para_ok;
+    }
+
+  } while(FaceNowUS() - t0 < m_nBusyTimeoutUS);
+
+  // No sign of ready, fall back to the fixed delay
+  pthread_mutex_lock(&m_mutex);
+  m_stats.nBusyTimeouts++;
+  if(++m_nBusyFails >= FACEBUSYFAILS)
+    m_bBusyWait = false;
+  pthread_mutex_unlock(&m_mutex);
+
+  usleep(nFixedUS[nWait]);
+
+  return res;
+}
+
 int CParaFace::LcdGetStatus(int *pBusy, int *pAddr/*=NULL*/) {
   int res;
   unsigned val, rval;
 
   val = m_bBacklight ? FACELCD_LED : 0;  // RS=RW=E=0
 
-  res = McpSet(FACEMCP_GPIOB, val);
+  res = McpSet(FACEMCP_GPIOB, val | LcdData());  // only if RS/RW/LED change
   if(res) return res;
   res = McpSet(FACEMCP_IODIRB, 0x0F);  // low bits inputs for read
   if(res) return res;
@@ -355,7 +1220,7 @@ int CParaFace::LcdGetDR(int *pByte) {
   val = m_bBacklight ? FACELCD_LED : 0;  // RS=RW=E=0
   val |= FACELCD_RS;
 
-  res = McpSet(FACEMCP_GPIOB, val);
+  res = McpSet(FACEMCP_GPIOB, val | LcdData());  // only if RS/RW/LED change
   if(res) return res;
   res = McpSet(FACEMCP_IODIRB, 0x0F);  // low bits inputs for read
   if(res) return res;
@@ -386,3 +1251,256 @@ int CParaFace::LcdGetDR(int *pByte) {
 
   return res;
 }
+
+void CParaFace::InitThreads() {
+  pthread_condattr_t attr;
+
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&m_condEvent, &attr);
+  pthread_condattr_destroy(&attr);
+
+  m_pfnEvent = NULL;
+  m_pEventArg = NULL;
+  m_nDebounceMS = FACEDEBOUNCEMS;
+  m_nButtons = 0xFF;
+  m_nEvHead = m_nEvTail = 0;
+  m_nStop = 0;
+  m_bRunning = false;
+
+  pthread_mutex_init(&m_qmutex, NULL);
+  pthread_cond_init(&m_condQWork, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&m_condQDone, &attr);
+  pthread_condattr_destroy(&attr);
+
+  m_bAsync = false;
+  memset(&m_pend, 0, sizeof(m_pend));
+  m_nQScreenValid = 0;
+  m_nQSeq = m_nQDone = 0;
+  m_nQError = para_ok;
+  m_nQStop = 0;
+}
+
+void *CParaFace::ButtonProc(void *pArg) {
+
+  ((CParaFace *)pArg)->ButtonRun();
+
+  return NULL;
+}
+
+// Wait for INTA, see Button events in para_face.h
+void CParaFace::ButtonRun() {
+  struct timespec ts;
+  para_edge edges[8];
+  unsigned long long t;
+  unsigned val;
+  int res, level, count;
+
+  while(!__atomic_load_n(&m_nStop, __ATOMIC_ACQUIRE)) {
+
+    res = m_intGpio.GetPin(0, &level);
+    if(res != para_ok || level) {
+
+      // Idle, sleep until INTA falls or it's time to check for Stop().
+      // ReadEdges() keeps edges from before the call, unlike WaitEdges(),
+      // so a fall just after GetPin() still wakes us at once.
+      res = m_intGpio.ReadEdges(1, edges, 8, FACEINTTIMEOUT, &count);
+      if(res != para_ok && res != para_timeout) {
+	ts.tv_sec = 0;
+	ts.tv_nsec = FACEINTPOLLMS * 1000000;
+	nanosleep(&ts, NULL);
+      }
+      continue;
+    }
+
+    t = FaceNowUS();
+
+    // The levels that caused it, reading them releases INTA
+    res = McpGet(FACEMCP_INTCAPA, &val);
+    if(res == para_ok)
+      ButtonEvents(val, t);
+
+    ts.tv_sec = m_nDebounceMS / 1000;
+    ts.tv_nsec = (m_nDebounceMS % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+
+    // Settled levels, this clears a change made while bouncing
+    res = McpGet(FACEMCP_GPIOA, &val);
+    if(res == para_ok)
+      ButtonEvents(val, FaceNowUS());
+
+    pthread_mutex_lock(&m_mutex);
+    m_stats.nButtonInts++;
+    pthread_mutex_unlock(&m_mutex);
+  }
+}
+
+// Report each button whose level differs from the last reported
+void CParaFace::ButtonEvents(unsigned nLevels, unsigned long long nTimeUS) {
+  para_faceevent ev[8];
+  unsigned diff;
+  int n, count = 0;
+
+  pthread_mutex_lock(&m_mutex);
+
+  diff = (nLevels ^ m_nButtons) & 0xFF;
+  m_nButtons = nLevels & 0xFF;
+
+  for(n = 0; n < 8; n++) {
+
+    if(!(diff & (1 << n)))
+      continue;
+
+    ev[count].nTimeUS = nTimeUS;
+    ev[count].nButton = n;
+    ev[count].bPressed = !(nLevels & (1 << n));
+    m_stats.nButtonEvents++;
+
+    if(m_pfnEvent == NULL) {
+      if(m_nEvHead - m_nEvTail == FACEEVENTQ) {
+	m_nEvTail++;  // drop the oldest
+	m_stats.nEventsDropped++;
+      }
+      m_events[m_nEvHead++ & (FACEEVENTQ - 1)] = ev[count];
+    }
+    count++;
+  }
+
+  if(count)
+    pthread_cond_broadcast(&m_condEvent);
+
+  pthread_mutex_unlock(&m_mutex);
+
+  // Outside the lock so the callback may use the display
+  for(n = 0; n < count && m_pfnEvent; n++)
+    m_pfnEvent(&ev[n], m_pEventArg);
+}
+
+void CParaFace::QueueLock() {
+
+  pthread_mutex_lock(&m_qmutex);
+}
+
+// Count a queued call, wake the display thread and unlock
+void CParaFace::QueueKick() {
+
+  m_nQSeq++;
+  m_stats.nAsyncCalls++;
+  pthread_cond_signal(&m_condQWork);
+  pthread_mutex_unlock(&m_qmutex);
+}
+
+// Queue the display control command for the current flags
+void CParaFace::QueueDisplay() {
+
+  if(m_pend.nFlags & FACEQ_DISPLAY)
+    m_stats.nAsyncSuperseded++;
+  m_pend.nFlags |= FACEQ_DISPLAY;
+  m_pend.nDisplay = DisplayCmd();
+}
+
+// Write nChar at the queued cursor address, as LcdSendDR() would
+void CParaFace::QueueCell(int nChar) {
+  unsigned bit;
+  int addr = m_pend.nAddr;
+
+  if((addr & 0x3F) < 16) {
+    bit = 1U << ((addr >> 6) * 16 + (addr & 0x3F));
+    if(m_pend.nCells & bit)
+      m_stats.nAsyncSuperseded++;
+    m_pend.cCells[addr >> 6][addr & 0x3F] = nChar;
+    m_pend.nCells |= bit;
+    m_cQScreen[addr >> 6][addr & 0x3F] = nChar;
+    m_nQScreenValid |= bit;
+  }
+
+  m_pend.nAddr = addr == 0x27 ? 0x40 : addr == 0x67 ? 0x00 : addr + 1;
+}
+
+void *CParaFace::DisplayProc(void *pArg) {
+
+  ((CParaFace *)pArg)->DisplayRun();
+
+  return NULL;
+}
+
+// Send whatever is pending, see Async mode in para_face.h
+void CParaFace::DisplayRun() {
+  para_facepend pend;
+  unsigned long long seq;
+  int res, nBytes;
+
+  pthread_mutex_lock(&m_qmutex);
+
+  for(;;) {
+
+    while(m_nQDone == m_nQSeq && !m_nQStop)
+      pthread_cond_wait(&m_condQWork, &m_qmutex);
+
+    if(m_nQDone == m_nQSeq)
+      break;  // stopping with nothing left
+
+    // Take all of it, callers may queue more while it's sent
+    pend = m_pend;
+    m_pend.nFlags = 0;
+    m_pend.nGlyphs = 0;
+    m_pend.nCells = 0;
+    seq = m_nQSeq;
+    pthread_mutex_unlock(&m_qmutex);
+
+    res = DisplaySend(&pend, &nBytes);
+
+    pthread_mutex_lock(&m_qmutex);
+    if(res && m_nQError == para_ok)
+      m_nQError = res;
+    if(res)
+      m_nGlyphValid &= ~pend.nGlyphs;  // may not have got there
+    m_nQDone = seq;
+    m_stats.nAsyncBatches++;
+    m_stats.nFrameBytes += nBytes;
+    pthread_cond_broadcast(&m_condQDone);
+  }
+
+  pthread_mutex_unlock(&m_qmutex);
+}
+
+int CParaFace::DisplaySend(const para_facepend *pPend, int *pnBytes) {
+  int n, res;
+
+  *pnBytes = 0;
+
+  if(pPend->nFlags & FACEQ_BACKLIGHT) {
+    res = SetLed(pPend->bBacklight);
+    if(res) return res;
+  }
+
+  for(n = 0; n < FACEGLYPHS; n++)
+    if(pPend->nGlyphs & (1 << n)) {
+      res = GlyphLoad(n, pPend->cGlyphs[n]);
+      if(res) return res;
+    }
+
+  if(pPend->nFlags & FACEQ_CLEAR) {
+    res = LcdSendIR(1, 2, FACEWAIT_CLEAR);
+    if(res) return res;
+  }
+
+  if(pPend->nCells) {
+    res = PresentCells(pPend->cCells, pPend->nCells, pnBytes);
+    if(res) return res;
+  }
+
+  if(pPend->nFlags & FACEQ_DISPLAY) {
+    res = LcdSendIR(pPend->nDisplay);
+    if(res) return res;
+  }
+
+  // Just one move to where the calls left the cursor, if needed
+  if(m_bCGAddr || m_nAddr != pPend->nAddr)
+    return LcdSendIR(0x80 | pPend->nAddr);
+
+  return para_ok;
+}
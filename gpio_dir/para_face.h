@@ -47,6 +47,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     CParaFace(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder) -
       Constructs an object using the specified pins.
 
+    SetBackend(para_gpiobackend eBackend) - Selects the pin access method
+      of the SPI object, see para_gpio.h.  Must be called before Init().
+
     Init() - Initializes the SPI object and sets up the port expander on the 
       PiFace card.  Must be called before any of the following functions.
 
@@ -62,7 +65,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Clear() - Clears the display.
 
     GetCursor(int *pnCol, int *pnRow) - Gets the current col & row
-      of the cursor.
+      of the cursor, from the tracked address if known or else read
+      from the LCD.  Columns past 15 are off the screen.  In async mode
+      it's where the queued calls leave it.
 
     Home() - Moves the cursor to 0,0.
 
@@ -71,7 +76,201 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Write(char *str) - Writes the zero-terminated string str to the current
       cursor location.
 
+    Present(const char screen[2][16], int *pnBytes=NULL) - Makes the
+      display show screen, sending only the characters that differ from
+      what it's known to show, see Frames below.  The bytes sent to the
+      LCD (characters plus cursor moves) are returned in *pnBytes.
+      In async mode the cursor isn't moved and *pnBytes is 0, the bytes
+      aren't known until the thread sends them.
+
+    GetGlyph(const unsigned char bitmap[8], int *pnCode) - Finds or loads
+      a custom character, see Glyphs below.  bitmap is the 8 rows top
+      first, 5 pixels each in the low bits.  *pnCode is the character
+      code (0-7) to Present() to show it, or add 8 for a zero-terminated
+      string to Write(), codes 8-15 show the same glyphs.  In async mode
+      a load is queued like the display calls.
+
     GetButtons(unsigned *pButtons) - Returns the state of the 8 button inputs.
+      While button events are running this is the debounced state the
+      events have reported, without reading the chip.
+
+    StartButtons(int nIntGpio, para_facecb pfnEvent=NULL, void *pArg=NULL,
+        unsigned nDebounceMS=FACEDEBOUNCEMS) - Turns on interrupt-on-change
+      for the buttons and starts a thread that waits for the MCP23S17 INTA
+      output on GPIO nIntGpio, see Button events below.  If pfnEvent is
+      given it's called (from that thread) with each event and pArg,
+      otherwise events are queued for GetButtonEvent().  Call after Init().
+      Returns the error if edge detection can't be set up on nIntGpio,
+      except with para_bkmmio, see Button events below.
+
+    StopButtons() - Stops the button thread (within ~100ms) and turns the
+      interrupts off.  Called automatically when the object is destroyed.
+
+    GetButtonEvent(para_faceevent *pEvent, int nTimeoutMS=0) - Takes the
+      oldest queued button event, waiting up to nTimeoutMS for one (-1
+      waits forever).  Returns para_timeout if there was none.
+
+    SetBurst(bool bOn) - Selects whether the EN strobes for each LCD byte
+      go out as one burst (the default) or one register write each,
+      see Bursts below.
+
+    SetBusyWait(bool bOn, unsigned nTimeoutUS=FACEBUSYUS) - Selects
+      waiting for the LCD's busy flag after each command instead of the
+      fixed worst-case delays, see Timing below.  nTimeoutUS bounds each
+      wait.  Best called before Init() so the latencies are learned there.
+
+    GetLatencies(unsigned *pCmdUS, unsigned *pHomeUS, unsigned *pClearUS) -
+      Returns the command latencies learned in busy-flag mode, 0 if not
+      learned yet.  Any pointer may be NULL.
+
+    SetAsync(bool bOn) - Starts or stops the display thread, see Async
+      mode below.  Stopping sends anything still queued first.  Call
+      after Init() and any SetBurst() / SetBusyWait().
+
+    Fence(unsigned long long *pnFence) - Returns a number identifying
+      everything queued so far, without waiting.
+
+    WaitFence(unsigned long long nFence, int nTimeoutMS=-1) - Waits until
+      the calls before Fence() returned nFence have reached the LCD.
+      Returns para_timeout if they haven't after nTimeoutMS (0 just
+      checks), or the first error the thread had since the last wait.
+
+    Flush(int nTimeoutMS=-1) - Fence() and WaitFence() together.
+
+    GetStats(para_facestats *pStats) - Fills in the counters below.
+
+    ResetStats() - Clears the counters.
+
+  Register cache:
+
+    Every MCP23S17 register written is remembered, and a write of the
+    value the register already holds is skipped.  Init() forgets them
+    all since the chip may have been reset.  So IODIRB is only written
+    when switching between LCD reads and writes, and the set-up write
+    before each EN strobe only happens when RS / RW / LED change.
+    para_facestats has:
+
+      nMcpWrites     - register writes sent
+      nMcpSkipped    - register writes avoided by the cache
+      nMcpReads      - register reads
+      nBursts        - burst writes sent
+      nBurstBytes    - data bytes in those bursts
+      nBusyPolls     - busy-flag reads
+      nBusyTimeouts  - busy-flag waits that timed out or failed
+      nFrames        - Present() calls
+      nFrameBytes    - LCD bytes sent by them, or for any queued text
+      nButtonInts    - INTA assertions handled by the button thread
+      nButtonEvents  - button events reported
+      nEventsDropped - events lost because the queue was full
+      nGlyphHits     - GetGlyph() calls that found the bitmap loaded
+      nGlyphMisses   - GetGlyph() calls that had to load it
+      nGlyphEvicts   - loads that replaced a glyph, visible or not
+      nGlyphVisible  - loads that replaced a glyph still on the screen
+      nAsyncCalls    - display calls queued in async mode
+      nAsyncBatches  - batches of them the thread has sent
+      nAsyncSuperseded - commands and characters replaced while queued
+
+  Frames:
+
+    Every command and character sent is followed to keep a copy of the
+    visible display RAM and the address counter, assuming the increment
+    entry mode set by Init().  Cells are unknown after Init() until
+    written, Clear() makes them all known spaces.  Present() writes
+    each run of changed cells with one SetCursor() (skipped if the
+    address counter is already there) and auto-increment writes for
+    the rest, doing first the row the cursor is already in position
+    for.  A cursor move and a character cost the same one LCD byte, so
+    unchanged cells between changes are never rewritten.  The cursor is
+    left after the last character written.
+
+  Timing:
+
+    By default each command is followed by a fixed delay long enough
+    for the slowest controller: 50us, or 2ms for Home() and 5ms for
+    Clear().  In busy-flag mode the LCD is instead polled with
+    LcdGetStatus() until it's ready, once it's in 4-bit mode.  Init()
+    times a status read and a single register read, and learns the
+    latency of an ordinary command and of Home() (so the cursor is left
+    at 0,0), Clear() is learned the first time it's used.  A status
+    read costs 6 register writes and 2 reads and leaves GPIOB's low
+    bits as inputs, which spoils the next burst, so once learned an
+    ordinary command isn't polled: the wait is the learned latency less
+    the one register transaction the next byte takes at least, usually
+    nothing at all.  Home() and Clear() waits sleep for the learned
+    latency, less the time a status read takes, and then poll, so
+    usually a single status read finds the LCD ready.  Those learned
+    values creep down while the first poll keeps finding it ready and
+    jump up to the measured time when it doesn't.  A poll that finds
+    it ready at once only shows the latency is no more than the fixed
+    delay.  A wait that times out falls back to the fixed delay, and
+    after FACEBUSYFAILS in a row busy-flag mode is turned off.
+
+  Glyphs:
+
+    The LCD's 8 CGRAM characters are kept as a cache indexed by their
+    bitmaps.  GetGlyph() returns the slot already holding the bitmap
+    without any LCD traffic, otherwise it loads it into a free slot or
+    evicts the least recently requested one, preferring slots whose
+    codes (0-7, or their aliases 8-15) aren't among the displayed cells
+    Frames keeps track of.  Loading costs 10 LCD bytes: the CGRAM
+    address, the 8 rows, and a DDRAM address to put the cursor back.
+    Replacing a visible glyph changes it on the screen at once, so a
+    screen shouldn't use more than 8 different ones.  Init() forgets
+    the cache.
+
+  Async mode:
+
+    After SetAsync(true) Backlight(), Display(), Blink(), Cursor(),
+    Clear(), Home(), SetCursor(), Write(), Present() and GetGlyph()
+    return at once and never touch the SPI.  Rather than a list of
+    commands they update the state the display should end up in: the
+    backlight, the display control flags, glyphs to load, whether a
+    Clear() comes first, the characters to go in each of the 32 visible
+    cells, and the cursor address.  GetGlyph() picks its slot against
+    the screen as the queued calls leave it.  Whenever that changes the
+    display thread takes all of it in one go and sends it, so anything
+    superseded while the thread was busy is never sent: a backlight or
+    display setting or a glyph changed again, cursor moves (only the
+    final address is set, and not at all if the cursor is already
+    there, Home() is just a move to 0,0), and characters written over
+    or cleared.  Glyphs are loaded before the cells, which go out as in
+    Frames, skipping ones the display already shows.  Characters
+    written past column 15 aren't shown and are dropped.  The calls are
+    mutex-protected so any thread may make them, errors are returned
+    later by WaitFence() / Flush().  Init() isn't allowed in async
+    mode, and SetAsync(true) puts the cursor at 0,0 if its position
+    isn't known.
+
+  Button events:
+
+    StartButtons() sets GPINTENA so any change of a button input pulls
+    INTA low, and the thread sleeps waiting for that edge on nIntGpio
+    with CParaGpio::ReadEdges(), which also sees an edge that came just
+    before it was called (polling the pin every FACEINTPOLLMS with
+    para_bkmmio, which has no edge detection), so there is no SPI
+    traffic at all while the buttons are idle.  On INTA it notes the time and reads INTCAPA once, the
+    levels when the change happened, which also releases INTA.  After
+    nDebounceMS it reads GPIOA for the settled levels.  Every button
+    whose state differs from the last one reported produces an event,
+    first from the captured levels (timed at the interrupt) and then
+    from the settled ones, so bounces inside the window are absorbed
+    but a tap shorter than it still gives a press and a release.  The
+    buttons pull down when pressed, bPressed is true for a 0 input.
+    The MCP23S17 transactions are serialized with a mutex so the
+    display may be used from another thread meanwhile.  The queue holds
+    FACEEVENTQ events, when full the oldest is dropped.
+
+  Bursts:
+
+    Init() puts the MCP23S17 in IOCON.BANK = 1 with byte mode (SEQOP),
+    where the address pointer stays on the same register.  Writing an
+    LCD byte is then one SPI transaction with enable held: the opcode,
+    GPIOB and the E-high / E-low pairs for both nibbles (plus the RS
+    set-up byte if needed), instead of a separate 24-bit write for each.
+    The FACEMCP_ register numbers are always the BANK = 0 addresses,
+    McpSet() / McpGet() translate them.  The destructor clears IOCON,
+    so the chip is left in the power-on BANK = 0 map that other PiFace
+    code expects.
 
 */
 
@@ -80,6 +279,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "para_spi.h"
 #include <stdlib.h>
+#include <pthread.h>
 
 // MCP addresses
 #define FACEMCPWR 0x40
@@ -88,10 +288,43 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // MCP registers, assumes bank=0
 #define FACEMCP_IODIRA 0x00
 #define FACEMCP_IODIRB 0x01
+#define FACEMCP_GPINTENA 0x04
+#define FACEMCP_GPINTENB 0x05
+#define FACEMCP_INTCONA 0x08
+#define FACEMCP_IOCON  0x0A
 #define FACEMCP_GPPUA  0x0C
 #define FACEMCP_GPPUB  0x0D
+#define FACEMCP_INTCAPA 0x10
 #define FACEMCP_GPIOA  0x12
 #define FACEMCP_GPIOB  0x13
+#define FACEMCP_NREGS  0x16
+
+// IOCON bits
+#define FACEIOCON_BANK  0x80
+#define FACEIOCON_SEQOP 0x20
+
+#define FACEBURSTMAX 8  // data bytes in one burst write
+
+#define FACEBUSYUS    10000  // default busy-flag wait timeout
+#define FACEBUSYFAILS 3      // timeouts in a row before using fixed delays
+
+#define FACEDEBOUNCEMS 20   // default button settle time
+#define FACEEVENTQ     32   // button events queued, power of two
+#define FACEINTTIMEOUT 100  // msec, how often the button thread checks for Stop
+#define FACEINTPOLLMS  2    // msec between INTA reads without edge detection
+
+#define FACEGLYPHS 8  // CGRAM characters
+
+// m_pend.nFlags, what's been queued
+#define FACEQ_BACKLIGHT 0x01
+#define FACEQ_DISPLAY   0x02
+#define FACEQ_CLEAR     0x04
+#define FACEQ_CURSOR    0x08
+
+// Command classes for LcdWait()
+#define FACEWAIT_CMD   0
+#define FACEWAIT_HOME  1
+#define FACEWAIT_CLEAR 2
 
 // Defines for bit positions in GPIOB, LCD interface
 #define FACELCD_LED 0x80
@@ -99,6 +332,48 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define FACELCD_RW  0x20
 #define FACELCD_EN  0x10
 
+typedef struct {
+  unsigned long long nMcpWrites;
+  unsigned long long nMcpSkipped;
+  unsigned long long nMcpReads;
+  unsigned long long nBursts;
+  unsigned long long nBurstBytes;
+  unsigned long long nBusyPolls;
+  unsigned long long nBusyTimeouts;
+  unsigned long long nFrames;
+  unsigned long long nFrameBytes;
+  unsigned long long nButtonInts;
+  unsigned long long nButtonEvents;
+  unsigned long long nEventsDropped;
+  unsigned long long nGlyphHits;
+  unsigned long long nGlyphMisses;
+  unsigned long long nGlyphEvicts;
+  unsigned long long nGlyphVisible;
+  unsigned long long nAsyncCalls;
+  unsigned long long nAsyncBatches;
+  unsigned long long nAsyncSuperseded;
+} para_facestats;
+
+typedef struct {
+  unsigned long long nTimeUS;  // CLOCK_MONOTONIC
+  int  nButton;                // 0-7, the GPIOA bit
+  bool bPressed;
+} para_faceevent;
+
+typedef void (*para_facecb)(const para_faceevent *pEvent, void *pArg);
+
+// Display state waiting for the async display thread
+typedef struct {
+  unsigned nFlags;      // FACEQ_ bits
+  bool bBacklight;
+  int  nDisplay;        // display control command
+  unsigned char cGlyphs[FACEGLYPHS][8];
+  unsigned nGlyphs;     // bit per slot to load from cGlyphs
+  char cCells[2][16];
+  unsigned nCells;      // bit per cell (row * 16 + col) in cCells
+  int  nAddr;           // cursor address when done
+} para_facepend;
+
 class CParaFace {
 protected:
   CParaSpi  spi;
@@ -112,19 +387,101 @@ protected:
   bool m_bBlink;
   bool m_bOn;
 
+  unsigned char m_nMcpRegs[FACEMCP_NREGS];  // last value written
+  unsigned m_nMcpValid;                     // bit per register in m_nMcpRegs
+  bool m_bBank1;            // chip is in IOCON.BANK = 1, byte mode
+  bool m_bBurst;
+
+  bool m_bBusyWait;
+  bool m_bLcdReady;         // in 4-bit mode, the busy flag can be read
+  unsigned m_nBusyTimeoutUS;
+  int m_nBusyFails;
+  unsigned m_nLearnUS[3];   // by FACEWAIT_ class
+  unsigned m_nPollUS;       // time for one LcdGetStatus()
+  unsigned m_nXferUS;       // time for one register transaction
+
+  char m_cScreen[2][16];    // visible display RAM as last written
+  unsigned m_nScreenValid;  // bit per cell (row * 16 + col) in m_cScreen
+  int m_nAddr;              // DDRAM address counter, -1 if unknown
+  bool m_bCGAddr;           // address counter is in CGRAM
+  unsigned char m_cGlyphs[FACEGLYPHS][8];  // CGRAM contents by slot
+  unsigned m_nGlyphValid;   // bit per slot in m_cGlyphs
+  unsigned long long m_nGlyphUsed[FACEGLYPHS];  // m_nGlyphTick when last requested
+  unsigned long long m_nGlyphTick;
+  para_facestats m_stats;
+
+  pthread_mutex_t m_mutex;  // MCP transactions, events and m_stats
+  pthread_cond_t m_condEvent;
+  para_gpiobackend m_eBackend;
+  CParaGpio m_intGpio;      // INTA input
+  para_facecb m_pfnEvent;
+  void *m_pEventArg;
+  unsigned m_nDebounceMS;
+  unsigned m_nButtons;      // GPIOA levels last reported
+  para_faceevent m_events[FACEEVENTQ];
+  unsigned m_nEvHead, m_nEvTail;
+  int  m_nStop;
+  bool m_bRunning;
+  pthread_t m_thread;
+
+  bool m_bAsync;
+  pthread_mutex_t m_qmutex; // m_pend, m_nQ*, caller-side state, taken
+                            // after m_mutex if both, never before
+  pthread_cond_t m_condQWork;
+  pthread_cond_t m_condQDone;
+  para_facepend m_pend;
+  char m_cQScreen[2][16];   // the screen as the queued calls leave it
+  unsigned m_nQScreenValid;
+  unsigned long long m_nQSeq;   // calls queued
+  unsigned long long m_nQDone;  // calls sent
+  int  m_nQError;
+  int  m_nQStop;
+  pthread_t m_qthread;
+
   // Internal functions
   int McpSet(int nReg, unsigned nData);
   int McpGet(int nReg, unsigned *pData);
-  int LcdSendIR(int nByte, int nCycles=2);
+  int McpBurst(int nReg, const unsigned char *pData, int nLen);
+  int McpAddr(int nReg);
+  bool McpHas(int nReg, unsigned nData);
+  unsigned LcdData();
+  int LcdStrobe(unsigned nCtrl, int nByte, int nCycles);
+  int LcdSendIR(int nByte, int nCycles=2, int nWait=FACEWAIT_CMD);
+  int LcdWait(int nWait);
+  void LcdTrack(int nCmd);
+  int SetLed(bool bOn);
+  int PresentCells(const char screen[2][16], unsigned nMask, int *pnBytes);
+  int PresentRows(const char screen[2][16], unsigned nMask, int nFirst, bool bSend,
+                  int *pnBytes);
+  int DisplayCmd();
+  unsigned GlyphsVisible();
+  int GlyphHit(const unsigned char bitmap[8]);
+  int GlyphMiss(const unsigned char bitmap[8], int *pnCode);
+  int GlyphLoad(int nSlot, const unsigned char bitmap[8]);
+  void QueueLock();
+  void QueueKick();
+  void QueueDisplay();
+  void QueueCell(int nChar);
+  static void *DisplayProc(void *pArg);
+  void DisplayRun();
+  int DisplaySend(const para_facepend *pPend, int *pnBytes);
   int LcdSendDR(int nByte);
   int LcdGetStatus(int *pBusy, int *pAddr=NULL);
   int LcdGetDR(int *pByte);
+  void InitThreads();
+  static void *ButtonProc(void *pArg);
+  void ButtonRun();
+  void ButtonEvents(unsigned nLevels, unsigned long long nTimeUS);
 
  public:
   CParaFace();
   CParaFace(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder=false);
   ~CParaFace();
   int AssignPins(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder=false);
+  int SetBackend(para_gpiobackend eBackend) {
+    m_eBackend = eBackend;
+    return spi.SetBackend(eBackend);
+  }
   int Init();
   int Backlight(bool bOn);
   int Display(bool bOn);
@@ -135,7 +492,22 @@ protected:
   int Home();
   int SetCursor(int nCol, int nRow);
   int Write(char *str);
+  int Present(const char screen[2][16], int *pnBytes=NULL);
+  int GetGlyph(const unsigned char bitmap[8], int *pnCode);
   int GetButtons(unsigned *pButtons);
+  int StartButtons(int nIntGpio, para_facecb pfnEvent=NULL, void *pArg=NULL,
+                   unsigned nDebounceMS=FACEDEBOUNCEMS);
+  int StopButtons();
+  int GetButtonEvent(para_faceevent *pEvent, int nTimeoutMS=0);
+  void SetBurst(bool bOn) { m_bBurst = bOn; }
+  void SetBusyWait(bool bOn, unsigned nTimeoutUS=FACEBUSYUS);
+  int GetLatencies(unsigned *pCmdUS, unsigned *pHomeUS, unsigned *pClearUS);
+  int SetAsync(bool bOn);
+  int Fence(unsigned long long *pnFence);
+  int WaitFence(unsigned long long nFence, int nTimeoutMS=-1);
+  int Flush(int nTimeoutMS=-1);
+  int GetStats(para_facestats *pStats);
+  void ResetStats();
 
 };
 
@@ -42,6 +42,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <glob.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/gpio.h>
 
 // Use the filesystem interface to control the GPIOs
 // Based on: http://www.wiki.xilinx.com/GPIO+User+Space+App
@@ -49,6 +56,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define GPIOBASE  "/sys/class/gpio/"
 
+static void para_resetgpio(para_gpio *pGpio, int nID) {
+
+  pGpio->nID = nID;
+  pGpio->eDir = para_dirunk;
+  pGpio->fdVal = -1;
+  pGpio->fdDir = -1;
+  pGpio->bIsNew = false;
+  pGpio->nEdge = -1;
+  pGpio->nVal = -1;
+  pGpio->nHwDir = -1;
+}
+
 int  para_initgpio(para_gpio **ppGpio, int nID) {
 
   return para_initgpio_ex(ppGpio, nID, true);
@@ -75,11 +94,7 @@ int  para_initgpio_ex(para_gpio **ppGpio, int nID, bool bMayExist) {
     return para_outofmemory;
   }
 
-  (*ppGpio)->nID = nID;
-  (*ppGpio)->eDir = para_dirunk;
-  (*ppGpio)->fdVal = -1;
-  (*ppGpio)->fdDir = -1;
-  (*ppGpio)->bIsNew = false;
+  para_resetgpio(*ppGpio, nID);
 
   sprintf(str1, GPIOBASE "gpio%d/direction", nID);
   if(!access(str1, F_OK)) {
@@ -167,14 +182,187 @@ void para_closegpio_ex(para_gpio *pGpio, bool bForceUnexport) {
   pGpio->nID = -1;
 }
 
+// Group versions of the above.  Each pin still needs its own write to
+// export / unexport, but they all go through one open fd, and nothing
+// is opened until every pin has been exported.
+
+int  para_initgpios(para_gpio **ppGpio, int *pIDArray, int nNumIDs,
+                    bool bMayExist) {
+  int  n, fd, fdExp = -1;
+  char str1[256], str2[256];
+  int  rc = para_ok;
+
+  if(ppGpio == NULL)
+    return para_badgpio;
+
+  if(pIDArray == NULL || nNumIDs <= 0 || nNumIDs > MAXPINSPEROBJECT)
+    return para_badarg;
+
+  for(n = 0; n < nNumIDs; n++)
+    ppGpio[n] = NULL;
+
+  for(n = 0; n < nNumIDs; n++) {
+
+    if(pIDArray[n] < 0) {
+      fprintf(stderr, "Illegal gpio # in call to initgpios");
+      rc = para_outofrange;
+      goto initfail;
+    }
+
+    ppGpio[n] = (para_gpio *)malloc(sizeof(para_gpio));
+    if(ppGpio[n] == NULL) {
+      fprintf(stderr, "Unable to allocate a new para_gpio structure\n");
+      rc = para_outofmemory;
+      goto initfail;
+    }
+
+    para_resetgpio(ppGpio[n], pIDArray[n]);
+  }
+
+  for(n = 0; n < nNumIDs; n++) {
+
+    sprintf(str1, GPIOBASE "gpio%d/direction", pIDArray[n]);
+    if(!access(str1, F_OK)) {
+
+      if(!bMayExist) {
+        fprintf(stderr, "GPIO %d already allocated and bMayExist is false", pIDArray[n]);
+        rc = para_alreadyopen;
+        goto initfail;
+      }
+      continue;
+    }
+
+    if(fdExp < 0 && (fdExp = open(GPIOBASE "export", O_WRONLY)) < 0) {
+      fprintf(stderr, "Can't access the GPIO fs entry, run me as root?\n");
+      rc = para_noaccess;
+      goto initfail;
+    }
+
+    sprintf(str2, "%d\n", pIDArray[n]);
+    if(write(fdExp, str2, strlen(str2)) <= 0) {
+      fprintf(stderr, "Unable to export GPIO pin %d!\n", pIDArray[n]);
+      rc = para_fileerr;
+      goto initfail;
+    }
+
+    ppGpio[n]->bIsNew = true;
+  }
+
+  if(fdExp >= 0) {
+    close(fdExp);
+    fdExp = -1;
+  }
+
+  for(n = 0; n < nNumIDs; n++) {
+
+    sprintf(str1, GPIOBASE "gpio%d/direction", pIDArray[n]);
+    if((fd = open(str1, O_WRONLY)) < 0) {
+      fprintf(stderr, "Can't open the direction file %s\n", str1);
+      rc = para_fileerr;
+      goto initfail;
+    }
+    ppGpio[n]->fdDir = fd;
+
+    sprintf(str1, GPIOBASE "gpio%d/value", pIDArray[n]);
+    if((fd = open(str1, O_RDWR)) < 0) {
+      fprintf(stderr, "Can't open the value file %s\n", str1);
+      rc = para_fileerr;
+      goto initfail;
+    }
+    ppGpio[n]->fdVal = fd;
+  }
+
+  return rc;
+
+ initfail:
+  if(fdExp >= 0)
+    close(fdExp);
+  para_closegpios(ppGpio, nNumIDs, false);
+  return rc;
+}
+
+void para_closegpios(para_gpio **ppGpio, int nNumIDs, bool bForceUnexport) {
+  char  str[256];
+  int   n, fd = -1;
+
+  if(ppGpio == NULL)
+    return;
+
+  for(n = 0; n < nNumIDs; n++) {
+
+    if(ppGpio[n] == NULL)
+      continue;
+
+    if(ppGpio[n]->fdVal >= 0)
+      close(ppGpio[n]->fdVal);
+
+    if(ppGpio[n]->fdDir >= 0)
+      close(ppGpio[n]->fdDir);
+
+    if(ppGpio[n]->nID >= 0 && (ppGpio[n]->bIsNew || bForceUnexport)) {
+
+      if(fd < 0)
+        fd = open(GPIOBASE "unexport", O_WRONLY);
+
+      if(fd >= 0) {
+        sprintf(str, "%d\n", ppGpio[n]->nID);
+        write(fd, str, strlen(str));
+      }
+    }
+
+    free(ppGpio[n]);
+    ppGpio[n] = NULL;
+  }
+
+  if(fd >= 0)
+    close(fd);
+}
+
 static const char str0[] = "0\n";
 static const char str1[] = "1\n";
 static const char strIn[] = "in\n";
-static const char strOut[] = "out\n";
+static const char strOut[] = "out\n";   // also sets the value to 0
+static const char strHigh[] = "high\n"; // output, value 1
 
-int para_setgpio(para_gpio *pGpio, int nValue) {
+// The structure caches what was last written to the value and direction
+// files (nVal, nHwDir), so writes that wouldn't change anything are
+// skipped.  -1 means unknown, e.g. a pin that was already exported.
+
+static int para_writedir(para_gpio *pGpio, int nHwDir, int nVal) {
   const char *str;
-  int res;
+
+  if(pGpio->nHwDir == nHwDir && (!nHwDir || pGpio->nVal == nVal))
+    return para_ok;
+
+  str = !nHwDir ? strIn : nVal ? strHigh : strOut;
+  if(write(pGpio->fdDir, str, strlen(str)) <= 0) {
+    pGpio->nHwDir = -1;
+    return para_fileerr;
+  }
+
+  pGpio->nHwDir = nHwDir;
+  if(nHwDir)
+    pGpio->nVal = nVal;
+
+  return para_ok;
+}
+
+static int para_writeval(para_gpio *pGpio, int nVal) {
+
+  if(pGpio->nVal == nVal)
+    return para_ok;
+
+  if(write(pGpio->fdVal, nVal ? str1 : str0, strlen(str0)) <= 0) {
+    pGpio->nVal = -1;
+    return para_fileerr;
+  }
+
+  pGpio->nVal = nVal;
+
+  return para_ok;
+}
+
+int para_setgpio(para_gpio *pGpio, int nValue) {
 
   if(pGpio == NULL)
     return para_badgpio;
@@ -182,32 +370,24 @@ int para_setgpio(para_gpio *pGpio, int nValue) {
   if(pGpio->fdVal < 0 || pGpio->fdDir < 0)
     return para_notopen;
 
+  nValue &= 1;
+
   switch(pGpio->eDir) {
 
   case para_dirout:
-    res = write(pGpio->fdVal, nValue & 1 ? str1 : str0, strlen(str0));
-    //    flush(pGpio->fpWVal);
-    break;
+    return para_writeval(pGpio, nValue);
 
-  case para_dirwand:
-    str = nValue & 1 ? strIn : strOut; // value is preset to 0
-    res = write(pGpio->fdDir, str, strlen(str)); // need to fix for MBCS?
-    //    fflush(pGpio->fpDir);
-    break;
+  case para_dirwand:  // float for 1, drive 0
+    return para_writedir(pGpio, !nValue, 0);
 
-  case para_dirwor:
-    str = nValue & 1 ? strOut : strIn; // value is preset to 1
-    res = write(pGpio->fdDir, str, strlen(str));
-    //    fflush(pGpio->fpDir);
-    break;
+  case para_dirwor:   // drive 1, float for 0
+    return para_writedir(pGpio, nValue, 1);
 
   case para_dirin:
   case para_dirunk:
   default:
     return para_nodir;
   }
-
-  return res ? para_ok : para_fileerr;
 }
 
 int para_dirgpio(para_gpio *pGpio, para_gpiodir eDir) {
@@ -222,23 +402,19 @@ int para_dirgpio(para_gpio *pGpio, para_gpiodir eDir) {
   switch(eDir) {
 
   case para_dirin:
-    res = write(pGpio->fdDir, strIn, strlen(strIn));
-    //    fflush(pGpio->fpDir);
+    res = para_writedir(pGpio, 0, 0);
     break;
 
   case para_dirout:
-    res = write(pGpio->fdDir, strOut, strlen(strOut));
-    //    fflush(pGpio->fpDir);
+    res = para_writedir(pGpio, 1, 0);
     break;
 
-  case para_dirwand:
-    res = write(pGpio->fdVal, str0, strlen(str0));
-    //    fflush(pGpio->fpWVal);
+  case para_dirwand:  // start floating
+    res = para_writedir(pGpio, 0, 0);
     break;
 
   case para_dirwor:
-    res = write(pGpio->fdVal, str1, strlen(str1));
-    //    fflush(pGpio->fpWVal);
+    res = para_writedir(pGpio, 0, 1);
     break;
 
   case para_dirunk:
@@ -246,9 +422,48 @@ int para_dirgpio(para_gpio *pGpio, para_gpiodir eDir) {
     return para_nodir;
   }
 
-  pGpio->eDir = eDir;
+  if(res == para_ok)
+    pGpio->eDir = eDir;
+
+  return res;
+}
+
+int para_getdirgpio(para_gpio *pGpio, para_gpiodir *pDir, bool bResync) {
+  char str[256], c;
+  int  fd, hw;
+
+  if(pGpio == NULL)
+    return para_badgpio;
+
+  if(pGpio->fdVal < 0 || pGpio->fdDir < 0)
+    return para_notopen;
+
+  if(pDir == NULL)
+    return para_badarg;
+
+  if(bResync) {
+
+    // fdDir is write-only, so go back to the file system for this
+    sprintf(str, GPIOBASE "gpio%d/direction", pGpio->nID);
+    if((fd = open(str, O_RDONLY)) < 0)
+      return para_fileerr;
+    hw = read(fd, &c, 1) == 1 ? (c == 'o') : -1;
+    close(fd);
+
+    if(hw < 0)
+      return para_fileerr;
+
+    pGpio->nHwDir = hw;
+    pGpio->nVal = -1;  // may have been changed behind our back
+
+    // wired-and/or toggle the direction, so either is consistent
+    if(pGpio->eDir != para_dirwand && pGpio->eDir != para_dirwor)
+      pGpio->eDir = hw ? para_dirout : para_dirin;
+  }
+
+  *pDir = pGpio->eDir;
 
-  return res ? para_ok : para_fileerr;
+  return para_ok;
 }
 
 int para_getgpio(para_gpio *pGpio, int *pValue) {
@@ -302,6 +517,1148 @@ int para_blinkgpio(para_gpio *pGpio, int nMSOn, int nMSOff) {
   return 0;
 }
 
+// Edge detection, the kernel flags POLLPRI on the value file after
+// each edge selected in the "edge" file.  Reading the value clears it.
+
+static const char *strEdge[] = { "falling\n", "rising\n", "both\n" };
+
+// Absolute deadline for a timeout in msec, negative = forever
+static void para_deadline(struct timespec *pEnd, int nTimeoutMS) {
+
+  clock_gettime(CLOCK_MONOTONIC, pEnd);
+
+  if(nTimeoutMS < 0)
+    return;
+
+  pEnd->tv_sec += nTimeoutMS / 1000;
+  pEnd->tv_nsec += (nTimeoutMS % 1000) * 1000000L;
+  if(pEnd->tv_nsec >= 1000000000L) {
+    pEnd->tv_sec++;
+    pEnd->tv_nsec -= 1000000000L;
+  }
+}
+
+// msec left until the deadline, rounded up, -1 if waiting forever
+static int para_remaining(const struct timespec *pEnd, int nTimeoutMS) {
+  struct timespec ts;
+  long long ns;
+
+  if(nTimeoutMS < 0)
+    return -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ns = (pEnd->tv_sec - ts.tv_sec) * 1000000000LL + (pEnd->tv_nsec - ts.tv_nsec);
+
+  return ns <= 0 ? 0 : (int)((ns + 999999) / 1000000);
+}
+
+static int para_edgemode(para_gpio *pGpio, int nEdge) {
+  char str[256];
+  int  fd, res;
+
+  if(pGpio->nEdge == nEdge)
+    return para_ok;
+
+  sprintf(str, GPIOBASE "gpio%d/edge", pGpio->nID);
+  if((fd = open(str, O_WRONLY)) < 0)
+    return para_fileerr;
+
+  res = write(fd, strEdge[nEdge], strlen(strEdge[nEdge]));
+  close(fd);
+
+  if(res <= 0)
+    return para_nodir;  // edges only work on inputs
+
+  pGpio->nEdge = nEdge;
+
+  return para_ok;
+}
+
+// Clears any pending edge notification, returning the level
+static int para_clearedge(para_gpio *pGpio) {
+  char c = '0';
+
+  lseek(pGpio->fdVal, 0, SEEK_SET);
+  if(read(pGpio->fdVal, &c, 1) != 1)
+    return -1;
+
+  return c == '1';
+}
+
+int para_waitgpio(para_gpio *pGpio, int nValue, int nTimeoutMS) {
+  struct pollfd pfd;
+  struct timespec tsEnd;
+  int res;
+
+  if(pGpio == NULL)
+    return para_badgpio;
+
+  if(pGpio->fdVal < 0)
+    return para_notopen;
+
+  nValue &= 1;
+  para_deadline(&tsEnd, nTimeoutMS);
+
+  // Watch for the edge that leads to nValue before sampling the level,
+  // so a change between the sample and the poll isn't missed.
+  if((res = para_edgemode(pGpio, nValue)) != para_ok)
+    return res;
+
+  pfd.fd = pGpio->fdVal;
+  pfd.events = POLLPRI | POLLERR;
+
+  for(;;) {
+
+    res = para_clearedge(pGpio);
+    if(res < 0)
+      return para_fileerr;
+    if(res == nValue)
+      return para_ok;
+
+    res = poll(&pfd, 1, para_remaining(&tsEnd, nTimeoutMS));
+    if(res < 0 && errno != EINTR)
+      return para_fileerr;
+    if(res == 0)
+      return para_timeout;
+  }
+}
+
+int para_edgegpio(para_gpio *pGpio, int nValue, int nTimeoutMS) {
+
+  return para_edgegpio_ex(&pGpio, 1, nValue, nTimeoutMS, NULL);
+}
+
+int para_edgegpio_ex(para_gpio **ppGpio, int nNum, int nValue,
+                     int nTimeoutMS, unsigned long long *pFired) {
+  struct pollfd pfd[MAXPINSPEROBJECT];
+  struct timespec tsEnd;
+  int n, res;
+
+  if(pFired)
+    *pFired = 0;
+
+  if(ppGpio == NULL || nNum <= 0 || nNum > MAXPINSPEROBJECT ||
+     nValue < 0 || nValue > 2)
+    return para_badarg;
+
+  para_deadline(&tsEnd, nTimeoutMS);
+
+  for(n = 0; n < nNum; n++) {
+
+    if(ppGpio[n] == NULL)
+      return para_badgpio;
+
+    if(ppGpio[n]->fdVal < 0)
+      return para_notopen;
+
+    if((res = para_edgemode(ppGpio[n], nValue)) != para_ok)
+      return res;
+
+    para_clearedge(ppGpio[n]);  // only edges from now on count
+
+    pfd[n].fd = ppGpio[n]->fdVal;
+    pfd[n].events = POLLPRI | POLLERR;
+  }
+
+  do {
+    res = poll(pfd, nNum, para_remaining(&tsEnd, nTimeoutMS));
+  } while(res < 0 && errno == EINTR);
+
+  if(res < 0)
+    return para_fileerr;
+  if(res == 0)
+    return para_timeout;
+
+  for(n = 0; n < nNum; n++) {
+
+    if(pfd[n].revents & (POLLPRI | POLLERR)) {
+      para_clearedge(ppGpio[n]);
+      if(pFired)
+        *pFired |= 1ULL << n;
+    }
+  }
+
+  return para_ok;
+}
+
+static unsigned long long para_nsnow(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int para_readgpio_ex(para_gpio **ppGpio, int nNum, para_edge *pEdges,
+                     int nMax, int nTimeoutMS, int *pCount) {
+  struct pollfd pfd[MAXPINSPEROBJECT];
+  struct timespec tsEnd;
+  unsigned long long ts;
+  int n, res;
+
+  if(pCount == NULL)
+    return para_badarg;
+
+  *pCount = 0;
+
+  if(ppGpio == NULL || pEdges == NULL || nNum <= 0 ||
+     nNum > MAXPINSPEROBJECT || nMax <= 0)
+    return para_badarg;
+
+  para_deadline(&tsEnd, nTimeoutMS);
+
+  for(n = 0; n < nNum; n++) {
+
+    if(ppGpio[n] == NULL)
+      return para_badgpio;
+
+    if(ppGpio[n]->fdVal < 0)
+      return para_notopen;
+
+    // Unlike para_edgegpio_ex, pending edges are kept between calls
+    if(ppGpio[n]->nEdge != 2) {
+      if((res = para_edgemode(ppGpio[n], 2)) != para_ok)
+        return res;
+      para_clearedge(ppGpio[n]);
+    }
+
+    pfd[n].fd = ppGpio[n]->fdVal;
+    pfd[n].events = POLLPRI | POLLERR;
+  }
+
+  // A signal isn't a timeout, carry on with the time that's left
+  do {
+    res = poll(pfd, nNum, para_remaining(&tsEnd, nTimeoutMS));
+  } while(res < 0 && errno == EINTR);
+
+  if(res < 0)
+    return para_fileerr;
+  if(res == 0)
+    return para_timeout;
+
+  // sysfs has no event queue, so the best timestamp is now
+  ts = para_nsnow();
+
+  for(n = 0; n < nNum && *pCount < nMax; n++) {
+
+    if(!(pfd[n].revents & (POLLPRI | POLLERR)))
+      continue;
+
+    pEdges[*pCount].nTimeNS = ts;
+    pEdges[*pCount].nPin = n;
+    pEdges[*pCount].nValue = para_clearedge(ppGpio[n]);
+    (*pCount)++;
+  }
+
+  return para_ok;
+}
+
+// Character-device GPIO access, one line request holds a whole group of
+// pins so that multi-pin reads & writes are a single ioctl each.
+// Based on: https://www.kernel.org/doc/html/latest/userspace-api/gpio/chardev.html
+
+#define GPIOCHIPDEV  "/dev/gpiochip0"
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+
+// Read a small decimal or text file from sysfs, stripping the newline
+static int para_readsysfs(const char *strPath, char *str, int nLen) {
+  int fd, n;
+
+  if((fd = open(strPath, O_RDONLY)) < 0)
+    return -1;
+
+  n = read(fd, str, nLen - 1);
+  close(fd);
+
+  if(n <= 0)
+    return -1;
+
+  if(str[n-1] == '\n')
+    n--;
+  str[n] = 0;
+
+  return n;
+}
+
+// The sysfs IDs used everywhere else are offset by the chip's base,
+// find it by matching the chip label against /sys/class/gpio.
+static int para_chipbase(const char *strLabel) {
+  glob_t gl;
+  char   str1[256], str2[64];
+  int    n, nBase = 0;
+
+  if(glob(GPIOBASE "gpiochip*/label", 0, NULL, &gl))
+    return 0;  // no sysfs, assume IDs are chip offsets
+
+  for(n = 0; n < (int)gl.gl_pathc; n++) {
+
+    if(para_readsysfs(gl.gl_pathv[n], str2, sizeof(str2)) < 0 ||
+       strcmp(str2, strLabel))
+      continue;
+
+    strcpy(str1, gl.gl_pathv[n]);
+    strcpy(strrchr(str1, '/'), "/base");
+    if(para_readsysfs(str1, str2, sizeof(str2)) > 0)
+      nBase = atoi(str2);
+    break;
+  }
+
+  globfree(&gl);
+  return nBase;
+}
+
+static unsigned long long para_lineflags(para_lines *pLines, int n) {
+
+  if(pLines->nEdgeMask & (1ULL << n)) {
+
+    switch(pLines->nEdge) {
+    case 0:
+      return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    case 1:
+      return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    default:
+      return GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING |
+        GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    }
+  }
+
+  switch(pLines->eDir[n]) {
+
+  case para_dirin:
+    return GPIO_V2_LINE_FLAG_INPUT;
+
+  case para_dirout:
+    return GPIO_V2_LINE_FLAG_OUTPUT;
+
+  case para_dirwand:
+    return GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN;
+
+  case para_dirwor:
+    return GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_SOURCE;
+
+  case para_dirunk:
+  default:
+    return 0;  // leave as-is
+  }
+}
+
+// The whole request is reconfigured at once, so describe every line.
+// Output values are re-stated so lines that aren't changing don't glitch.
+static int para_cfglines(para_lines *pLines) {
+  struct gpio_v2_line_config cfg;
+  unsigned long long flags[MAXPINSPEROBJECT], mask, done;
+  int n, m, nAttr = 0;
+
+  for(n = 0; n < pLines->nLines; n++)
+    flags[n] = para_lineflags(pLines, n);
+
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.flags = flags[0];
+  done = 0;
+
+  for(n = 0; n < pLines->nLines; n++) {
+
+    if(done & (1ULL << n))
+      continue;
+
+    mask = 0;
+    for(m = n; m < pLines->nLines; m++)
+      if(flags[m] == flags[n])
+        mask |= 1ULL << m;
+    done |= mask;
+
+    if(flags[n] == cfg.flags)
+      continue;
+
+    if(nAttr >= GPIO_V2_LINE_NUM_ATTRS_MAX - 1)
+      return para_badarg;
+
+    cfg.attrs[nAttr].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    cfg.attrs[nAttr].attr.flags = flags[n];
+    cfg.attrs[nAttr].mask = mask;
+    nAttr++;
+  }
+
+  cfg.attrs[nAttr].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+  cfg.attrs[nAttr].attr.values = pLines->nValue;
+  cfg.attrs[nAttr].mask = ~0ULL;
+  nAttr++;
+
+  cfg.num_attrs = nAttr;
+
+  if(ioctl(pLines->fdReq, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) < 0)
+    return para_fileerr;
+
+  return para_ok;
+}
+
+int para_initlines(para_lines **ppLines, int *pIDArray, int nNumIDs) {
+  struct gpiochip_info info;
+  struct gpio_v2_line_request req;
+  int  fd, n, nBase;
+  int  rc = para_ok;
+
+  if(ppLines == NULL)
+    return para_badgpio;
+
+  *ppLines = NULL;
+
+  if(pIDArray == NULL || nNumIDs <= 0 || nNumIDs > MAXPINSPEROBJECT)
+    return para_badarg;
+
+  if((fd = open(GPIOCHIPDEV, O_RDWR)) < 0) {
+    fprintf(stderr, "Can't open " GPIOCHIPDEV ", run me as root?\n");
+    return para_noaccess;
+  }
+
+  memset(&info, 0, sizeof(info));
+  if(ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0) {
+    fprintf(stderr, "Unable to get chip info from " GPIOCHIPDEV "\n");
+    close(fd);
+    return para_fileerr;
+  }
+
+  nBase = para_chipbase(info.label);
+
+  *ppLines = (para_lines *)malloc(sizeof(para_lines));
+  if(*ppLines == NULL) {
+    fprintf(stderr, "Unable to allocate a new para_lines structure\n");
+    close(fd);
+    return para_outofmemory;
+  }
+
+  memset(*ppLines, 0, sizeof(para_lines));
+  memset(&req, 0, sizeof(req));
+
+  for(n = 0; n < nNumIDs; n++) {
+
+    if(pIDArray[n] < nBase || pIDArray[n] - nBase >= (int)info.lines) {
+      fprintf(stderr, "GPIO %d is not on " GPIOCHIPDEV "\n", pIDArray[n]);
+      rc = para_outofrange;
+      goto initfail;
+    }
+
+    (*ppLines)->nIDs[n] = pIDArray[n];
+    (*ppLines)->eDir[n] = para_dirunk;
+    (*ppLines)->nOffsets[n] = pIDArray[n] - nBase;
+    req.offsets[n] = pIDArray[n] - nBase;
+  }
+
+  strcpy(req.consumer, "para_gpio");
+  req.num_lines = nNumIDs;
+  req.config.flags = 0;  // no defaults imposed, same as sysfs
+
+  if(ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+    fprintf(stderr, "Unable to request GPIO lines, already in use?\n");
+    rc = para_alreadyopen;
+    goto initfail;
+  }
+
+  close(fd);
+  (*ppLines)->nLines = nNumIDs;
+  (*ppLines)->fdReq = req.fd;
+
+  // Edge events are drained without blocking, see para_edgelines()
+  fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+
+  return rc;
+
+ initfail:
+  close(fd);
+  free(*ppLines);
+  *ppLines = NULL;
+  return rc;
+}
+
+void para_closelines(para_lines *pLines) {
+
+  if(pLines == NULL)
+    return;
+
+  if(pLines->fdReq >= 0)
+    close(pLines->fdReq);
+
+  free(pLines);
+}
+
+int para_setlines(para_lines *pLines, unsigned long long nMask,
+                  unsigned long long nValue) {
+  struct gpio_v2_line_values vals;
+  int ret = para_ok;
+
+  if(pLines == NULL)
+    return para_badgpio;
+
+  if(pLines->fdReq < 0)
+    return para_notopen;
+
+  if(nMask & ~pLines->nOutMask) {
+    nMask &= pLines->nOutMask;
+    ret = para_nodir;
+  }
+
+  if(!nMask)
+    return ret;
+
+  vals.mask = nMask;
+  vals.bits = nValue & nMask;
+
+  if(ioctl(pLines->fdReq, GPIO_V2_LINE_SET_VALUES_IOCTL, &vals) < 0)
+    return para_fileerr;
+
+  pLines->nValue = (pLines->nValue & ~nMask) | (nValue & nMask);
+
+  return ret;
+}
+
+int para_dirlines(para_lines *pLines, unsigned long long nMask,
+                  para_gpiodir eDir) {
+  para_gpiodir eOld[MAXPINSPEROBJECT];
+  unsigned long long nOldEdge;
+  int n;
+
+  if(pLines == NULL)
+    return para_badgpio;
+
+  if(pLines->fdReq < 0)
+    return para_notopen;
+
+  if(eDir == para_dirunk)
+    return para_nodir;
+
+  memcpy(eOld, pLines->eDir, sizeof(eOld));
+  nOldEdge = pLines->nEdgeMask;
+
+  for(n = 0; n < pLines->nLines; n++)
+    if(nMask & (1ULL << n))
+      pLines->eDir[n] = eDir;
+
+  if(eDir != para_dirin)
+    pLines->nEdgeMask &= ~nMask;  // outputs can't have edge detection
+
+  if(para_cfglines(pLines) != para_ok) {
+    memcpy(pLines->eDir, eOld, sizeof(eOld));
+    pLines->nEdgeMask = nOldEdge;
+    return para_fileerr;
+  }
+
+  pLines->nOutMask = 0;
+  for(n = 0; n < pLines->nLines; n++)
+    if(pLines->eDir[n] >= para_dirout)
+      pLines->nOutMask |= 1ULL << n;
+
+  return para_ok;
+}
+
+int para_getlines(para_lines *pLines, unsigned long long nMask,
+                  unsigned long long *pValue) {
+  struct gpio_v2_line_values vals;
+
+  if(pLines == NULL)
+    return para_badgpio;
+
+  if(pLines->fdReq < 0)
+    return para_notopen;
+
+  if(pValue == NULL)
+    return para_badarg;
+
+  vals.mask = nMask;
+  vals.bits = 0;
+
+  if(ioctl(pLines->fdReq, GPIO_V2_LINE_GET_VALUES_IOCTL, &vals) < 0)
+    return para_fileerr;
+
+  *pValue = vals.bits & nMask;
+
+  return para_ok;
+}
+
+// Select edge detection on the lines in nMask, then throw away any
+// events already queued so only edges from now on are seen.
+static int para_armlines(para_lines *pLines, unsigned long long nMask,
+                         int nEdge, bool bFlush) {
+  struct gpio_v2_line_event ev[16];
+  int n, res;
+
+  if(nMask & pLines->nOutMask)
+    return para_nodir;
+
+  if(nMask != pLines->nEdgeMask || nEdge != pLines->nEdge) {
+
+    pLines->nEdgeMask = nMask;
+    pLines->nEdge = nEdge;
+    if((res = para_cfglines(pLines)) != para_ok) {
+      pLines->nEdgeMask = 0;
+      return res;
+    }
+
+    for(n = 0; n < pLines->nLines; n++)
+      if(nMask & (1ULL << n))
+        pLines->eDir[n] = para_dirin;
+
+    bFlush = true;  // events from the old setting don't apply
+    pLines->nSeqNo = 0;
+  }
+
+  while(bFlush && read(pLines->fdReq, ev, sizeof(ev)) > 0)
+    ;
+
+  return para_ok;
+}
+
+// Wait for at least one event, returning the lines that had one
+static int para_pollines(para_lines *pLines, const struct timespec *pEnd,
+                         int nTimeoutMS, unsigned long long *pFired) {
+  struct gpio_v2_line_event ev[16];
+  struct pollfd pfd;
+  int n, m, res;
+
+  *pFired = 0;
+  pfd.fd = pLines->fdReq;
+  pfd.events = POLLIN;
+
+  do {
+    res = poll(&pfd, 1, para_remaining(pEnd, nTimeoutMS));
+  } while(res < 0 && errno == EINTR);
+
+  if(res < 0)
+    return para_fileerr;
+  if(res == 0)
+    return para_timeout;
+
+  while((res = read(pLines->fdReq, ev, sizeof(ev))) > 0) {
+
+    for(n = 0; n < res / (int)sizeof(ev[0]); n++)
+      for(m = 0; m < pLines->nLines; m++)
+        if(pLines->nOffsets[m] == ev[n].offset)
+          *pFired |= 1ULL << m;
+  }
+
+  return para_ok;
+}
+
+int para_waitlines(para_lines *pLines, unsigned long long nMask, int nValue,
+                   int nTimeoutMS, unsigned long long *pFired) {
+  struct timespec tsEnd;
+  unsigned long long val, fired;
+  int res;
+
+  if(pLines == NULL)
+    return para_badgpio;
+
+  if(pLines->fdReq < 0)
+    return para_notopen;
+
+  if(!nMask)
+    return para_badarg;
+
+  para_deadline(&tsEnd, nTimeoutMS);
+
+  // Arm before sampling so a change in between isn't missed
+  if((res = para_armlines(pLines, nMask, nValue & 1, true)) != para_ok)
+    return res;
+
+  for(;;) {
+
+    if((res = para_getlines(pLines, nMask, &val)) != para_ok)
+      return res;
+
+    if(!(nValue & 1))
+      val = ~val & nMask;
+
+    if(val) {
+      if(pFired)
+        *pFired = val;
+      return para_ok;
+    }
+
+    if((res = para_pollines(pLines, &tsEnd, nTimeoutMS, &fired)) != para_ok)
+      return res;
+  }
+}
+
+int para_edgelines(para_lines *pLines, unsigned long long nMask, int nValue,
+                   int nTimeoutMS, unsigned long long *pFired) {
+  struct timespec tsEnd;
+  unsigned long long fired;
+  int res;
+
+  if(pFired)
+    *pFired = 0;
+
+  if(pLines == NULL)
+    return para_badgpio;
+
+  if(pLines->fdReq < 0)
+    return para_notopen;
+
+  if(!nMask || nValue < 0 || nValue > 2)
+    return para_badarg;
+
+  para_deadline(&tsEnd, nTimeoutMS);
+
+  if((res = para_armlines(pLines, nMask, nValue, true)) != para_ok)
+    return res;
+
+  do {
+    res = para_pollines(pLines, &tsEnd, nTimeoutMS, &fired);
+  } while(res == para_ok && !(fired & nMask));
+
+  if(pFired)
+    *pFired = fired & nMask;
+
+  return res;
+}
+
+int para_readlines(para_lines *pLines, unsigned long long nMask,
+                   para_edge *pEdges, int nMax, int nTimeoutMS, int *pCount) {
+  struct gpio_v2_line_event ev[16];
+  struct pollfd pfd;
+  struct timespec tsEnd;
+  int n, m, res;
+
+  if(pCount == NULL)
+    return para_badarg;
+
+  *pCount = 0;
+
+  if(pLines == NULL)
+    return para_badgpio;
+
+  if(pLines->fdReq < 0)
+    return para_notopen;
+
+  if(!nMask || pEdges == NULL || nMax <= 0)
+    return para_badarg;
+
+  if((res = para_armlines(pLines, nMask, 2, false)) != para_ok)
+    return res;
+
+  pfd.fd = pLines->fdReq;
+  pfd.events = POLLIN;
+
+  para_deadline(&tsEnd, nTimeoutMS);
+
+  do {
+    res = poll(&pfd, 1, para_remaining(&tsEnd, nTimeoutMS));
+  } while(res < 0 && errno == EINTR);
+
+  if(res < 0)
+    return para_fileerr;
+  if(res == 0)
+    return para_timeout;
+
+  // Don't read more than fits, the rest stay queued in the kernel
+  while(*pCount < nMax) {
+
+    m = nMax - *pCount;
+    if(m > 16)
+      m = 16;
+
+    res = read(pLines->fdReq, ev, m * sizeof(ev[0]));
+    if(res <= 0)
+      break;
+
+    for(n = 0; n < res / (int)sizeof(ev[0]); n++) {
+
+      // A gap in the sequence numbers means the kernel fifo overflowed.
+      // nLost is read from other threads, so no torn 64-bit writes.
+      if(pLines->nSeqNo && ev[n].seqno > pLines->nSeqNo + 1)
+        __atomic_fetch_add(&pLines->nLost, ev[n].seqno - pLines->nSeqNo - 1,
+                           __ATOMIC_RELAXED);
+      pLines->nSeqNo = ev[n].seqno;
+
+      for(m = 0; m < pLines->nLines; m++)
+        if(pLines->nOffsets[m] == ev[n].offset)
+          break;
+
+      pEdges[*pCount].nTimeNS = ev[n].timestamp_ns;
+      pEdges[*pCount].nPin = m;
+      pEdges[*pCount].nValue = ev[n].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+      (*pCount)++;
+    }
+  }
+
+  return para_ok;
+}
+
+#else  // GPIO_V2_GET_LINE_IOCTL
+
+// Kernel headers too old for the v2 character device interface
+
+int para_initlines(para_lines **ppLines, int *pIDArray, int nNumIDs) {
+
+  if(ppLines != NULL)
+    *ppLines = NULL;
+
+  fprintf(stderr, "GPIO character device not supported by this build\n");
+  return para_noaccess;
+}
+
+void para_closelines(para_lines *pLines) {
+
+  free(pLines);
+}
+
+int para_setlines(para_lines *pLines, unsigned long long nMask,
+                  unsigned long long nValue) {
+
+  return pLines ? para_notopen : para_badgpio;
+}
+
+int para_dirlines(para_lines *pLines, unsigned long long nMask,
+                  para_gpiodir eDir) {
+
+  return pLines ? para_notopen : para_badgpio;
+}
+
+int para_getlines(para_lines *pLines, unsigned long long nMask,
+                  unsigned long long *pValue) {
+
+  return pLines ? para_notopen : para_badgpio;
+}
+
+int para_waitlines(para_lines *pLines, unsigned long long nMask, int nValue,
+                   int nTimeoutMS, unsigned long long *pFired) {
+
+  return pLines ? para_notopen : para_badgpio;
+}
+
+int para_edgelines(para_lines *pLines, unsigned long long nMask, int nValue,
+                   int nTimeoutMS, unsigned long long *pFired) {
+
+  return pLines ? para_notopen : para_badgpio;
+}
+
+int para_readlines(para_lines *pLines, unsigned long long nMask,
+                   para_edge *pEdges, int nMax, int nTimeoutMS, int *pCount) {
+
+  return pLines ? para_notopen : para_badgpio;
+}
+
+#endif  // GPIO_V2_GET_LINE_IOCTL
+
+// Memory-mapped GPIO access, talks straight to the Zynq PS GPIO
+// controller the same way getfpga maps the SLCR.
+// Register offsets in bytes, from UG585 appendix B.19
+
+#define ZYNQGPIO_MASKDATA(b)  (0x000 + 8 * (b))   // LSW, MSW at +4
+#define ZYNQGPIO_DATARO(b)    (0x060 + 4 * (b))
+#define ZYNQGPIO_DIRM(b)      (0x204 + 0x40 * (b))
+#define ZYNQGPIO_OEN(b)       (0x208 + 0x40 * (b))
+
+#define ZYNQREG(p, off)  ((p)->pRegs[(off) >> 2])
+
+// MIO 0-31 bank 0, MIO 32-53 bank 1, EMIO 54-85 bank 2, EMIO 86-117 bank 3
+static int para_mmiopin(int nID, unsigned char *pBank, unsigned char *pBit) {
+
+  if(nID < 0 || nID > LASTGPIOID)
+    return para_outofrange;
+
+  if(nID < 32) {
+    *pBank = 0;
+    *pBit = nID;
+  } else if(nID < EXTGPIOSTART) {
+    *pBank = 1;
+    *pBit = nID - 32;
+  } else {
+    *pBank = 2 + (nID - EXTGPIOSTART) / 32;
+    *pBit = (nID - EXTGPIOSTART) % 32;
+  }
+
+  return para_ok;
+}
+
+// Spread a group mask/value out to per-bank register bits
+static void para_mmiobanks(para_mmio *pMmio, unsigned long long nMask,
+                           unsigned long long nValue,
+                           unsigned *pMask, unsigned *pData) {
+  int n;
+
+  memset(pMask, 0, ZYNQGPIONBANKS * sizeof(unsigned));
+  memset(pData, 0, ZYNQGPIONBANKS * sizeof(unsigned));
+
+  for(n = 0; nMask && n < pMmio->nLines; n++, nMask >>= 1, nValue >>= 1) {
+
+    if(!(nMask & 1))
+      continue;
+
+    pMask[pMmio->nBank[n]] |= 1U << pMmio->nBit[n];
+    if(nValue & 1)
+      pData[pMmio->nBank[n]] |= 1U << pMmio->nBit[n];
+  }
+}
+
+// MASK_DATA takes the inverted write-mask in the upper 16 bits
+static void para_mmiowrite(para_mmio *pMmio, unsigned *pMask, unsigned *pData) {
+  int b;
+
+  for(b = 0; b < ZYNQGPIONBANKS; b++) {
+
+    if(pMask[b] & 0xFFFF)
+      ZYNQREG(pMmio, ZYNQGPIO_MASKDATA(b)) =
+        ((~pMask[b] & 0xFFFF) << 16) | (pData[b] & 0xFFFF);
+
+    if(pMask[b] >> 16)
+      ZYNQREG(pMmio, ZYNQGPIO_MASKDATA(b) + 4) =
+        (~pMask[b] & 0xFFFF0000) | (pData[b] >> 16);
+  }
+}
+
+// Turn drivers on (pEnb bit set) or off for the pins in pMask
+static void para_mmioenable(para_mmio *pMmio, unsigned *pMask, unsigned *pEnb) {
+  int b;
+
+  for(b = 0; b < ZYNQGPIONBANKS; b++) {
+
+    if(!pMask[b])
+      continue;
+
+    ZYNQREG(pMmio, ZYNQGPIO_DIRM(b)) =
+      (ZYNQREG(pMmio, ZYNQGPIO_DIRM(b)) & ~pMask[b]) | (pEnb[b] & pMask[b]);
+    ZYNQREG(pMmio, ZYNQGPIO_OEN(b)) =
+      (ZYNQREG(pMmio, ZYNQGPIO_OEN(b)) & ~pMask[b]) | (pEnb[b] & pMask[b]);
+  }
+}
+
+int para_initmmio(para_mmio **ppMmio, int *pIDArray, int nNumIDs) {
+  const char *str;
+
+  str = getenv("PARA_GPIOMEM");
+  if(str != NULL && str[0])
+    return para_initmmio_ex(ppMmio, pIDArray, nNumIDs, str, 0);
+
+  return para_initmmio_ex(ppMmio, pIDArray, nNumIDs, "/dev/mem", ZYNQGPIOBASE);
+}
+
+int para_initmmio_ex(para_mmio **ppMmio, int *pIDArray, int nNumIDs,
+                     const char *strDev, long nOffset) {
+  para_mmio *pMmio;
+  void *pMap;
+  int  n;
+  int  rc = para_ok;
+
+  if(ppMmio == NULL)
+    return para_badgpio;
+
+  *ppMmio = NULL;
+
+  if(pIDArray == NULL || strDev == NULL ||
+     nNumIDs <= 0 || nNumIDs > MAXPINSPEROBJECT)
+    return para_badarg;
+
+  pMmio = (para_mmio *)malloc(sizeof(para_mmio));
+  if(pMmio == NULL) {
+    fprintf(stderr, "Unable to allocate a new para_mmio structure\n");
+    return para_outofmemory;
+  }
+
+  memset(pMmio, 0, sizeof(para_mmio));
+  pMmio->fdMem = -1;
+
+  for(n = 0; n < nNumIDs; n++) {
+
+    if(para_mmiopin(pIDArray[n], pMmio->nBank + n, pMmio->nBit + n) != para_ok) {
+      fprintf(stderr, "GPIO %d has no Zynq GPIO register bit\n", pIDArray[n]);
+      rc = para_outofrange;
+      goto initfail;
+    }
+
+    pMmio->nIDs[n] = pIDArray[n];
+    pMmio->eDir[n] = para_dirunk;
+    pMmio->nBanks |= 1U << pMmio->nBank[n];
+  }
+
+  if((pMmio->fdMem = open(strDev, O_RDWR | O_SYNC)) < 0) {
+    fprintf(stderr, "Can't open %s, run me as root?\n", strDev);
+    rc = para_noaccess;
+    goto initfail;
+  }
+
+  pMap = mmap(NULL, ZYNQGPIOSIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+              pMmio->fdMem, nOffset);
+  if(pMap == MAP_FAILED) {
+    fprintf(stderr, "Unable to map the GPIO registers from %s\n", strDev);
+    rc = para_fileerr;
+    goto initfail;
+  }
+
+  pMmio->pRegs = (volatile unsigned *)pMap;
+  pMmio->nLines = nNumIDs;
+  *ppMmio = pMmio;
+
+  return rc;
+
+ initfail:
+  para_closemmio(pMmio);
+  return rc;
+}
+
+void para_closemmio(para_mmio *pMmio) {
+
+  if(pMmio == NULL)
+    return;
+
+  if(pMmio->pRegs != NULL)
+    munmap((void *)pMmio->pRegs, ZYNQGPIOSIZE);
+
+  if(pMmio->fdMem >= 0)
+    close(pMmio->fdMem);
+
+  free(pMmio);
+}
+
+int para_setmmio(para_mmio *pMmio, unsigned long long nMask,
+                 unsigned long long nValue) {
+  unsigned mask[ZYNQGPIONBANKS], data[ZYNQGPIONBANKS];
+  unsigned long long nWired;
+  int ret = para_ok;
+
+  if(pMmio == NULL)
+    return para_badgpio;
+
+  if(pMmio->pRegs == NULL)
+    return para_notopen;
+
+  nWired = pMmio->nWandMask | pMmio->nWorMask;
+
+  if(nMask & ~(pMmio->nOutMask | nWired)) {
+    nMask &= pMmio->nOutMask | nWired;
+    ret = para_nodir;
+  }
+
+  if(nMask & pMmio->nOutMask) {
+    para_mmiobanks(pMmio, nMask & pMmio->nOutMask, nValue, mask, data);
+    para_mmiowrite(pMmio, mask, data);
+  }
+
+  if(nMask & nWired) {
+    // wired-and drives on 0, wired-or drives on 1
+    para_mmiobanks(pMmio, nMask & nWired, nValue ^ pMmio->nWandMask, mask, data);
+    para_mmioenable(pMmio, mask, data);
+  }
+
+  return ret;
+}
+
+int para_dirmmio(para_mmio *pMmio, unsigned long long nMask,
+                 para_gpiodir eDir) {
+  unsigned mask[ZYNQGPIONBANKS], data[ZYNQGPIONBANKS];
+  int n;
+
+  if(pMmio == NULL)
+    return para_badgpio;
+
+  if(pMmio->pRegs == NULL)
+    return para_notopen;
+
+  switch(eDir) {
+
+  case para_dirin:
+    para_mmiobanks(pMmio, nMask, 0, mask, data);
+    para_mmioenable(pMmio, mask, data);
+    break;
+
+  case para_dirout:  // same as sysfs, output starts at 0
+    para_mmiobanks(pMmio, nMask, 0, mask, data);
+    para_mmiowrite(pMmio, mask, data);
+    para_mmiobanks(pMmio, nMask, ~0ULL, mask, data);
+    para_mmioenable(pMmio, mask, data);
+    break;
+
+  case para_dirwand:  // start floating, as sysfs, with the value preset
+    para_mmiobanks(pMmio, nMask, 0, mask, data);
+    para_mmiowrite(pMmio, mask, data);
+    para_mmiobanks(pMmio, nMask, 0, mask, data);
+    para_mmioenable(pMmio, mask, data);
+    break;
+
+  case para_dirwor:
+    para_mmiobanks(pMmio, nMask, ~0ULL, mask, data);
+    para_mmiowrite(pMmio, mask, data);
+    para_mmiobanks(pMmio, nMask, 0, mask, data);
+    para_mmioenable(pMmio, mask, data);
+    break;
+
+  case para_dirunk:
+  default:
+    return para_nodir;
+  }
+
+  pMmio->nOutMask = pMmio->nWandMask = pMmio->nWorMask = 0;
+
+  for(n = 0; n < pMmio->nLines; n++) {
+
+    if(nMask & (1ULL << n))
+      pMmio->eDir[n] = eDir;
+
+    if(pMmio->eDir[n] == para_dirout)
+      pMmio->nOutMask |= 1ULL << n;
+    else if(pMmio->eDir[n] == para_dirwand)
+      pMmio->nWandMask |= 1ULL << n;
+    else if(pMmio->eDir[n] == para_dirwor)
+      pMmio->nWorMask |= 1ULL << n;
+  }
+
+  return para_ok;
+}
+
+int para_getmmio(para_mmio *pMmio, unsigned long long nMask,
+                 unsigned long long *pValue) {
+  unsigned data[ZYNQGPIONBANKS];
+  int b, n;
+
+  if(pMmio == NULL)
+    return para_badgpio;
+
+  if(pMmio->pRegs == NULL)
+    return para_notopen;
+
+  if(pValue == NULL)
+    return para_badarg;
+
+  // Sample each bank once so all pins of a bank are coherent
+  for(b = 0; b < ZYNQGPIONBANKS; b++)
+    if(pMmio->nBanks & (1U << b))
+      data[b] = ZYNQREG(pMmio, ZYNQGPIO_DATARO(b));
+
+  *pValue = 0;
+
+  for(n = 0; n < pMmio->nLines; n++)
+    if((nMask & (1ULL << n)) &&
+       (data[pMmio->nBank[n]] & (1U << pMmio->nBit[n])))
+      *pValue |= 1ULL << n;
+
+  return para_ok;
+}
+
+int para_pinmmio(para_mmio *pMmio, int nLine, para_mmiobit *pPin) {
+  unsigned bank, bit, half;
+
+  if(pMmio == NULL)
+    return para_badgpio;
+
+  if(pMmio->pRegs == NULL)
+    return para_notopen;
+
+  if(nLine < 0 || nLine >= pMmio->nLines || pPin == NULL)
+    return para_badarg;
+
+  bank = pMmio->nBank[nLine];
+  bit = pMmio->nBit[nLine];
+  half = 1U << (bit & 15);
+
+  // Same encoding as para_mmiowrite(), inverted write-mask on top
+  pPin->pMaskData = &ZYNQREG(pMmio, ZYNQGPIO_MASKDATA(bank) + (bit < 16 ? 0 : 4));
+  pPin->nLow = (~half & 0xFFFF) << 16;
+  pPin->nHigh = pPin->nLow | half;
+  pPin->pDataRO = &ZYNQREG(pMmio, ZYNQGPIO_DATARO(bank));
+  pPin->nBit = bit;
+
+  return para_ok;
+}
+
 // Legacy GPIO access, following:
 // https://www.kernel.org/doc/Documentation/gpio/gpio-legacy.txt
 // Does not seem to be available on Parallella.
@@ -54,11 +54,23 @@ CParaGpio::CParaGpio() {
   
   nPins = 0;
   bIsOK = true;
+  eBackend = para_bksysfs;
+  pLines = NULL;
+  pMmio = NULL;
+  nShadow = nKnown = 0;
+  nIOCalls = 0;
  }
 
-CParaGpio::CParaGpio(int nStartID, int nNumIDs/*=1*/, bool bPorcOrder/*=false*/) {
+CParaGpio::CParaGpio(int nStartID, int nNumIDs/*=1*/, bool bPorcOrder/*=false*/,
+                     para_gpiobackend eBackend/*=para_bksysfs*/) {
   int n, p;
 
+  this->eBackend = eBackend;
+  pLines = NULL;
+  pMmio = NULL;
+  nShadow = nKnown = 0;
+  nIOCalls = 0;
+
   if(nStartID < 0 || nNumIDs > MAXPINSPEROBJECT || 
      nStartID + nNumIDs >= LASTGPIOID) {
 
@@ -76,16 +88,26 @@ CParaGpio::CParaGpio(int nStartID, int nNumIDs/*=1*/, bool bPorcOrder/*=false*/)
     if(bPorcOrder)
       p = nPorcOrder[p] + EXTGPIOSTART;
 
-    if(para_initgpio(pGpio + n, p) != para_ok)  // Will be set to NULL on error
-      bIsOK = false;
+    nIDs[n] = p;
+    eDirs[n] = para_dirunk;
   }
 
   nPins = nNumIDs;
+
+  if(OpenPins(0) != para_ok)
+    bIsOK = false;
 }
 
-CParaGpio::CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder/*=false*/) {
+CParaGpio::CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder/*=false*/,
+                     para_gpiobackend eBackend/*=para_bksysfs*/) {
   int n, p;
 
+  this->eBackend = eBackend;
+  pLines = NULL;
+  pMmio = NULL;
+  nShadow = nKnown = 0;
+  nIOCalls = 0;
+
   if(nNumIDs < 0 || nNumIDs > MAXPINSPEROBJECT) {
     nPins = 0;
     bIsOK = false;
@@ -101,11 +123,14 @@ CParaGpio::CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder/*=false*/) {
     if(bPorcOrder)
       p = nPorcOrder[p] + EXTGPIOSTART;
 
-    if(para_initgpio(pGpio + n, p) != para_ok)  // Will be set to NULL on error
-      bIsOK = false;
+    nIDs[n] = p;
+    eDirs[n] = para_dirunk;
   }
 
   nPins = nNumIDs;
+
+  if(OpenPins(0) != para_ok)
+    bIsOK = false;
 }
 
 CParaGpio::~CParaGpio() {
@@ -113,127 +138,449 @@ CParaGpio::~CParaGpio() {
   Close();
 }
 
+int CParaGpio::SetBackend(para_gpiobackend eBackend) {
+
+  if(nPins)
+    return para_alreadyopen;
+
+  this->eBackend = eBackend;
+
+  return para_ok;
+}
+
+// (Re-)open all pins as one group for the group-based backends
+int CParaGpio::OpenGroup() {
+  int n;
+
+  para_closelines(pLines);
+  pLines = NULL;
+  para_closemmio(pMmio);
+  pMmio = NULL;
+
+  if(!nPins || eBackend == para_bksysfs)
+    return para_ok;
+
+  // A new request starts with all directions unknown
+  for(n = 0; n < nPins; n++)
+    eDirs[n] = para_dirunk;
+  nKnown = 0;
+
+  switch(eBackend) {
+
+  case para_bkcdev:
+    return para_initlines(&pLines, nIDs, nPins);
+
+  case para_bkmmio:
+    return para_initmmio(&pMmio, nIDs, nPins);
+
+  case para_bksysfs:
+  default:
+    return para_ok;
+  }
+}
+
+// Open pins nFirst..nPins-1, which have been filled-in in nIDs[]
+int CParaGpio::OpenPins(int nFirst) {
+  int n;
+
+  for(n = nFirst; n < nPins; n++) {
+    pGpio[n] = NULL;
+    nKnown &= ~(1ULL << n);
+  }
+
+  if(nFirst >= nPins)
+    return para_ok;
+
+  if(eBackend != para_bksysfs)
+    return OpenGroup();
+
+  return para_initgpios(pGpio + nFirst, nIDs + nFirst, nPins - nFirst, true);
+}
+
+// Close pins nFirst..nPins-1 and take them out of the object, the
+// others stay open
+int CParaGpio::DropPins(int nFirst) {
+
+  if(nFirst < 0 || nFirst >= nPins)
+    return para_ok;
+
+  if(eBackend == para_bksysfs)
+    para_closegpios(pGpio + nFirst, nPins - nFirst, false);
+
+  nPins = nFirst;
+  nShadow &= PinMask();
+  nKnown &= PinMask();
+
+  return OpenGroup();  // re-request the rest as a group
+}
+
 int CParaGpio::AddPin(int nID, bool bPorcOrder/*=false*/) {
-  int  ret;
 
-  if(nPins >= MAXPINSPEROBJECT)
+  return AddPins(&nID, 1, bPorcOrder);
+}
+
+int CParaGpio::AddPins(int *pIDArray, int nNumIDs, bool bPorcOrder/*=false*/) {
+  int  n, nFirst, ret;
+
+  if(pIDArray == NULL || nNumIDs <= 0)
+    return para_badarg;
+
+  if(nPins + nNumIDs > MAXPINSPEROBJECT)
     return para_outofmemory;
 
-  if(bPorcOrder)
-    nID = nPorcOrder[nID] + EXTGPIOSTART;
+  nFirst = nPins;
 
-  ret = para_initgpio(pGpio + nPins, nID);
+  for(n = 0; n < nNumIDs; n++) {
+    nIDs[nFirst + n] = bPorcOrder ? nPorcOrder[pIDArray[n]] + EXTGPIOSTART
+                                  : pIDArray[n];
+    eDirs[nFirst + n] = para_dirunk;
+  }
 
-  if(ret != para_ok)
+  nPins += nNumIDs;
+  ret = OpenPins(nFirst);
+
+  if(ret != para_ok) {
+    nPins = nFirst;
+    if(eBackend != para_bksysfs)
+      OpenGroup();  // put back the pins we had
     bIsOK = false;
-  else
-    nPins++;
+  }
 
   return ret;
 }
 
 int CParaGpio::SetDirection(para_gpiodir eDir) {
+
+  return SetDirection(PinMask(), eDir);
+}
+
+int CParaGpio::SetDirection(unsigned long long nMask, para_gpiodir eDir) {
+  unsigned long long nFailed = 0;
   int n, res, ret = para_ok;
 
-  for(n = 0; n < nPins; n++) {
+  nMask &= PinMask();
 
-    res = para_dirgpio(pGpio[n], eDir);
+  switch(eBackend) {
 
-    if(res != para_ok)
-      ret = res;  // return last error, if any
+  case para_bkcdev:
+    ret = para_dirlines(pLines, nMask, eDir);
+    break;
+
+  case para_bkmmio:
+    ret = para_dirmmio(pMmio, nMask, eDir);
+    break;
+
+  case para_bksysfs:
+  default:
+    for(n = 0; n < nPins; n++) {
+
+      if(!(nMask & (1ULL << n)))
+	continue;
+
+      res = para_dirgpio(pGpio[n], eDir);
+
+      if(res != para_ok) {
+	nFailed |= 1ULL << n;
+	ret = res;  // return last error, if any
+      }
+    }
+    break;
   }
 
-  return ret;
-}
+  // One request for the whole group, it fails for every pin
+  if(eBackend != para_bksysfs && ret != para_ok)
+    nFailed = nMask;
 
-int CParaGpio::GetDirection(para_gpiodir *pDir) {
+  // Each pin's direction from its own result.  Setting it again
+  // re-drives the level (sysfs "out" is low), so forget what we drove.
+  for(n = 0; n < nPins; n++)
+    if(nMask & (1ULL << n))
+      eDirs[n] = (nFailed & (1ULL << n)) ? para_dirunk : eDir;
+  nKnown &= ~nMask;
 
-  return para_noaccess;  // TODO: Implement C function for this!
+  return ret;
 }
 
-int CParaGpio::SetValue(unsigned long long nValue) {
+int CParaGpio::GetDirection(para_gpiodir *pDir, bool bResync/*=false*/) {
+  para_gpiodir eDir;
   int n, res, ret = para_ok;
 
-  for(n = 0; n < nPins; n++) {
+  if(pDir == NULL)
+    return para_badarg;
 
-    res = para_setgpio(pGpio[n], (int)((nValue >> n) & 1));
+  *pDir = para_dirunk;
 
-    if(res != para_ok)
-      ret = res;
+  for(n = 0; n < nPins; n++) {
+
+    eDir = eDirs[n];
+
+    if(eBackend == para_bksysfs) {
+      res = para_getdirgpio(pGpio[n], &eDir, bResync);
+      if(res != para_ok) {
+	ret = res;
+	continue;
+      }
+      if(eDir != eDirs[n])
+	nKnown &= ~(1ULL << n);
+      eDirs[n] = eDir;
+    }
+
+    if(n == 0)
+      *pDir = eDir;
+    else if(eDir != *pDir)
+      *pDir = para_dirunk;  // mixed
   }
 
   return ret;
 }
 
-int CParaGpio::GetValue(unsigned long long *pValue) {
-  int n, bit, res, ret = para_ok;
+int CParaGpio::SetValue(unsigned long long nValue) {
 
-  *pValue = 0;
+  return SetMasked(PinMask(), nValue);
+}
 
-  for(n = 0; n < nPins; n++) {
+int CParaGpio::SetMasked(unsigned long long nMask, unsigned long long nValue) {
+  unsigned long long nChange;
+  int n, res, ret = para_ok;
 
-    res = para_getgpio(pGpio[n], &bit);
+  // Only pins that are unknown or actually change go to the backend
+  nMask &= PinMask();
+  nChange = nMask & (~nKnown | (nShadow ^ nValue));
 
-    if(res != para_ok)
-      ret = res;
-    else
-      *pValue |= ((unsigned long long)(bit & 1)) << n;
+  if(!nChange)
+    return para_ok;
+
+  switch(eBackend) {
+
+  case para_bkcdev:
+    ret = para_setlines(pLines, nChange, nValue);
+    nIOCalls++;
+    break;
 
+  case para_bkmmio:
+    ret = para_setmmio(pMmio, nChange, nValue);
+    nIOCalls++;
+    break;
+
+  case para_bksysfs:
+  default:
+    for(n = 0; n < nPins; n++) {
+
+      if(!(nChange & (1ULL << n)))
+	continue;
+
+      res = para_setgpio(pGpio[n], (int)((nValue >> n) & 1));
+      nIOCalls++;
+
+      if(res != para_ok) {
+	ret = res;
+	nChange &= ~(1ULL << n);
+      }
+    }
+    break;
   }
 
+  if(ret != para_ok && eBackend != para_bksysfs) {
+    nKnown &= ~nChange;  // don't know which pins made it
+    return ret;
+  }
+
+  nShadow = (nShadow & ~nChange) | (nValue & nChange);
+  nKnown |= nChange;
+
   return ret;
 }
 
+int CParaGpio::SetPin(int nPin, int nValue) {
+
+  if(nPin < 0 || nPin >= nPins)
+    return para_outofrange;
+
+  return SetMasked(1ULL << nPin, (unsigned long long)(nValue & 1) << nPin);
+}
+
+int CParaGpio::GetValue(unsigned long long *pValue) {
+
+  return GetMasked(PinMask(), pValue);
+}
+
 int CParaGpio::GetValue(unsigned *pValue) {
-  int n, bit, res, ret = para_ok;
+  unsigned long long val;
+  int ret;
 
   if(nPins > 32)
     return para_outofrange;
 
+  ret = GetMasked(PinMask(), &val);
+  *pValue = (unsigned)val;
+
+  return ret;
+}
+
+int CParaGpio::GetMasked(unsigned long long nMask, unsigned long long *pValue) {
+  int n, bit, res, ret = para_ok;
+
+  if(pValue == NULL)
+    return para_badarg;
+
+  nMask &= PinMask();
+
+  if(eBackend != para_bksysfs)
+    nIOCalls++;
+  if(eBackend == para_bkcdev)
+    return para_getlines(pLines, nMask, pValue);
+  if(eBackend == para_bkmmio)
+    return para_getmmio(pMmio, nMask, pValue);
+
   *pValue = 0;
 
   for(n = 0; n < nPins; n++) {
 
+    if(!(nMask & (1ULL << n)))
+      continue;
+
     res = para_getgpio(pGpio[n], &bit);
+    nIOCalls++;
 
     if(res != para_ok)
       ret = res;
     else
-      *pValue |= (bit & 1) << n;
+      *pValue |= ((unsigned long long)(bit & 1)) << n;
 
   }
 
   return ret;
 }
 
+int CParaGpio::GetPin(int nPin, int *pValue) {
+  unsigned long long val;
+  int ret;
+
+  if(nPin < 0 || nPin >= nPins)
+    return para_outofrange;
+
+  if(pValue == NULL)
+    return para_badarg;
+
+  ret = GetMasked(1ULL << nPin, &val);
+  *pValue = (int)((val >> nPin) & 1);
+
+  return ret;
+}
+
 int CParaGpio::WaitLevel(int nPin, int nValue, int nTimeout) {
+  int nMS = nTimeout < 0 ? -1 : nTimeout * 1000;
+
+  if(nPin < 0 || nPin >= nPins)
+    return para_outofrange;
+
+  switch(eBackend) {
+
+  case para_bkcdev:
+    return para_waitlines(pLines, 1ULL << nPin, nValue, nMS, NULL);
+
+  case para_bksysfs:
+    return para_waitgpio(pGpio[nPin], nValue, nMS);
 
-  return para_noaccess;  // TODO: Implement C function for this!
+  case para_bkmmio:
+  default:
+    return para_noaccess;  // no interrupts without the kernel driver
+  }
 }
 
 int CParaGpio::WaitEdge(int nPin, int nValue, int nTimeout) {
 
-  return para_noaccess;  // TODO: Implement C function for this!
+  if(nPin < 0 || nPin >= nPins)
+    return para_outofrange;
+
+  return WaitEdges(1ULL << nPin, nValue & 1,
+                   nTimeout < 0 ? -1 : nTimeout * 1000);
 }
 
-int CParaGpio::Blink(unsigned long long nMask, int nMSOn, int nMSOff) {
-  int ret, n;
+int CParaGpio::WaitEdges(unsigned long long nMask, int nValue, int nTimeoutMS,
+                         unsigned long long *pFired/*=NULL*/) {
+  para_gpio *pList[MAXPINSPEROBJECT];
+  unsigned long long fired;
+  int n, m, ret;
+
+  nMask &= PinMask();
+
+  switch(eBackend) {
+
+  case para_bkcdev:
+    return para_edgelines(pLines, nMask, nValue, nTimeoutMS, pFired);
+
+  case para_bksysfs:
+    // Gather the selected pins, then map the result back to our bits
+    for(n = m = 0; n < nPins; n++)
+      if(nMask & (1ULL << n))
+	pList[m++] = pGpio[n];
+
+    ret = para_edgegpio_ex(pList, m, nValue, nTimeoutMS, &fired);
 
-  for(n=0; n < nPins; n++) {
+    if(pFired) {
+      *pFired = 0;
+      for(n = m = 0; n < nPins; n++)
+	if(nMask & (1ULL << n))
+	  if(fired & (1ULL << m++))
+	    *pFired |= 1ULL << n;
+    }
+    return ret;
 
-    if(nMask & ( 1LL << n ))
-      if((ret = para_setgpio(pGpio[n], 1)) != para_ok)
-	return ret;
+  case para_bkmmio:
+  default:
+    return para_noaccess;
   }
+}
 
-  usleep(nMSOn * 1000);
+int CParaGpio::ReadEdges(unsigned long long nMask, para_edge *pEdges, int nMax,
+                         int nTimeoutMS, int *pCount) {
+  para_gpio *pList[MAXPINSPEROBJECT];
+  int nMap[MAXPINSPEROBJECT];
+  int n, m, ret;
+
+  if(pCount == NULL)
+    return para_badarg;
+
+  nMask &= PinMask();
+
+  switch(eBackend) {
+
+  case para_bkcdev:
+    return para_readlines(pLines, nMask, pEdges, nMax, nTimeoutMS, pCount);
+
+  case para_bksysfs:
+    for(n = m = 0; n < nPins; n++) {
+      if(nMask & (1ULL << n)) {
+	nMap[m] = n;
+	pList[m++] = pGpio[n];
+      }
+    }
+
+    ret = para_readgpio_ex(pList, m, pEdges, nMax, nTimeoutMS, pCount);
+
+    for(n = 0; n < *pCount; n++)
+      pEdges[n].nPin = nMap[pEdges[n].nPin];
 
-  for(n=0; n < nPins; n++) {
+    return ret;
 
-    if(nMask & (1<<n))
-      if((ret = para_setgpio(pGpio[n], 0)) != para_ok)
-	return ret;
+  case para_bkmmio:
+  default:
+    *pCount = 0;
+    return para_noaccess;
   }
+}
+
+int CParaGpio::Blink(unsigned long long nMask, int nMSOn, int nMSOff) {
+  int ret;
+
+  if((ret = SetMasked(nMask, nMask)) != para_ok)
+    return ret;
+
+  usleep(nMSOn * 1000);
+
+  if((ret = SetMasked(nMask, 0)) != para_ok)
+    return ret;
 
   usleep(nMSOff * 1000);
 
@@ -241,11 +588,16 @@ int CParaGpio::Blink(unsigned long long nMask, int nMSOn, int nMSOff) {
 }
 
 void CParaGpio::Close() {
-  int  n;
 
-  for(n = 0; n < nPins; n++)
-    para_closegpio(pGpio[n]);
+  if(eBackend == para_bksysfs)
+    para_closegpios(pGpio, nPins, false);
+
+  para_closelines(pLines);
+  pLines = NULL;
+  para_closemmio(pMmio);
+  pMmio = NULL;
 
   nPins = 0;
+  nShadow = nKnown = 0;
   bIsOK = true;
 }
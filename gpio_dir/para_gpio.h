@@ -82,6 +82,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
       Same as para_closegpio but allow forcibly un-exporting the
       pin even if we did not export it in the first place.
 
+    para_initgpios(para_gpio **ppGpio, int *pIDArray, int nNumIDs,
+      bool bMayExist) - Same as para_initgpio_ex for nNumIDs pins at
+      once, filling the array ppGpio.  All pins are exported through a
+      single open of the export file before any are opened, which is
+      much quicker than one para_initgpio call per pin.  If any pin
+      fails, none are left open and all entries are NULL.
+
+    para_closegpios(para_gpio **ppGpio, int nNumIDs, bool bForceUnexport) -
+      Closes and un-exports the nNumIDs pins of ppGpio as for
+      para_closegpio_ex, using a single open of the unexport file.  The
+      structures are freed and the array entries set to NULL.
+
     para_setgpio(para_gpio *pGpio, int nValue) - Sets the pin level to
       nValue, looking only at the lsb.  Returns 0 on success or else
       an error code.
@@ -94,6 +106,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
           (will either float or pull to 0)
         para_dirwor - wired-or (will either pull to 1 or float)
 
+      The last direction and value written are cached in the para_gpio
+        structure, and para_setgpio / para_dirgpio skip file writes that
+        would not change anything, so repeated wired-and/or toggles of
+        the same level cost nothing.
+
+    para_getdirgpio(para_gpio *pGpio, para_gpiodir *pDir, bool bResync) -
+      Returns the direction last set with para_dirgpio (para_dirunk if
+      none).  If bResync is true the kernel's direction is read back
+      first and the cache is updated to match, in case something else
+      changed it.
+
     para_getgpio(para_gpio *pGpio, int *pValue) - Gets the current
       pin level.  Returns 0 on success or else an error code.
 
@@ -101,6 +124,124 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
       the gpio pin, turning it on for nMSOn milliseconds and then
       off for nMSOff before returning.
 
+    para_waitgpio(para_gpio *pGpio, int nValue, int nTimeoutMS) - Waits
+      until the pin is at level nValue, returning immediately if it
+      already is.  The process sleeps in poll() on the kernel's edge
+      notification rather than spinning.  Returns para_timeout after
+      nTimeoutMS milliseconds, a negative timeout waits forever.  The
+      pin must be an input.
+
+    para_edgegpio(para_gpio *pGpio, int nValue, int nTimeoutMS) - Waits
+      for a rising (nValue = 1), falling (nValue = 0) or either (nValue
+      = 2) edge on the pin.  Edges that happened before the call are
+      ignored.  Timeout as above.
+
+    para_edgegpio_ex(para_gpio **ppGpio, int nNum, int nValue,
+      int nTimeoutMS, unsigned long long *pFired) - Same as
+      para_edgegpio but waits on all nNum pins in the array ppGpio at
+      once.  On return, bit n of *pFired (if not NULL) is set if pin
+      ppGpio[n] saw an edge.
+
+    para_readgpio_ex(para_gpio **ppGpio, int nNum, para_edge *pEdges,
+      int nMax, int nTimeoutMS, int *pCount) - Collects edges (both
+      directions) on the nNum pins for continuous capture.  Waits up to
+      nTimeoutMS for at least one, then stores up to nMax para_edge
+      records with a CLOCK_MONOTONIC timestamp, the index into ppGpio
+      and the level after the edge.  Unlike para_edgegpio_ex, edges
+      between calls are kept.  sysfs doesn't queue edges, so pulses
+      shorter than the wake-up latency are seen as a single edge.
+
+  Character-device C functions:
+    These operate on a group of up to MAXPINSPEROBJECT pins held in a
+      single line request on the GPIO character device (/dev/gpiochip0),
+      so that all pins of the group are written or read with one ioctl.
+      Pin IDs are the same as for the sysfs functions above.  Bit n of
+      every mask / value corresponds to the n'th ID passed to
+      para_initlines.  Requires kernel 5.10 or later.
+
+    para_initlines(para_lines **ppLines, int *pIDArray, int nNumIDs) -
+      Requests the nNumIDs pins listed in pIDArray, returning a pointer
+      to a new para_lines structure or NULL on failure.  All pins must
+      belong to the same GPIO controller.  Pin directions are left as-is.
+
+    para_closelines(para_lines *pLines) - Releases the pins and
+      de-allocates the structure.
+
+    para_setlines(para_lines *pLines, unsigned long long nMask,
+      unsigned long long nValue) - Sets the levels of the pins selected
+      by nMask.  Pins that are not outputs (incl. wired-and/or) are
+      skipped and para_nodir is returned.
+
+    para_dirlines(para_lines *pLines, unsigned long long nMask,
+      para_gpiodir eDir) - Sets the direction of the pins selected by
+      nMask.  Wired-and/or use the kernel's open-drain/open-source
+      emulation, so para_setlines works the same for all directions.
+
+    para_getlines(para_lines *pLines, unsigned long long nMask,
+      unsigned long long *pValue) - Reads the levels of the pins
+      selected by nMask.
+
+    para_waitlines(para_lines *pLines, unsigned long long nMask,
+      int nValue, int nTimeoutMS, unsigned long long *pFired) - Waits
+      until any of the pins selected by nMask is at level nValue, same
+      as para_waitgpio.  *pFired (if not NULL) returns the pins found
+      at that level.
+
+    para_edgelines(para_lines *pLines, unsigned long long nMask,
+      int nValue, int nTimeoutMS, unsigned long long *pFired) - Waits
+      for an edge on any of the pins selected by nMask, same as
+      para_edgegpio_ex.  Edge detection is configured in the same line
+      request, so this is one poll() on one fd for the whole group.
+
+    para_readlines(para_lines *pLines, unsigned long long nMask,
+      para_edge *pEdges, int nMax, int nTimeoutMS, int *pCount) - Same
+      as para_readgpio_ex, using the kernel's queued edge events, which
+      carry the time of the interrupt.  nPin is the line's bit number.
+      Events the kernel had to drop are added to pLines->nLost.
+
+  Memory-mapped C functions:
+    These map the Zynq PS GPIO controller's registers (MASK_DATA, DATA_RO,
+      DIRM, OEN) into the process so that writes are masked register
+      stores and reads are one load per 32-pin bank, with no system call
+      at all.  Pin IDs are the controller's MIO/EMIO numbers, which
+      match the sysfs IDs on the standard Parallella kernels (EMIO 54-117
+      are banks 2 & 3).  Bit n of every mask / value corresponds to the
+      n'th ID passed to para_initmmio.  Needs read/write access to
+      /dev/mem.  The kernel driver is bypassed, so pins used this way
+      should not also be used via sysfs or the character device.
+
+    para_initmmio(para_mmio **ppMmio, int *pIDArray, int nNumIDs) -
+      Maps the controller and sets up the group of nNumIDs pins listed
+      in pIDArray.  If the environment variable PARA_GPIOMEM names a
+      file, that file is mapped from offset 0 instead of the hardware,
+      which allows testing against a fake register window.
+
+    para_initmmio_ex(para_mmio **ppMmio, int *pIDArray, int nNumIDs,
+      const char *strDev, long nOffset) - Same as para_initmmio but
+      maps the 4kB register window at nOffset (page-aligned) in strDev.
+
+    para_closemmio(para_mmio *pMmio) - Unmaps the registers and
+      de-allocates the structure.  Pin states are left as they are.
+
+    para_setmmio(para_mmio *pMmio, unsigned long long nMask,
+      unsigned long long nValue) - Sets the levels of the pins selected
+      by nMask, one MASK_DATA store per 16-pin half-bank touched.
+      Wired-and/or pins are driven by switching their output enables.
+
+    para_dirmmio(para_mmio *pMmio, unsigned long long nMask,
+      para_gpiodir eDir) - Sets the direction of the pins selected by
+      nMask, same semantics as para_dirgpio.
+
+    para_getmmio(para_mmio *pMmio, unsigned long long nMask,
+      unsigned long long *pValue) - Reads the levels of the pins
+      selected by nMask from DATA_RO.
+
+    para_pinmmio(para_mmio *pMmio, int nLine, para_mmiobit *pPin) - Fills
+      in *pPin with the registers of line nLine (bit nLine of the masks)
+      and the MASK_DATA words that drive it low and high, so a caller
+      toggling one pin many times can store them directly.  Does not
+      check the line's direction, see nOutMask.
+
   Parallella GPIO Class, member functions:
     Except for the constructors, all functions return 0 (success) or an
       error code.
@@ -108,7 +249,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     CParaGpio()  - Constructs an 'empty' GPIO object which may later be 
       assigned to a pin or group of pins.
 
-    CParaGpio(int nStartID, int nNumIDs=1, bool bPorcOrder=false) - 
+    CParaGpio(int nStartID, int nNumIDs=1, bool bPorcOrder=false,
+        para_gpiobackend eBackend=para_bksysfs) - 
       Constructs a multi-pin GPIO object starting at pin nStartID and
       continuing for a total of nNumIDs pins.  If bPorcOrder is false,
       the pins are assigned in numerical order 0, 1, 2, 3...  If true,
@@ -117,16 +259,32 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
       so they come out 'nicely' on the headers.  If using bPorcOrder,
       do NOT add the offset of 54 for the first external GPIO pin,
       instead use a startID based at 0.  The offset will be added
-      automatically.
+      automatically.  eBackend selects how the pins are accessed:
+        para_bksysfs - one sysfs file access per pin (default)
+        para_bkcdev - one character-device ioctl per group access
+        para_bkmmio - direct register access, see para_initmmio
 
-    CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder=false) -
+    CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder=false,
+        para_gpiobackend eBackend=para_bksysfs) -
       Constructs a multi-pin GPIO object using the pin numbers defined
       in the array pIDArray.  The first ID in the array corresponds to
       the lowest bit in any read or write transaction.
 
+    SetBackend(para_gpiobackend eBackend) - Selects the backend for an
+      object created with the empty constructor.  Must be called before
+      any pins are added.
+
+    AddPins(int *pIDArray, int nNumIDs, bool bPorcOrder=false) - Adds
+      nNumIDs pins to the object at once, in order from the next
+      unused bit.  Exports and opens them as a batch (para_initgpios),
+      which is the quickest way to set up a large group.  The
+      constructors use this, and Close() releases the pins as a batch.
+
     AddPin(int nID, bool bPorcOrder=false) - Adds a new pin to the object,
       for multi-pin objects this will become the new most-significant bit.
-      Returns para_ok on success or else an integer error code.
+      Returns para_ok on success or else an integer error code.  With
+      the para_bkcdev backend the whole group is re-requested, so set
+      the direction after all pins have been added.
 
     IsOK() - Checks that all pin assignments were successful, returns
       true if no errors have occurred during pin assignment, including
@@ -134,6 +292,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
     GetNPins() - Returns the number of pins assigned.
 
+    GetID(int nPin) - Returns the GPIO number of pin nPin, or -1.
+
+    GetIOCalls() - Returns the number of backend accesses (sysfs file
+      reads / writes, cdev ioctls or register accesses) made for pin
+      values since the object was created.  Writes skipped because the
+      pins didn't change aren't counted.
+
+    GetBackend() - Returns the backend in use, para_bksysfs, para_bkcdev
+      or para_bkmmio.
+
     SetDirection(para_gpiodir eDir) - Sets the direction for all pins of the object
       based on the enum eDir:
         para_dirin - input
@@ -142,20 +310,43 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	  (will either float or pull to 0)
         para_dirwor - wired-or (will either pull to 1 or float)
 
-    GetDirection(para_gpiodir *pDir) - Gets the current direction setting as above.
+    SetDirection(unsigned long long nMask, para_gpiodir eDir) - Same as
+      above but only for the pins selected by nMask.
+
+    GetDirection(para_gpiodir *pDir, bool bResync=false) - Gets the
+      current direction setting as above, or para_dirunk if the pins
+      are not all the same.  Comes from the cached setting, with
+      bResync true (sysfs only) the kernel's setting is read back.
 
     SetValue(unsigned long long nValue) - Sets the values of all pins.
       The effect of this function depends on the current Direction setting.
 
+    SetMasked(unsigned long long nMask, unsigned long long nValue) - Sets
+      the values of only the pins selected by nMask.  The object keeps a
+      shadow of the last value driven on each pin, and only pins whose
+      value actually changes are passed to the backend, so SetValue and
+      SetMasked cost nothing for pins that stay the same.  The shadow is
+      discarded for pins whose direction is changed.
+
+    SetPin(int nPin, int nValue) - Same as SetMasked for the single pin
+      nPin (0 = first pin of the object).
+
     GetValue(unsigned long long *pValue) - OR
     GetValue(unsigned *pValue) - Gets the current levels of all
       pins.  This function always reads the pin levels, it doesn't just
       return the values most recently Set, regardless of direction.
 
+    GetMasked(unsigned long long nMask, unsigned long long *pValue) -
+      Same as GetValue but only reads the pins selected by nMask, the
+      other bits of *pValue are returned as 0.
+
+    GetPin(int nPin, int *pValue) - Reads the single pin nPin.
+
     WaitLevel(int nPin, int nValue, int nTimeout) - Waits for the given
       value to be present on the input, meaning it will return immediately
       if the input is already at the requested value.  Times out after
-      nTimeout seconds if request not satisfied.
+      nTimeout seconds if request not satisfied (negative = forever).
+      Sleeps in the kernel while waiting, see para_waitgpio.
 
     WaitEdge(int nPin, int nValue, int nTimeout) - Waits for a rising 
       (nValue = 1) or falling (nValue = 0) edge on the input.  Requires
@@ -163,6 +354,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
       must toggle before this function will return.  Times out after
       nTimeout seconds if no edge.
 
+    WaitEdges(unsigned long long nMask, int nValue, int nTimeoutMS,
+        unsigned long long *pFired=NULL) - Waits for an edge as above
+      (nValue = 2 for either edge) on any of the pins selected by nMask,
+      with the timeout in milliseconds.  *pFired returns which pins saw
+      an edge.  The Wait functions are not available with para_bkmmio,
+      which has no interrupt path, and return para_noaccess.
+
+    ReadEdges(unsigned long long nMask, para_edge *pEdges, int nMax,
+        int nTimeoutMS, int *pCount) - Collects timestamped edges on the
+      pins in nMask for continuous capture, see para_readlines.  nPin in
+      each record is the bit number within the object.  See para_edgecap.h
+      for a background capture thread built on this.
+
+    GetLostEdges() - Returns the number of edge events the kernel had to
+      drop because ReadEdges wasn't called often enough (cdev only).
+
     Blink(unsigned long long nMask, int nMSOn, int nMSOff) -
       "Blinks" the gpio pin(s) defined in nMask by turning them on for
       nMSOn milliseconds then then off for nMSOff before returning.
@@ -176,8 +383,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     There has been no attempt to make this thread-safe or to deal intelligently 
       with two or more objects that refer to the same pins.  
 
-    No support yet for edge detection.  Next "to-do."
-
     Before things like the direction or value are set, they may be anything.  No
       defaults are imposed when the gpio pins are opened.
 
@@ -187,6 +392,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PARA_GPIO_H
 
 #include <stdbool.h>
+#include <stdlib.h>  // for NULL
 
 // Available directions
 typedef enum e_para_gpiodir {
@@ -204,8 +410,18 @@ typedef struct st_para_gpio {
   int fdDir;
   bool bIsNew;
   para_gpiodir eDir;
+  int nEdge;  // last edge selected, -1 = none
+  int nVal;   // last value written, -1 = unknown
+  int nHwDir; // kernel direction, 0 = in, 1 = out, -1 = unknown
 } para_gpio;
 
+// Edge record for the capture functions
+typedef struct st_para_edge {
+  unsigned long long nTimeNS;  // CLOCK_MONOTONIC
+  int nPin;                    // bit number within the group
+  int nValue;                  // level after the edge
+} para_edge;
+
 // Function return values
 enum e_para_gpiores {
   para_ok = 0,
@@ -227,6 +443,57 @@ enum e_para_gpiores {
 #define EXTGPIONUM        64
 #define LASTGPIOID        (EXTGPIOSTART + EXTGPIONUM - 1)
 
+// Available pin-access methods for the class
+typedef enum e_para_gpiobackend {
+  para_bksysfs,  // /sys/class/gpio, one file per pin
+  para_bkcdev,   // /dev/gpiochipN, one line request per group
+  para_bkmmio    // Zynq GPIO registers mapped from /dev/mem
+} para_gpiobackend;
+
+// Line-group structure for the character-device functions
+typedef struct st_para_lines {
+  int nLines;
+  int fdReq;
+  int nIDs[MAXPINSPEROBJECT];
+  unsigned nOffsets[MAXPINSPEROBJECT];
+  para_gpiodir eDir[MAXPINSPEROBJECT];
+  unsigned long long nOutMask;  // lines that may be driven
+  unsigned long long nValue;    // last value driven
+  unsigned long long nEdgeMask; // lines with edge detection on
+  int nEdge;                    // 0 falling, 1 rising, 2 both
+  unsigned nSeqNo;              // last event sequence number
+  unsigned long long nLost;     // events dropped by the kernel
+} para_lines;
+
+// Zynq-7000 PS GPIO controller, see UG585 appendix B.19
+#define ZYNQGPIOBASE      0xE000A000
+#define ZYNQGPIOSIZE      0x1000
+#define ZYNQGPIONBANKS    4
+
+// Register-group structure for the memory-mapped functions
+typedef struct st_para_mmio {
+  int nLines;
+  int fdMem;
+  volatile unsigned *pRegs;
+  int nIDs[MAXPINSPEROBJECT];
+  unsigned char nBank[MAXPINSPEROBJECT];
+  unsigned char nBit[MAXPINSPEROBJECT];
+  para_gpiodir eDir[MAXPINSPEROBJECT];
+  unsigned nBanks;              // bit b set if bank b is used
+  unsigned long long nOutMask;  // para_dirout lines
+  unsigned long long nWandMask;
+  unsigned long long nWorMask;
+} para_mmio;
+
+// One line's registers, see para_pinmmio
+typedef struct st_para_mmiobit {
+  volatile unsigned *pMaskData; // MASK_DATA word for the line's half-bank
+  unsigned nLow;                // stored there, drives the line to 0
+  unsigned nHigh;               // stored there, drives the line to 1
+  volatile unsigned *pDataRO;   // DATA_RO for the line's bank
+  unsigned nBit;                // the line's bit in DATA_RO
+} para_mmiobit;
+
 #ifdef __cplusplus
 extern "C" {
 #endif  // __cplusplus
@@ -235,10 +502,50 @@ extern "C" {
   int         para_initgpio_ex(para_gpio **ppGpio, int nID, bool bMayExist);
   void        para_closegpio(para_gpio *pGpio);
   void        para_closegpio_ex(para_gpio *pGpio, bool bForceUnexport);
+  int         para_initgpios(para_gpio **ppGpio, int *pIDArray, int nNumIDs,
+                             bool bMayExist);
+  void        para_closegpios(para_gpio **ppGpio, int nNumIDs, bool bForceUnexport);
   int         para_setgpio(para_gpio *pGpio, int nValue);
   int         para_dirgpio(para_gpio *pGpio, para_gpiodir eDir);
+  int         para_getdirgpio(para_gpio *pGpio, para_gpiodir *pDir, bool bResync);
   int         para_getgpio(para_gpio *pGpio, int *pValue);
   int         para_blinkgpio(para_gpio *pGpio, int nMSOn, int nMSOff);
+  int         para_waitgpio(para_gpio *pGpio, int nValue, int nTimeoutMS);
+  int         para_edgegpio(para_gpio *pGpio, int nValue, int nTimeoutMS);
+  int         para_edgegpio_ex(para_gpio **ppGpio, int nNum, int nValue,
+                               int nTimeoutMS, unsigned long long *pFired);
+  int         para_readgpio_ex(para_gpio **ppGpio, int nNum, para_edge *pEdges,
+                               int nMax, int nTimeoutMS, int *pCount);
+
+  int         para_initlines(para_lines **ppLines, int *pIDArray, int nNumIDs);
+  void        para_closelines(para_lines *pLines);
+  int         para_setlines(para_lines *pLines, unsigned long long nMask,
+                            unsigned long long nValue);
+  int         para_dirlines(para_lines *pLines, unsigned long long nMask,
+                            para_gpiodir eDir);
+  int         para_getlines(para_lines *pLines, unsigned long long nMask,
+                            unsigned long long *pValue);
+  int         para_waitlines(para_lines *pLines, unsigned long long nMask,
+                             int nValue, int nTimeoutMS,
+                             unsigned long long *pFired);
+  int         para_edgelines(para_lines *pLines, unsigned long long nMask,
+                             int nValue, int nTimeoutMS,
+                             unsigned long long *pFired);
+  int         para_readlines(para_lines *pLines, unsigned long long nMask,
+                             para_edge *pEdges, int nMax, int nTimeoutMS,
+                             int *pCount);
+
+  int         para_initmmio(para_mmio **ppMmio, int *pIDArray, int nNumIDs);
+  int         para_initmmio_ex(para_mmio **ppMmio, int *pIDArray, int nNumIDs,
+                               const char *strDev, long nOffset);
+  void        para_closemmio(para_mmio *pMmio);
+  int         para_setmmio(para_mmio *pMmio, unsigned long long nMask,
+                           unsigned long long nValue);
+  int         para_dirmmio(para_mmio *pMmio, unsigned long long nMask,
+                           para_gpiodir eDir);
+  int         para_getmmio(para_mmio *pMmio, unsigned long long nMask,
+                           unsigned long long *pValue);
+  int         para_pinmmio(para_mmio *pMmio, int nLine, para_mmiobit *pPin);
   
 #ifdef __cplusplus
 }  // extern "C"
@@ -248,22 +555,56 @@ class CParaGpio {
   int  nPins;
   para_gpio *pGpio[MAXPINSPEROBJECT];
   bool bIsOK;
+  para_gpiobackend eBackend;
+  para_lines *pLines;
+  para_mmio  *pMmio;
+  int  nIDs[MAXPINSPEROBJECT];
+  para_gpiodir eDirs[MAXPINSPEROBJECT];
+  unsigned long long nShadow;  // last value driven
+  unsigned long long nKnown;   // pins for which nShadow is valid
+  unsigned long long nIOCalls; // backend reads & writes, see GetIOCalls()
+
+  unsigned long long PinMask() {
+    return nPins >= 64 ? ~0ULL : (1ULL << nPins) - 1;
+  }
+  int OpenGroup();
+  int OpenPins(int nFirst);
+  int DropPins(int nFirst);
 
  public:
   CParaGpio();
-  CParaGpio(int nStartID, int nNumIDs=1, bool bPorcOrder=false);
-  CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder=false);
+  CParaGpio(int nStartID, int nNumIDs=1, bool bPorcOrder=false,
+            para_gpiobackend eBackend=para_bksysfs);
+  CParaGpio(int *pIDArray, int nNumIDs, bool bPorcOrder=false,
+            para_gpiobackend eBackend=para_bksysfs);
   ~CParaGpio();
+  int SetBackend(para_gpiobackend eBackend);
+  para_gpiobackend GetBackend() { return eBackend; }
   int AddPin(int nID, bool bPorcOrder=false);
+  int AddPins(int *pIDArray, int nNumIDs, bool bPorcOrder=false);
   bool IsOK() { return bIsOK; }
   int GetNPins() { return nPins; }
+  int GetID(int nPin) { return (nPin >= 0 && nPin < nPins) ? nIDs[nPin] : -1; }
+  unsigned long long GetIOCalls() { return nIOCalls; }
   int SetDirection(para_gpiodir eDir);
-  int GetDirection(para_gpiodir *pDir);
+  int SetDirection(unsigned long long nMask, para_gpiodir eDir);
+  int GetDirection(para_gpiodir *pDir, bool bResync=false);
   int SetValue(unsigned long long nValue);
+  int SetMasked(unsigned long long nMask, unsigned long long nValue);
+  int SetPin(int nPin, int nValue);
   int GetValue(unsigned long long *pValue);
   int GetValue(unsigned *pValue);
+  int GetMasked(unsigned long long nMask, unsigned long long *pValue);
+  int GetPin(int nPin, int *pValue);
   int WaitLevel(int nPin, int nValue, int nTimeout);
   int WaitEdge(int nPin, int nValue, int nTimeout);
+  int WaitEdges(unsigned long long nMask, int nValue, int nTimeoutMS,
+                unsigned long long *pFired=NULL);
+  int ReadEdges(unsigned long long nMask, para_edge *pEdges, int nMax,
+                int nTimeoutMS, int *pCount);
+  unsigned long long GetLostEdges() {
+    return pLines ? __atomic_load_n(&pLines->nLost, __ATOMIC_RELAXED) : 0;
+  }
   int Blink(unsigned long long nMask, int nMSOn, int nMSOff);
   void Close();
 };
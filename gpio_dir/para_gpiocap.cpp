@@ -0,0 +1,502 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_gpiocap.cpp
+  See the header file para_gpiocap.h for description & usage info.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include "para_gpiocap.h"
+
+#define CAPDEPTH      65536  // default ring size in samples
+#define CAPBATCH      64     // edges fetched at once
+#define CAPTIMEOUT    100    // msec, how often the edge thread checks for Stop()
+#define CAPPOLLNS     1000000  // nsec between checks in Wait()
+
+static unsigned long long CapNow() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+CParaGpioCap::CParaGpioCap() {
+
+  m_pGpio = NULL;
+  m_nMask = 0;
+  m_nTrigMask = m_nTrigValue = 0;
+  m_nPre = m_nPost = 0;
+  m_pHdr = NULL;
+  m_pRing = NULL;
+  m_nMapSize = 0;
+  m_fd = -1;
+  m_nDropped = m_nMaxGap = 0;
+  m_nLostBase = 0;
+  m_nError = para_ok;
+  m_nStop = m_nDone = 0;
+  m_bRunning = false;
+}
+
+CParaGpioCap::CParaGpioCap(CParaGpio *pGpio, unsigned long long nMask) {
+
+  m_pGpio = pGpio;
+  m_nMask = nMask;
+  m_nTrigMask = m_nTrigValue = 0;
+  m_nPre = m_nPost = 0;
+  m_pHdr = NULL;
+  m_pRing = NULL;
+  m_nMapSize = 0;
+  m_fd = -1;
+  m_nDropped = m_nMaxGap = 0;
+  m_nLostBase = 0;
+  m_nError = para_ok;
+  m_nStop = m_nDone = 0;
+  m_bRunning = false;
+}
+
+CParaGpioCap::~CParaGpioCap() {
+
+  Stop();
+  Unmap();
+}
+
+int CParaGpioCap::Attach(CParaGpio *pGpio, unsigned long long nMask) {
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  m_pGpio = pGpio;
+  m_nMask = nMask;
+
+  return para_ok;
+}
+
+int CParaGpioCap::SetTrigger(unsigned long long nMask, unsigned long long nValue,
+                             int nPre, int nPost) {
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  if(nPre < 0 || nPost < 0)
+    return para_badarg;
+
+  m_nTrigMask = nMask;
+  m_nTrigValue = nValue & nMask;
+  m_nPre = nPre;
+  m_nPost = nPost;
+
+  return para_ok;
+}
+
+int CParaGpioCap::Start(long long nPeriodNS, const char *strFile/*=NULL*/,
+                        int nDepth/*=0*/) {
+  unsigned size;
+  int n;
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  if(m_pGpio == NULL)
+    return para_notopen;
+
+  if(nPeriodNS < PARA_CAPEDGES || nDepth < 0)
+    return para_badarg;
+
+  if(nPeriodNS == PARA_CAPEDGES && m_pGpio->GetBackend() == para_bkmmio)
+    return para_badarg;
+
+  size = nDepth ? nDepth : CAPDEPTH;
+  if(size < (unsigned)(m_nPre + m_nPost + 1))
+    size = m_nPre + m_nPost + 1;
+
+  Unmap();
+  m_nMapSize = sizeof(para_caphdr) + size * sizeof(para_sample);
+
+  if(strFile) {
+
+    m_fd = open(strFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(m_fd < 0) {
+      fprintf(stderr, "Unable to create the capture file %s\n", strFile);
+      return para_fileerr;
+    }
+
+    if(ftruncate(m_fd, m_nMapSize)) {
+      Unmap();
+      return para_fileerr;
+    }
+
+    m_pHdr = (para_caphdr *)mmap(NULL, m_nMapSize, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, m_fd, 0);
+  } else {
+
+    m_pHdr = (para_caphdr *)mmap(NULL, m_nMapSize, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if(m_pHdr == MAP_FAILED) {
+    m_pHdr = NULL;
+    Unmap();
+    return para_outofmemory;
+  }
+
+  // Touch every page now so the sampling thread never faults
+  memset(m_pHdr, 0, m_nMapSize);
+  m_pRing = (para_sample *)(m_pHdr + 1);
+
+  memcpy(m_pHdr->strMagic, PARA_CAPMAGIC, sizeof(m_pHdr->strMagic));
+  m_pHdr->nSize = size;
+  m_pHdr->nPins = m_pGpio->GetNPins();
+  m_pHdr->nMask = m_nMask;
+  m_pHdr->nPeriodNS = nPeriodNS;
+  m_pHdr->nHead = 0;
+  m_pHdr->nTrigger = -1;
+  for(n = 0; n < MAXPINSPEROBJECT; n++)
+    m_pHdr->nIDs[n] = m_pGpio->GetID(n);
+
+  m_nDropped = m_nMaxGap = 0;
+  m_nLostBase = m_pGpio->GetLostEdges();  // the object's total so far
+  m_nError = para_ok;
+  m_nStop = m_nDone = 0;
+
+  if(pthread_create(&m_thread, NULL, ThreadProc, this))
+    return para_outofmemory;
+
+  m_bRunning = true;
+
+  return para_ok;
+}
+
+int CParaGpioCap::Wait(int nTimeoutMS/*=-1*/) {
+  struct timespec ts;
+  unsigned long long tEnd;
+
+  if(!m_bRunning)
+    return para_ok;
+
+  tEnd = CapNow() + nTimeoutMS * 1000000ULL;
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = CAPPOLLNS;
+
+  while(!__atomic_load_n(&m_nDone, __ATOMIC_ACQUIRE)) {
+
+    if(nTimeoutMS >= 0 && CapNow() >= tEnd)
+      return para_timeout;
+
+    nanosleep(&ts, NULL);
+  }
+
+  pthread_join(m_thread, NULL);
+  m_bRunning = false;
+
+  return para_ok;
+}
+
+int CParaGpioCap::Stop() {
+
+  if(!m_bRunning)
+    return para_ok;
+
+  __atomic_store_n(&m_nStop, 1, __ATOMIC_RELEASE);
+  pthread_join(m_thread, NULL);
+  m_bRunning = false;
+
+  if(m_fd >= 0)
+    msync(m_pHdr, m_nMapSize, MS_ASYNC);
+
+  return para_ok;
+}
+
+bool CParaGpioCap::IsTriggered() {
+
+  return m_pHdr && __atomic_load_n(&m_pHdr->nTrigger, __ATOMIC_ACQUIRE) >= 0;
+}
+
+int CParaGpioCap::Read(para_sample *pSamples, int nMax, int *pCount) {
+  unsigned long long first, end;
+  int n;
+
+  if(pSamples == NULL || pCount == NULL || nMax < 0)
+    return para_badarg;
+
+  *pCount = 0;
+
+  if(m_pHdr == NULL)
+    return para_notopen;
+
+  Window(&first, &end);
+
+  for(n = 0; n < nMax && first < end; n++, first++)
+    pSamples[n] = m_pRing[first % m_pHdr->nSize];
+
+  *pCount = n;
+
+  return para_ok;
+}
+
+int CParaGpioCap::WriteVCD(const char *strFile, const char **pNames/*=NULL*/) {
+  unsigned long long first, end, t0, last, tOut, mask;
+  bool bFirst;
+  FILE *pFile;
+  para_sample *p;
+  long long trig;
+  int n, nPins;
+  char strID[MAXPINSPEROBJECT];
+
+  if(strFile == NULL)
+    return para_badarg;
+
+  if(m_pHdr == NULL)
+    return para_notopen;
+
+  pFile = fopen(strFile, "w");
+  if(pFile == NULL) {
+    fprintf(stderr, "Unable to create the VCD file %s\n", strFile);
+    return para_fileerr;
+  }
+
+  Window(&first, &end);
+  nPins = m_pHdr->nPins;
+  mask = m_pHdr->nMask;
+  trig = __atomic_load_n(&m_pHdr->nTrigger, __ATOMIC_ACQUIRE);
+  t0 = first < end ? m_pRing[first % m_pHdr->nSize].nTimeNS : 0;
+
+  fprintf(pFile, "$comment Parallella gpiocap, %llu samples", end - first);
+  if(trig >= (long long)first && trig < (long long)end)
+    fprintf(pFile, ", trigger at %llu ns",
+            m_pRing[trig % m_pHdr->nSize].nTimeNS - t0);
+  fprintf(pFile, " $end\n$timescale 1ns $end\n$scope module gpio $end\n");
+
+  for(n = 0; n < nPins; n++) {
+    strID[n] = '!' + n;   // one printable character per signal
+    if(!(mask & (1ULL << n)))
+      continue;
+    if(pNames && pNames[n])
+      fprintf(pFile, "$var wire 1 %c %s $end\n", strID[n], pNames[n]);
+    else
+      fprintf(pFile, "$var wire 1 %c gpio%d $end\n", strID[n], m_pHdr->nIDs[n]);
+  }
+
+  fprintf(pFile, "$upscope $end\n$enddefinitions $end\n");
+
+  for(last = 0, tOut = 0, bFirst = true; first < end; first++) {
+
+    p = m_pRing + first % m_pHdr->nSize;
+
+    if(!bFirst && !((p->nValue ^ last) & mask))
+      continue;
+
+    tOut = p->nTimeNS - t0;
+    fprintf(pFile, "#%llu\n", tOut);
+
+    for(n = 0; n < nPins; n++)
+      if((mask & (1ULL << n)) && (bFirst || ((p->nValue ^ last) & (1ULL << n))))
+        fprintf(pFile, "%d%c\n", (int)((p->nValue >> n) & 1), strID[n]);
+
+    last = p->nValue;
+    bFirst = false;
+  }
+
+  // Mark the end of the capture so viewers show its full length
+  if(!bFirst && m_pRing[(end - 1) % m_pHdr->nSize].nTimeNS - t0 != tOut)
+    fprintf(pFile, "#%llu\n", m_pRing[(end - 1) % m_pHdr->nSize].nTimeNS - t0);
+
+  fclose(pFile);
+
+  return para_ok;
+}
+
+int CParaGpioCap::GetStats(unsigned long long *pSamples,
+                           unsigned long long *pDropped,
+                           unsigned long long *pMaxGapNS) {
+
+  if(pSamples)
+    *pSamples = m_pHdr ? __atomic_load_n(&m_pHdr->nHead, __ATOMIC_RELAXED) : 0;
+  if(pDropped)
+    *pDropped = __atomic_load_n(&m_nDropped, __ATOMIC_RELAXED);
+  if(pMaxGapNS)
+    *pMaxGapNS = __atomic_load_n(&m_nMaxGap, __ATOMIC_RELAXED);
+
+  return para_ok;
+}
+
+// Internal functions
+void *CParaGpioCap::ThreadProc(void *pArg) {
+
+  ((CParaGpioCap *)pArg)->Run();
+
+  return NULL;
+}
+
+void CParaGpioCap::Unmap() {
+
+  if(m_pHdr)
+    munmap(m_pHdr, m_nMapSize);
+  if(m_fd >= 0)
+    close(m_fd);
+
+  m_pHdr = NULL;
+  m_pRing = NULL;
+  m_fd = -1;
+}
+
+// Sample numbers [*pFirst, *pEnd) of the capture window
+void CParaGpioCap::Window(unsigned long long *pFirst, unsigned long long *pEnd) {
+  unsigned long long head;
+  long long trig;
+
+  head = __atomic_load_n(&m_pHdr->nHead, __ATOMIC_ACQUIRE);
+  trig = __atomic_load_n(&m_pHdr->nTrigger, __ATOMIC_ACQUIRE);
+
+  *pEnd = head;
+  *pFirst = head > m_pHdr->nSize ? head - m_pHdr->nSize : 0;
+
+  if(trig >= 0 && m_nPost && trig - m_nPre > (long long)*pFirst)
+    *pFirst = trig - m_nPre;
+}
+
+// Store one sample, returns true when the post-trigger window is full
+bool CParaGpioCap::Store(unsigned long long nTimeNS, unsigned long long nValue) {
+  unsigned long long head = m_pHdr->nHead;
+  para_sample *p;
+
+  if(head) {
+    p = m_pRing + (head - 1) % m_pHdr->nSize;
+    if(nTimeNS - p->nTimeNS > m_nMaxGap)
+      __atomic_store_n(&m_nMaxGap, nTimeNS - p->nTimeNS, __ATOMIC_RELAXED);
+  }
+
+  p = m_pRing + head % m_pHdr->nSize;
+  p->nTimeNS = nTimeNS;
+  p->nValue = nValue;
+
+  if(m_pHdr->nTrigger < 0 && (nValue & m_nTrigMask) == m_nTrigValue)
+    __atomic_store_n(&m_pHdr->nTrigger, (long long)head, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&m_pHdr->nHead, head + 1, __ATOMIC_RELEASE);
+
+  return m_nPost && m_pHdr->nTrigger >= 0 &&
+    head - m_pHdr->nTrigger >= (unsigned long long)m_nPost;
+}
+
+void CParaGpioCap::Run() {
+  struct timespec ts;
+  unsigned long long tNext, now, value, missed;
+  long long period = m_pHdr->nPeriodNS;
+  para_edge edges[CAPBATCH];
+  int n, count, res;
+
+  if(period == PARA_CAPEDGES) {
+
+    // Arm edge detection first (which flushes older events), then
+    // start from the current levels and apply each edge in order.  An
+    // edge between the two is already in the levels, and applying it
+    // again does no harm.
+    res = m_pGpio->ReadEdges(m_nMask, edges, CAPBATCH, 0, &count);
+    if(res != para_ok && res != para_timeout)
+      goto fail;
+
+    res = m_pGpio->GetMasked(m_nMask, &value);
+    if(res != para_ok)
+      goto fail;
+
+    if(Store(CapNow(), value))
+      goto done;
+
+    while(!__atomic_load_n(&m_nStop, __ATOMIC_ACQUIRE)) {
+
+      res = m_pGpio->ReadEdges(m_nMask, edges, CAPBATCH, CAPTIMEOUT, &count);
+      if(res == para_timeout)
+	continue;
+      if(res != para_ok)
+	goto fail;
+
+      for(n = 0; n < count; n++) {
+	value = (value & ~(1ULL << edges[n].nPin)) |
+	  ((unsigned long long)edges[n].nValue << edges[n].nPin);
+	if(Store(edges[n].nTimeNS, value))
+	  goto done;
+      }
+
+      __atomic_store_n(&m_nDropped, m_pGpio->GetLostEdges() - m_nLostBase,
+		       __ATOMIC_RELAXED);
+    }
+
+    goto done;
+  }
+
+  prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+  tNext = CapNow();
+
+  while(!__atomic_load_n(&m_nStop, __ATOMIC_RELAXED)) {
+
+    if(period > 0) {
+
+      ts.tv_sec = tNext / 1000000000ULL;
+      ts.tv_nsec = tNext % 1000000000ULL;
+      while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	;
+
+      // Whole periods that have gone by are samples we could not take
+      now = CapNow();
+      missed = (now - tNext) / period;
+      if(missed) {
+	__atomic_fetch_add(&m_nDropped, missed, __ATOMIC_RELAXED);
+	tNext += missed * period;
+      }
+      tNext += period;
+    }
+
+    res = m_pGpio->GetMasked(m_nMask, &value);
+    if(res != para_ok)
+      goto fail;
+
+    if(Store(CapNow(), value))
+      break;
+  }
+
+ done:
+  __atomic_store_n(&m_nDone, 1, __ATOMIC_RELEASE);
+  return;
+
+ fail:
+  __atomic_store_n(&m_nError, res, __ATOMIC_RELEASE);
+  __atomic_store_n(&m_nDone, 1, __ATOMIC_RELEASE);
+}
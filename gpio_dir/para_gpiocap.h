@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_gpiocap.h
+
+  Header file for the para_gpiocap library, a software logic analyzer
+  for a group of CParaGpio pins.  A background thread samples the pins
+  either at a fixed rate, as fast as the backend allows, or on every
+  edge, into a ring of timestamped samples.  The ring may live in a
+  memory-mapped file so the capture survives the program and can be
+  inspected by another process while running.  A trigger on a pin /
+  level condition stops the capture after a post-trigger window while
+  keeping a pre-trigger window, and the result can be written as a
+  Value Change Dump (VCD) for viewing in e.g. GTKWave.
+
+  Member functions:
+
+    Except for the constructors, all functions return 0 (success) or an
+      error code from para_gpio.h.
+
+    CParaGpioCap() - Constructs an object not yet attached to any pins.
+
+    CParaGpioCap(CParaGpio *pGpio, unsigned long long nMask) - Constructs
+      an object capturing the pins of pGpio selected by nMask.  The pins
+      should be set as inputs before Start().
+
+    Attach(CParaGpio *pGpio, unsigned long long nMask) - Same as the
+      constructor, for an object created empty.  Not allowed while
+      running.
+
+    SetTrigger(unsigned long long nMask, unsigned long long nValue,
+        int nPre, int nPost) - Triggers when the pins in nMask match
+      nValue, keeping at least the nPre samples before the trigger and
+      stopping nPost samples after it.  With nMask 0 the first sample
+      triggers.  With nPost 0 (the default) the capture runs until
+      Stop() and the ring holds the most recent samples.
+
+    Start(long long nPeriodNS, const char *strFile=NULL, int nDepth=0) -
+      Starts capturing.  nPeriodNS > 0 samples at that fixed rate,
+      0 samples back-to-back as fast as possible, PARA_CAPEDGES records
+      a sample on every edge (not with para_bkmmio).  strFile names the
+      ring file to create, NULL keeps the ring in memory.  nDepth is the
+      ring size in samples, at least nPre+nPost+1, default 65536.
+
+    Wait(int nTimeoutMS=-1) - Waits for the capture to finish after a
+      trigger, up to nTimeoutMS msec (-1 = forever), returning
+      para_timeout if still running.
+
+    Stop() - Stops capturing and waits for the thread to exit.  The
+      samples stay available until the next Start().
+
+    IsTriggered() - Returns true once the trigger condition was seen.
+
+    Read(para_sample *pSamples, int nMax, int *pCount) - Copies up to
+      nMax samples of the capture window, oldest first, into pSamples.
+
+    WriteVCD(const char *strFile, const char **pNames=NULL) - Writes
+      the capture window as a VCD file.  pNames optionally gives a name
+      for each pin of the CParaGpio object, default "gpioNN" by ID.
+
+    GetStats(unsigned long long *pSamples, unsigned long long *pDropped,
+        unsigned long long *pMaxGapNS) - Returns the number of samples
+      taken, the number of sample periods missed (fixed rate) or edges
+      lost by the kernel (edges), and the longest time between two
+      samples.  Any pointer may be NULL.
+
+    GetError() - Returns the error that stopped the capture, or para_ok.
+
+  Ring file format:
+
+    A para_caphdr header followed by nSize para_sample records.  Sample
+      number i (counting from the start) is in slot i % nSize, nHead is
+      the number of samples written and nTrigger is the sample number of
+      the trigger, or -1.
+
+*/
+
+#ifndef PARA_GPIOCAP_H
+#define PARA_GPIOCAP_H
+
+#include <pthread.h>
+#include "para_gpio.h"
+
+#define PARA_CAPEDGES  -1LL      // nPeriodNS for Start() to sample on edges
+#define PARA_CAPMAGIC  "PGPIOCAP"
+
+typedef struct {
+  unsigned long long nTimeNS;   // CLOCK_MONOTONIC
+  unsigned long long nValue;    // pin levels, bit n = pin n of the object
+} para_sample;
+
+typedef struct {
+  char strMagic[8];
+  unsigned nSize;               // ring slots
+  unsigned nPins;
+  unsigned long long nMask;
+  long long nPeriodNS;
+  unsigned long long nHead;
+  long long nTrigger;
+  int  nIDs[MAXPINSPEROBJECT];
+} para_caphdr;
+
+class CParaGpioCap {
+ protected:
+  CParaGpio *m_pGpio;
+  unsigned long long m_nMask;
+  unsigned long long m_nTrigMask;
+  unsigned long long m_nTrigValue;
+  int  m_nPre;
+  int  m_nPost;
+  para_caphdr *m_pHdr;
+  para_sample *m_pRing;
+  size_t m_nMapSize;
+  int  m_fd;
+  unsigned long long m_nDropped;
+  unsigned long long m_nLostBase;  // GetLostEdges() when started
+  unsigned long long m_nMaxGap;
+  int  m_nError;
+  int  m_nStop;
+  int  m_nDone;
+  bool m_bRunning;
+  pthread_t m_thread;
+
+  static void *ThreadProc(void *pArg);
+  void Run();
+  bool Store(unsigned long long nTimeNS, unsigned long long nValue);
+  void Unmap();
+  void Window(unsigned long long *pFirst, unsigned long long *pEnd);
+
+ public:
+  CParaGpioCap();
+  CParaGpioCap(CParaGpio *pGpio, unsigned long long nMask);
+  ~CParaGpioCap();
+  int Attach(CParaGpio *pGpio, unsigned long long nMask);
+  int SetTrigger(unsigned long long nMask, unsigned long long nValue,
+                 int nPre, int nPost);
+  int Start(long long nPeriodNS, const char *strFile=NULL, int nDepth=0);
+  int Wait(int nTimeoutMS=-1);
+  int Stop();
+  bool IsTriggered();
+  int Read(para_sample *pSamples, int nMax, int *pCount);
+  int WriteVCD(const char *strFile, const char **pNames=NULL);
+  int GetStats(unsigned long long *pSamples, unsigned long long *pDropped,
+               unsigned long long *pMaxGapNS);
+  int GetError() { return __atomic_load_n(&m_nError, __ATOMIC_ACQUIRE); }
+};
+
+#endif  // PARA_GPIOCAP_H
@@ -0,0 +1,335 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_pattern.cpp
+  See the header file para_pattern.h for description & usage info.
+
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include "para_pattern.h"
+
+#define PATLEADNS   1000000  // nsec from PlayPattern() to the first step
+#define PATPOLLNS   1000000  // nsec between checks in Wait()
+
+// mlockall() is per process, so only the last PARA_PATLOCK player
+// to finish unlocks
+static pthread_mutex_t patLockMutex = PTHREAD_MUTEX_INITIALIZER;
+static int patLockCount = 0;
+
+static int PatLock() {
+  int res = para_ok;
+
+  pthread_mutex_lock(&patLockMutex);
+  if(patLockCount == 0 && mlockall(MCL_CURRENT | MCL_FUTURE))
+    res = para_noaccess;
+  else
+    patLockCount++;
+  pthread_mutex_unlock(&patLockMutex);
+
+  return res;
+}
+
+static void PatUnlock() {
+
+  pthread_mutex_lock(&patLockMutex);
+  if(--patLockCount == 0)
+    munlockall();
+  pthread_mutex_unlock(&patLockMutex);
+}
+
+static unsigned long long PatNow() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+CParaPattern::CParaPattern() {
+
+  m_pGpio = NULL;
+  m_pSteps = NULL;
+  m_pLate = NULL;
+  m_nSteps = m_nRepeat = m_nFlags = 0;
+  m_nWorst = 0;
+  m_nPlayed = m_nOverruns = 0;
+  m_nError = para_ok;
+  m_nStop = m_nDone = 0;
+  m_bRunning = m_bLocked = false;
+}
+
+CParaPattern::CParaPattern(CParaGpio *pGpio) {
+
+  m_pGpio = pGpio;
+  m_pSteps = NULL;
+  m_pLate = NULL;
+  m_nSteps = m_nRepeat = m_nFlags = 0;
+  m_nWorst = 0;
+  m_nPlayed = m_nOverruns = 0;
+  m_nError = para_ok;
+  m_nStop = m_nDone = 0;
+  m_bRunning = m_bLocked = false;
+}
+
+CParaPattern::~CParaPattern() {
+
+  Stop();
+  free(m_pSteps);
+  free(m_pLate);
+}
+
+int CParaPattern::Attach(CParaGpio *pGpio) {
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  m_pGpio = pGpio;
+
+  return para_ok;
+}
+
+int CParaPattern::PlayPattern(const para_step *pSteps, int nSteps,
+                              int nRepeat/*=1*/, int nFlags/*=0*/) {
+  pthread_attr_t attr;
+  struct sched_param param;
+  int res;
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  if(m_pGpio == NULL)
+    return para_notopen;
+
+  if(pSteps == NULL || nSteps <= 0 || nRepeat < 0)
+    return para_badarg;
+
+  free(m_pSteps);
+  free(m_pLate);
+  m_pSteps = (para_step *)malloc(nSteps * sizeof(para_step));
+  m_pLate = (long long *)calloc(nSteps, sizeof(long long));
+  if(m_pSteps == NULL || m_pLate == NULL) {
+    free(m_pSteps);
+    free(m_pLate);
+    m_pSteps = NULL;
+    m_pLate = NULL;
+    m_nSteps = 0;
+    return para_outofmemory;
+  }
+
+  memcpy(m_pSteps, pSteps, nSteps * sizeof(para_step));
+  m_nSteps = nSteps;
+  m_nRepeat = nRepeat;
+  m_nFlags = nFlags;
+  m_nWorst = 0;
+  m_nPlayed = m_nOverruns = 0;
+  m_nError = para_ok;
+  m_nStop = m_nDone = 0;
+
+  if(nFlags & PARA_PATLOCK) {
+    res = PatLock();
+    if(res)
+      return res;
+    m_bLocked = true;
+  }
+
+  pthread_attr_init(&attr);
+
+  if(nFlags & PARA_PATRT) {
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    pthread_attr_setschedparam(&attr, &param);
+  }
+
+  res = pthread_create(&m_thread, &attr, ThreadProc, this);
+  pthread_attr_destroy(&attr);
+
+  if(res) {
+    if(m_bLocked) {
+      PatUnlock();
+      m_bLocked = false;
+    }
+    return res == EPERM ? para_noaccess : para_outofmemory;
+  }
+
+  m_bRunning = true;
+
+  return para_ok;
+}
+
+int CParaPattern::Wait(int nTimeoutMS/*=-1*/) {
+  struct timespec ts;
+  unsigned long long tEnd;
+
+  if(!m_bRunning)
+    return para_ok;
+
+  tEnd = PatNow() + nTimeoutMS * 1000000ULL;
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = PATPOLLNS;
+
+  while(!__atomic_load_n(&m_nDone, __ATOMIC_ACQUIRE)) {
+
+    if(nTimeoutMS >= 0 && PatNow() >= tEnd)
+      return para_timeout;
+
+    nanosleep(&ts, NULL);
+  }
+
+  Join();
+
+  return para_ok;
+}
+
+int CParaPattern::Stop() {
+
+  if(!m_bRunning)
+    return para_ok;
+
+  __atomic_store_n(&m_nStop, 1, __ATOMIC_RELEASE);
+  Join();
+
+  return para_ok;
+}
+
+bool CParaPattern::IsPlaying() {
+
+  return m_bRunning && !__atomic_load_n(&m_nDone, __ATOMIC_ACQUIRE);
+}
+
+int CParaPattern::GetLateness(long long *pWorstNS, long long *pStepNS/*=NULL*/,
+                              int nMax/*=0*/) {
+  int n;
+
+  if(pWorstNS == NULL || (pStepNS == NULL && nMax > 0))
+    return para_badarg;
+
+  *pWorstNS = __atomic_load_n(&m_nWorst, __ATOMIC_RELAXED);
+
+  for(n = 0; pStepNS && n < nMax; n++)
+    pStepNS[n] = n < m_nSteps ? __atomic_load_n(m_pLate + n, __ATOMIC_RELAXED) : 0;
+
+  return para_ok;
+}
+
+int CParaPattern::GetStats(unsigned long long *pSteps,
+                           unsigned long long *pOverruns) {
+
+  if(pSteps)
+    *pSteps = __atomic_load_n(&m_nPlayed, __ATOMIC_RELAXED);
+  if(pOverruns)
+    *pOverruns = __atomic_load_n(&m_nOverruns, __ATOMIC_RELAXED);
+
+  return para_ok;
+}
+
+// Internal functions
+void *CParaPattern::ThreadProc(void *pArg) {
+
+  ((CParaPattern *)pArg)->Run();
+
+  return NULL;
+}
+
+void CParaPattern::Join() {
+
+  pthread_join(m_thread, NULL);
+  m_bRunning = false;
+
+  if(m_bLocked) {
+    PatUnlock();
+    m_bLocked = false;
+  }
+}
+
+void CParaPattern::Run() {
+  struct timespec ts;
+  unsigned long long tStep, now;
+  long long late;
+  int n, rep, res;
+
+  // The default 50us timer slack would be added to every normal-priority step
+  prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+
+  tStep = PatNow() + PATLEADNS;
+
+  for(rep = 0; !m_nRepeat || rep < m_nRepeat; rep++) {
+    for(n = 0; n < m_nSteps; n++) {
+
+      if(__atomic_load_n(&m_nStop, __ATOMIC_RELAXED))
+	goto done;
+
+      ts.tv_sec = tStep / 1000000000ULL;
+      ts.tv_nsec = tStep % 1000000000ULL;
+
+      while((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+	;
+
+      now = PatNow();
+      late = (long long)(now - tStep);
+
+      if(late > m_pLate[n])
+	__atomic_store_n(m_pLate + n, late, __ATOMIC_RELAXED);
+      if(late > m_nWorst)
+	__atomic_store_n(&m_nWorst, late, __ATOMIC_RELAXED);
+      if(late >= (long long)m_pSteps[n].nDelayNS)
+	__atomic_fetch_add(&m_nOverruns, 1, __ATOMIC_RELAXED);
+
+      res = m_pGpio->SetMasked(m_pSteps[n].nMask, m_pSteps[n].nValue);
+      if(res != para_ok) {
+	__atomic_store_n(&m_nError, res, __ATOMIC_RELEASE);
+	goto done;
+      }
+
+      __atomic_fetch_add(&m_nPlayed, 1, __ATOMIC_RELAXED);
+
+      // Always relative to the schedule, never to when we woke up
+      tStep += m_pSteps[n].nDelayNS;
+    }
+  }
+
+  // Hold the last step for its delay too, so Wait() and a following
+  // PlayPattern() don't cut it short
+  ts.tv_sec = tStep / 1000000000ULL;
+  ts.tv_nsec = tStep % 1000000000ULL;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+
+ done:
+  __atomic_store_n(&m_nDone, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_pattern.h
+
+  Header file for the para_pattern library, which plays a precomputed
+  waveform on a group of CParaGpio pins from a background thread.  The
+  waveform is an array of steps, each step sets some pins (nMask) to a
+  value and then holds for nDelayNS nanoseconds.  The start time of
+  every step is computed from the start of the pattern and the thread
+  sleeps until it with clock_nanosleep(TIMER_ABSTIME), so unlike a chain
+  of usleep() calls (Blink(), para_blinkgpio()) the overhead of each step
+  never accumulates into drift.  The thread can optionally run at
+  real-time priority with memory locked, and records how late each step
+  actually started.
+
+  Member functions:
+
+    Except for the constructors, all functions return 0 (success) or an
+      error code from para_gpio.h.
+
+    CParaPattern() - Constructs an object not yet attached to any pins.
+
+    CParaPattern(CParaGpio *pGpio) - Constructs an object that will play
+      patterns on pGpio.  Set the pins' direction before playing.
+
+    Attach(CParaGpio *pGpio) - Same as the constructor, for an object
+      created empty.  Not allowed while playing.
+
+    PlayPattern(const para_step *pSteps, int nSteps, int nRepeat=1,
+        int nFlags=0) - Starts playing the nSteps steps of pSteps, nRepeat
+      times (0 = until Stop()), and returns immediately.  The steps are
+      copied so the caller's array may be re-used at once.  nFlags may
+      include:
+        PARA_PATRT   - Run the thread with SCHED_FIFO (needs root or
+                       CAP_SYS_NICE, returns para_noaccess otherwise)
+        PARA_PATLOCK - Lock all process memory (mlockall) while playing
+                       so no page fault lands in the middle of a step.
+                       When the last such pattern finishes, munlockall()
+                       unlocks the whole process, including memory the
+                       application locked itself.
+
+    Wait(int nTimeoutMS=-1) - Waits until the pattern has finished,
+      including the delay of its last step, up
+      to nTimeoutMS msec (-1 = forever), returning para_timeout if still
+      playing.  The result of the playback (e.g. a SetMasked error) is
+      available from GetError().
+
+    Stop() - Stops playing after the current step and waits for the
+      thread to exit.  Called automatically when the object is destroyed.
+
+    IsPlaying() - Returns true while the thread is playing.
+
+    GetLateness(long long *pWorstNS, long long *pStepNS=NULL, int nMax=0) -
+      Returns the worst-case lateness over all steps of the most recent
+      pattern in *pWorstNS, and if pStepNS is not NULL the worst
+      lateness of each step (over all repeats) in pStepNS[0..nMax-1].
+      Lateness is measured from the scheduled start of the step to the
+      moment the thread woke up to write it.
+
+    GetStats(unsigned long long *pSteps, unsigned long long *pOverruns) -
+      Returns the number of steps played and the number that started
+      after the following step was already due.  Either pointer may be NULL.
+
+    GetError() - Returns the error that stopped the thread, or para_ok.
+
+  Caveats:
+
+    The pins are written with CParaGpio::SetMasked, so the speed of the
+      backend limits the shortest useful step, para_bkmmio is best.  The
+      application must not use the CParaGpio object while it is playing.
+
+*/
+
+#ifndef PARA_PATTERN_H
+#define PARA_PATTERN_H
+
+#include <pthread.h>
+#include "para_gpio.h"
+
+typedef struct {
+  unsigned long long nMask;     // pins to set in this step
+  unsigned long long nValue;    // values for those pins
+  unsigned long long nDelayNS;  // time until the next step
+} para_step;
+
+enum e_para_patflags {
+  PARA_PATRT = 1,
+  PARA_PATLOCK = 2
+};
+
+class CParaPattern {
+ protected:
+  CParaGpio *m_pGpio;
+  para_step *m_pSteps;
+  long long *m_pLate;    // worst lateness per step
+  int  m_nSteps;
+  int  m_nRepeat;
+  int  m_nFlags;
+  long long m_nWorst;
+  unsigned long long m_nPlayed;
+  unsigned long long m_nOverruns;
+  int  m_nError;
+  int  m_nStop;
+  int  m_nDone;
+  bool m_bRunning;
+  bool m_bLocked;
+  pthread_t m_thread;
+
+  static void *ThreadProc(void *pArg);
+  void Run();
+  void Join();
+
+ public:
+  CParaPattern();
+  CParaPattern(CParaGpio *pGpio);
+  ~CParaPattern();
+  int Attach(CParaGpio *pGpio);
+  int PlayPattern(const para_step *pSteps, int nSteps, int nRepeat=1,
+                  int nFlags=0);
+  int Wait(int nTimeoutMS=-1);
+  int Stop();
+  bool IsPlaying();
+  int GetLateness(long long *pWorstNS, long long *pStepNS=NULL, int nMax=0);
+  int GetStats(unsigned long long *pSteps, unsigned long long *pOverruns);
+  int GetError() { return __atomic_load_n(&m_nError, __ATOMIC_ACQUIRE); }
+};
+
+#endif  // PARA_PATTERN_H
@@ -36,6 +36,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <sys/ioctl.h>
 #include "para_spi.h"
 
 #define SPINPINS   4
@@ -44,27 +52,78 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SPIMISOPIN 2
 #define SPIENBPIN  3
 
+#define SPIDEVHZ   1000000  // default spidev clock rate
+#define SPICALNS   50000    // nsec per sleep when calibrating SetClockRate
+#define SPICALN    16       // sleeps (and x4 pin reads) to calibrate
+
+static unsigned long long SpiNow() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 CParaSpi::CParaSpi() {
 
-  m_nCPOL = 0;
-  m_nCPHA = 0;
-  m_nEPOL = 0;
+  m_fdDev = -1;
+  m_nSpeedHz = 0;
+  m_nCEPin = SPIENBPIN;
+  m_nIO2Pin = m_nIO3Pin = -1;
+  m_nDataOut = 0;
+  m_nHalfNS = 0;
+  m_pTrace = NULL;
+  m_pRing = NULL;
+  m_nRing = m_nRingNext = 0;
+  m_strDump = NULL;
+  m_pTraceNext = NULL;
+  memset(&m_clk, 0, sizeof(m_clk));
+  ResetClockStats();
+  m_bLSBFirst = false;
+  m_bGeneric = false;
+  SetMode(0, 0, 0);  // No pins yet, just records the mode
 }
 
 CParaSpi::CParaSpi(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder/*=false*/,
 		   int nCPOL/*=0*/, int nCPHA/*=0*/, int nEPOL/*=0*/) {
 
+  m_fdDev = -1;
+  m_nSpeedHz = 0;
+  m_nCEPin = SPIENBPIN;
+  m_nIO2Pin = m_nIO3Pin = -1;
+  m_nDataOut = 0;
+  m_nHalfNS = 0;
+  m_pTrace = NULL;
+  m_pRing = NULL;
+  m_nRing = m_nRingNext = 0;
+  m_strDump = NULL;
+  m_pTraceNext = NULL;
+  memset(&m_clk, 0, sizeof(m_clk));
+  ResetClockStats();
+  m_bLSBFirst = false;
+  m_bGeneric = false;
+  m_nCPOL = m_nCPHA = m_nEPOL = 0;
   AssignPins(nClk, nMOSI, nMISO, nCE, bPorcuOrder);
   SetMode(nCPOL, nCPHA, nEPOL);
 }
 
 CParaSpi::~CParaSpi() {
 
+  if(m_strDump)
+    DumpTrace(m_strDump);
+  DisableTrace();
+  CloseDevice();
 }
 
 int CParaSpi::AssignPins(int nClk, int nMOSI, int nMISO, int nCE,
 			 bool bPorcuOrder/*=false*/) {
   int  res, ret=para_ok;
+  const char *strDev = getenv("PARA_SPIDEV");
+
+  if(strDev && *strDev) {
+    if(OpenDevice(strDev) == para_ok)
+      return para_ok;
+    fprintf(stderr, "Unable to use %s, using GPIO pins for SPI\n", strDev);
+  }
 
   res = AddPin(nClk, bPorcuOrder);
   if(res) ret = res;
@@ -81,32 +140,81 @@ int CParaSpi::AssignPins(int nClk, int nMOSI, int nMISO, int nCE,
   return ret;
 }
 
+int CParaSpi::AddQuadPins(int nIO2, int nIO3, bool bPorcuOrder/*=false*/) {
+  int res, ret=para_ok;
+
+  if(m_fdDev >= 0)
+    return para_ok;  // the device does its own wiring
+
+  if(!bIsOK || nPins < SPINPINS || m_nIO2Pin >= 0)
+    return para_notopen;
+
+  res = AddPin(nIO2, bPorcuOrder);
+  if(res) ret = res;
+  res = AddPin(nIO3, bPorcuOrder);
+  if(res) ret = res;
+  if(ret)
+    return ret;
+
+  m_nIO2Pin = nPins - 2;
+  m_nIO3Pin = nPins - 1;
+
+  // Adding pins resets all directions, set them up again
+  return SetMode(m_nCPOL, m_nCPHA, m_nEPOL);
+}
+
 int CParaSpi::SetMode(int nCPOL, int nCPHA, int nEPOL) {
-  int res, ret = para_ok;
+  int n, res, ret = para_ok;
 
   m_nCPOL = nCPOL ? 1 : 0;
   m_nCPHA = nCPHA ? 1 : 0;
   m_nEPOL = nEPOL ? 1 : 0;
 
-  if(!bIsOK || nPins != SPINPINS)
+  for(n = 0; n < 4; n++)
+    m_pKernels[n] = spiKernels[m_nCPOL][m_nCPHA][n];
+
+  // Pin values for each nibble of a wide segment, IO0..IO3 = bits 0..3
+  for(n = 0; n < 16; n++) {
+    m_nWideOut[n] = ((unsigned long long)(n & 1) << SPIMOSIPIN) |
+      ((unsigned long long)((n >> 1) & 1) << SPIMISOPIN);
+    if(m_nIO2Pin >= 0)
+      m_nWideOut[n] |= ((unsigned long long)((n >> 2) & 1) << m_nIO2Pin) |
+	((unsigned long long)((n >> 3) & 1) << m_nIO3Pin);
+  }
+
+  if(m_fdDev >= 0)
+    return DevConfig();
+
+  if(!bIsOK || nPins < SPINPINS)
     return para_notopen;
 
-  res = para_dirgpio(pGpio[SPIENBPIN], para_dirout);
+  res = SetDirection(1ULL << m_nCEPin, para_dirout);
   if(res) ret = res;
-  res = para_setgpio(pGpio[SPIENBPIN], 1-m_nEPOL);  // Inactive state
+  res = SetPin(m_nCEPin, 1-m_nEPOL);  // Inactive state
   if(res) ret = res;
 
-  res = para_dirgpio(pGpio[SPICLKPIN], para_dirout);
+  res = SetDirection(1 << SPICLKPIN, para_dirout);
   if(res) ret = res;
-  res = para_setgpio(pGpio[SPICLKPIN], m_nCPOL);  // Inactive state
+  res = SetPin(SPICLKPIN, m_nCPOL);  // Inactive state
   if(res) ret = res;
 
-  res = para_dirgpio(pGpio[SPIMOSIPIN], para_dirout);
+  res = SetDirection(1 << SPIMOSIPIN, para_dirout);
   if(res) ret = res;
 
-  res = para_dirgpio(pGpio[SPIMISOPIN], para_dirin);
+  res = SetDirection(1 << SPIMISOPIN, para_dirin);
   if(res) ret = res;
 
+  if(m_nIO2Pin >= 0) {
+
+    // IO2 / IO3 idle high, i.e. WP# and HOLD# inactive
+    res = SetDirection((1ULL << m_nIO2Pin) | (1ULL << m_nIO3Pin), para_dirout);
+    if(res) ret = res;
+    res = SetMasked((1ULL << m_nIO2Pin) | (1ULL << m_nIO3Pin), ~0ULL);
+    if(res) ret = res;
+  }
+
+  m_nDataOut = SingleOut();
+
   return ret;
 }
 
@@ -115,69 +223,1251 @@ int CParaSpi::Xfer(int nBits, unsigned nWVal, unsigned *pRVal/*=NULL*/) {
   return Xfer(nBits, &nWVal, pRVal);
 }
 
+int CParaSpi::OpenDevice(const char *strDev/*=NULL*/, unsigned nSpeedHz/*=0*/) {
+  const char *str;
+  int res;
+
+  if(strDev == NULL)
+    strDev = getenv("PARA_SPIDEV");
+  if(strDev == NULL || !*strDev)
+    return para_badarg;
+
+  if(!nSpeedHz) {
+    str = getenv("PARA_SPIHZ");
+    nSpeedHz = str ? strtoul(str, NULL, 0) : 0;
+    if(!nSpeedHz)
+      nSpeedHz = SPIDEVHZ;
+  }
+
+  CloseDevice();
+
+  m_fdDev = DevOpen(strDev);
+  if(m_fdDev < 0)
+    return para_noaccess;
+
+  m_nSpeedHz = nSpeedHz;
+
+  res = DevConfig();
+  if(res)
+    CloseDevice();
+
+  return res;
+}
+
+void CParaSpi::CloseDevice() {
+
+  if(m_fdDev >= 0)
+    close(m_fdDev);
+
+  m_fdDev = -1;
+}
+
+void CParaSpi::Close() {
+
+  CloseDevice();
+  m_nIO2Pin = m_nIO3Pin = -1;
+  CParaGpio::Close();
+}
+
 int CParaSpi::Xfer(int nBits, unsigned *pWVal, unsigned *pRVal/*=NULL*/) {
-  int n, clk, res, currentVal, lastVal;
-  int rval;
+#ifdef PARA_SPITRACE
+  unsigned long long t0, nCalls;
+  int res;
+
+  if(m_pTrace) {
+    t0 = SpiNow();
+    nCalls = nIOCalls;
+    res = XferBits(nBits, pWVal, pRVal);
+    TraceAdd(t0, nBits, nIOCalls - nCalls, res);
+    return res;
+  }
+#endif
+
+  return XferBits(nBits, pWVal, pRVal);
+}
+
+int CParaSpi::XferBits(int nBits, unsigned *pWVal, unsigned *pRVal) {
+  int res, ret;
+
+  if(m_fdDev >= 0)
+    return DevXfer(nBits, pWVal, pRVal);
 
   if(pWVal == NULL)
-    para_setgpio(pGpio[SPIMOSIPIN], 0);
+    SetPin(SPIMOSIPIN, 0);
 
   if(pRVal)
     *pRVal = 0;  // clear all bits to start
 
   // Enable = active
-  res = para_setgpio(pGpio[SPIENBPIN], m_nEPOL);
+  res = SetPin(m_nCEPin, m_nEPOL);
   if(res)
     return res;
 
-  clk = m_nCPOL;
+  if(m_nHalfNS)
+    PaceStart();
+
+  ret = Shift(nBits, pWVal, pRVal);
+
+  if(m_nHalfNS)
+    PaceEnd();
+
+  // Enable = inactive, even after an error
+  res = SetPin(m_nCEPin, 1-m_nEPOL);
+
+  return ret ? ret : res;
+}
+
+int CParaSpi::Transfer(const uint8_t *pTx, uint8_t *pRx, size_t nLen) {
+  para_spiseg seg;
+
+  seg.pTx = pTx;
+  seg.pRx = pRx;
+  seg.nLen = nLen;
+  seg.nWidth = 1;
+
+  return Transfer(&seg, 1);
+}
+
+int CParaSpi::Transfer(const para_spiseg *pSegs, int nSegs) {
+#ifdef PARA_SPITRACE
+  unsigned long long t0, nCalls, nBits = 0;
+  int n, res;
+
+  if(m_pTrace) {
+    for(n = 0; pSegs && n < nSegs; n++)
+      nBits += pSegs[n].nLen * 8;
+    t0 = SpiNow();
+    nCalls = nIOCalls;
+    res = TransferSegs(pSegs, nSegs);
+    TraceAdd(t0, nBits, nIOCalls - nCalls, res);
+    return res;
+  }
+#endif
+
+  return TransferSegs(pSegs, nSegs);
+}
+
+int CParaSpi::TransferBatch(para_spibatch *pXacts, int nXacts) {
+  int n, ret = para_ok;
+
+  if(pXacts == NULL || nXacts < 0)
+    return para_badarg;
+
+  if(m_fdDev >= 0 && !m_pTrace)
+    return DevBatch(pXacts, nXacts);
+
+  for(n = 0; n < nXacts; n++) {
+    pXacts[n].nResult = Transfer(pXacts[n].pSegs, pXacts[n].nSegs);
+    if(ret == para_ok)
+      ret = pXacts[n].nResult;
+  }
+
+  return ret;
+}
+
+int CParaSpi::CheckSegs(const para_spiseg *pSegs, int nSegs) {
+  int n;
+
+  if(pSegs == NULL || nSegs < 0)
+    return para_badarg;
+
+  for(n = 0; n < nSegs; n++) {
+
+    if(pSegs[n].nWidth > 1 && pSegs[n].pTx && pSegs[n].pRx)
+      return para_badarg;  // wide segments are one direction only
+    if(pSegs[n].nWidth == 4 && m_fdDev < 0 && m_nIO2Pin < 0)
+      return para_notopen;
+    if(pSegs[n].nWidth < 0 || pSegs[n].nWidth == 3 || pSegs[n].nWidth > 4)
+      return para_badarg;
+  }
+
+  return para_ok;
+}
+
+int CParaSpi::TransferSegs(const para_spiseg *pSegs, int nSegs) {
+  int n, res, ret;
+
+  res = CheckSegs(pSegs, nSegs);
+  if(res)
+    return res;
+
+  if(m_fdDev >= 0)
+    return DevTransfer(pSegs, nSegs);
+
+  // Enable = active
+  res = SetPin(m_nCEPin, m_nEPOL);
+  if(res)
+    return res;
+
+  if(m_nHalfNS)
+    PaceStart();
+
+  for(ret = para_ok, n = 0; n < nSegs && ret == para_ok; n++) {
+
+    if(pSegs[n].nWidth > 1)
+      ret = ShiftWide(pSegs[n].pTx, pSegs[n].pRx, pSegs[n].nLen, pSegs[n].nWidth);
+    else if((ret = SetDataDir(SingleOut())) == para_ok)
+      ret = ShiftBytes(pSegs[n].pTx, pSegs[n].pRx, pSegs[n].nLen);
+  }
+
+  // Back to single-bit lines and enable = inactive, even after an
+  // error, keeping the first error seen
+  res = SetDataDir(SingleOut());
+  if(ret == para_ok)
+    ret = res;
+
+  if(m_nHalfNS)
+    PaceEnd();
+
+  res = SetPin(m_nCEPin, 1-m_nEPOL);
+
+  return ret ? ret : res;
+}
+
+int CParaSpi::SetClockRate(unsigned nHz) {
+  struct timespec ts;
+  unsigned long long t0, t1, nOver = 0;
+  int n, v;
+
+  m_clk.nTargetHz = nHz;
+  ResetClockStats();
+
+  if(m_fdDev >= 0) {
+    m_nSpeedHz = nHz ? nHz : SPIDEVHZ;
+    return DevConfig();
+  }
+
+  m_nHalfNS = 0;
+  if(!nHz)
+    return para_ok;
+
+  if(!bIsOK || nPins < SPINPINS)
+    return para_notopen;
+
+  // Cost of one pin access, reads always go to the backend
+  t0 = SpiNow();
+  for(n = 0; n < 4 * SPICALN; n++)
+    GetPin(SPIMISOPIN, &v);
+  m_clk.nPinNS = (SpiNow() - t0) / (4 * SPICALN);
+
+  // Worst oversleep, waits longer than this can sleep before spinning
+  ts.tv_sec = 0;
+  ts.tv_nsec = SPICALNS;
+  for(n = 0; n < SPICALN; n++) {
+    t0 = SpiNow();
+    nanosleep(&ts, NULL);
+    t1 = SpiNow() - t0 - SPICALNS;
+    if(t1 > nOver && t1 < 1000000000ULL)
+      nOver = t1;
+  }
+  m_clk.nSleepNS = nOver;
+
+  m_nHalfNS = 500000000U / nHz;
+  if(!m_nHalfNS)
+    m_nHalfNS = 1;
+
+  return para_ok;
+}
+
+int CParaSpi::GetClockStats(para_spiclk *pStats) {
+
+  if(pStats == NULL)
+    return para_badarg;
+
+  *pStats = m_clk;
+  pStats->dAchievedHz = m_nPaceNS ? m_nPaceHalves * 5e8 / m_nPaceNS : 0;
+  pStats->dJitterNS = m_clk.nEdges ? sqrt(m_dLateSq / m_clk.nEdges) : 0;
+
+  return para_ok;
+}
+
+void CParaSpi::ResetClockStats() {
+
+  m_clk.nEdges = 0;
+  m_clk.nLateMaxNS = 0;
+  m_dLateSq = 0;
+  m_nPaceNS = m_nPaceHalves = 0;
+}
+
+int CParaSpi::EnableTrace(int nRing/*=64*/, const char *strDump/*=NULL*/) {
+#ifndef PARA_SPITRACE
+  return para_noaccess;
+#else
+  static bool bAtExit = false;
+
+  if(nRing < 0)
+    return para_badarg;
+
+  DisableTrace();
+
+  m_pTrace = (para_spitrace *)calloc(1, sizeof(para_spitrace));
+  if(nRing)
+    m_pRing = (para_spirec *)calloc(nRing, sizeof(para_spirec));
+  if(strDump)
+    m_strDump = strdup(strDump);
+
+  if(!m_pTrace || (nRing && !m_pRing) || (strDump && !m_strDump)) {
+    DisableTrace();
+    return para_outofmemory;
+  }
+
+  m_nRing = nRing;
+  m_nRingNext = 0;
+
+  if(m_strDump) {
+    pthread_mutex_lock(&spiTraceMutex);
+    if(!bAtExit && atexit(TraceExit) == 0)
+      bAtExit = true;
+    m_pTraceNext = spiTraced;
+    spiTraced = this;
+    pthread_mutex_unlock(&spiTraceMutex);
+  }
+
+  return para_ok;
+#endif
+}
+
+void CParaSpi::DisableTrace() {
+  CParaSpi **pp;
+
+  pthread_mutex_lock(&spiTraceMutex);
+  for(pp = &spiTraced; *pp; pp = &(*pp)->m_pTraceNext)
+    if(*pp == this) {
+      *pp = m_pTraceNext;
+      break;
+    }
+  pthread_mutex_unlock(&spiTraceMutex);
+
+  free(m_pTrace);
+  free(m_pRing);
+  free(m_strDump);
+  m_pTrace = NULL;
+  m_pRing = NULL;
+  m_strDump = NULL;
+  m_pTraceNext = NULL;
+  m_nRing = m_nRingNext = 0;
+}
+
+void CParaSpi::ResetTrace() {
+
+  if(m_pTrace)
+    memset(m_pTrace, 0, sizeof(para_spitrace));
+  m_nRingNext = 0;
+}
+
+int CParaSpi::GetTrace(para_spitrace *pTrace) {
+
+  if(pTrace == NULL)
+    return para_badarg;
+  if(m_pTrace == NULL)
+    return para_notopen;
+
+  *pTrace = *m_pTrace;
+
+  return para_ok;
+}
+
+int CParaSpi::GetTraceRecs(para_spirec *pRecs, int *pnRecs) {
+  unsigned long long nHave;
+  int n, nCopy;
+
+  if(pRecs == NULL || pnRecs == NULL || *pnRecs < 0)
+    return para_badarg;
+  if(m_pTrace == NULL)
+    return para_notopen;
+
+  nHave = m_pTrace->nXacts < (unsigned long long)m_nRing ? m_pTrace->nXacts : m_nRing;
+  nCopy = (unsigned long long)*pnRecs < nHave ? *pnRecs : (int)nHave;
+
+  for(n = 0; n < nCopy; n++)
+    pRecs[n] = m_pRing[(m_nRingNext - nCopy + n + m_nRing) % m_nRing];
+
+  *pnRecs = nCopy;
+
+  return para_ok;
+}
+
+int CParaSpi::DumpTrace(const char *strFile/*=NULL*/) {
+  para_spitrace *t = m_pTrace;
+  para_spirec rec;
+  FILE *f;
+  unsigned long long tFirst = 0;
+  int n, nRecs;
+
+  if(t == NULL)
+    return para_notopen;
+
+  if(strFile == NULL || !strcmp(strFile, "-"))
+    f = stderr;
+  else if((f = fopen(strFile, "w")) == NULL)
+    return para_fileerr;
+
+  fprintf(f, "SPI trace: %llu transactions, %llu errors\n", t->nXacts, t->nErrors);
+
+  if(t->nXacts) {
+
+    fprintf(f, "  avg %.0f ns (max %u), %.1f bits, %.1f backend calls\n",
+	    (double)t->nTotalNS / t->nXacts, t->nMaxNS,
+	    (double)t->nTotalBits / t->nXacts, (double)t->nTotalCalls / t->nXacts);
+
+    fprintf(f, "  %12s %12s %12s %12s\n", "from", "nsec", "bits", "calls");
+    for(n = 0; n < SPITRACEBINS; n++)
+      if(t->nNSHist[n] || t->nBitsHist[n] || t->nCallsHist[n])
+	fprintf(f, "  %12llu %12llu %12llu %12llu\n", n ? 1ULL << (n - 1) : 0ULL,
+		t->nNSHist[n], t->nBitsHist[n], t->nCallsHist[n]);
+  }
+
+  nRecs = t->nXacts < (unsigned long long)m_nRing ? (int)t->nXacts : m_nRing;
+  if(nRecs) {
+
+    fprintf(f, "  Last %d transactions:\n", nRecs);
+    fprintf(f, "  %12s %12s %12s %12s %6s\n", "start ns", "nsec", "bits", "calls", "result");
+    for(n = 0; n < nRecs; n++) {
+      rec = m_pRing[(m_nRingNext - nRecs + n + m_nRing) % m_nRing];
+      if(!n)
+	tFirst = rec.tStart;
+      fprintf(f, "  %12llu %12u %12u %12u %6d\n", rec.tStart - tFirst,
+	      rec.nNS, rec.nBits, rec.nCalls, rec.nResult);
+    }
+  }
+
+  if(f != stderr)
+    fclose(f);
+
+  return para_ok;
+}
+
+int CParaSpiXact::Add(const uint8_t *pTx, uint8_t *pRx, size_t nLen, int nWidth) {
+
+  if(m_nSegs >= SPIMAXSEGS)
+    return para_outofmemory;
+
+  m_segs[m_nSegs].pTx = pTx;
+  m_segs[m_nSegs].pRx = pRx;
+  m_segs[m_nSegs].nLen = nLen;
+  m_segs[m_nSegs].nWidth = nWidth;
+  m_nSegs++;
+
+  return para_ok;
+}
+
+// Internal functions
+
+// Reverse the bits of a byte, for LSB-first transfers
+static unsigned SpiFlip(unsigned nByte) {
+
+  nByte = ((nByte & 0xF0) >> 4) | ((nByte & 0x0F) << 4);
+  nByte = ((nByte & 0xCC) >> 2) | ((nByte & 0x33) << 2);
+  nByte = ((nByte & 0xAA) >> 1) | ((nByte & 0x55) << 1);
+
+  return nByte;
+}
+
+// spidev functions
+
+int CParaSpi::DevOpen(const char *strDev) {
+
+  return open(strDev, O_RDWR);
+}
+
+int CParaSpi::DevConfig() {
+  uint8_t mode, bits = 8;
+  uint32_t speed = m_nSpeedHz;
+
+  mode = (m_nCPOL ? SPI_CPOL : 0) | (m_nCPHA ? SPI_CPHA : 0) |
+    (m_nEPOL ? SPI_CS_HIGH : 0);
+
+  if(ioctl(m_fdDev, SPI_IOC_WR_MODE, &mode) < 0 ||
+     ioctl(m_fdDev, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+     ioctl(m_fdDev, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+    fprintf(stderr, "Unable to set the spidev mode\n");
+    return para_fileerr;
+  }
+
+  return para_ok;
+}
+
+int CParaSpi::DevMessage(struct spi_ioc_transfer *pXfers, int nXfers) {
+
+  if(ioctl(m_fdDev, SPI_IOC_MESSAGE(nXfers), pXfers) < 0)
+    return errno == EMSGSIZE ? para_outofrange : para_fileerr;
+
+  return para_ok;
+}
+
+int CParaSpi::DevXfer(int nBits, const unsigned *pWVal, unsigned *pRVal) {
+  struct spi_ioc_transfer xfer;
+  uint8_t tx[4], rx[4];
+  uint16_t w16;
+  unsigned wval = pWVal ? *pWVal : 0;
+  int n, nBytes, res;
+
+  if(nBits <= 0 || nBits > 32)
+    return para_badarg;
+
+  memset(&xfer, 0, sizeof(xfer));
+  memset(rx, 0, sizeof(rx));
+
+  if(nBits % 8 == 0) {
+
+    // Whole bytes, MSB-first like the GPIO path
+    nBytes = nBits / 8;
+    for(n = 0; n < nBytes; n++)
+      tx[n] = wval >> (8 * (nBytes - 1 - n));
+
+  } else {
+
+    // One word of nBits bits, in the host's byte order as spidev wants
+    nBytes = nBits <= 8 ? 1 : nBits <= 16 ? 2 : 4;
+    xfer.bits_per_word = nBits;
+    if(nBytes == 1)
+      tx[0] = wval;
+    else if(nBytes == 2) {
+      w16 = wval;
+      memcpy(tx, &w16, 2);
+    } else
+      memcpy(tx, &wval, 4);
+  }
+
+  xfer.tx_buf = (unsigned long)tx;
+  xfer.rx_buf = (unsigned long)rx;
+  xfer.len = nBytes;
+
+  nIOCalls++;
+  res = DevMessage(&xfer, 1);
+  if(res || !pRVal)
+    return res;
+
+  if(nBits % 8 == 0) {
+    for(*pRVal = 0, n = 0; n < nBytes; n++)
+      *pRVal = (*pRVal << 8) | rx[n];
+  } else if(nBytes == 1)
+    *pRVal = rx[0];
+  else if(nBytes == 2) {
+    memcpy(&w16, rx, 2);
+    *pRVal = w16;
+  } else
+    memcpy(pRVal, rx, 4);
+
+  if(nBits < 32)
+    *pRVal &= (1U << nBits) - 1;
+
+  return para_ok;
+}
+
+int CParaSpi::DevTransfer(const para_spiseg *pSegs, int nSegs) {
+  para_spibatch xact;
+
+  if(nSegs > SPIMAXSEGS)
+    return para_outofrange;
+
+  xact.pSegs = pSegs;
+  xact.nSegs = nSegs;
+
+  return DevBatch(&xact, 1);
+}
+
+// Send pXacts as few spidev messages as SPIDEVBATCH allows, cs_change
+// on the last transfer of each transaction ends its enable cycle
+int CParaSpi::DevBatch(para_spibatch *pXacts, int nXacts) {
+  struct spi_ioc_transfer xfers[SPIMAXSEGS * 4];
+  uint8_t *pFlip = NULL;
+  size_t n, nFlip, nBytes;
+  int x, first, last, nXfers, s, res, ret = para_ok;
 
+  for(first = 0; first < nXacts; first = x) {
+
+    // Take transactions while they fit, but always at least one
+    nXfers = 0;
+    nBytes = nFlip = 0;
+    last = -1;
+    for(x = first; x < nXacts; x++) {
+
+      pXacts[x].nResult = CheckSegs(pXacts[x].pSegs, pXacts[x].nSegs);
+      if(pXacts[x].nResult == para_ok && pXacts[x].nSegs > SPIMAXSEGS)
+	pXacts[x].nResult = para_outofrange;
+      if(pXacts[x].nResult != para_ok || pXacts[x].nSegs == 0)
+	continue;  // not sent
+
+      for(n = 0, s = 0; s < pXacts[x].nSegs; s++)
+	n += pXacts[x].pSegs[s].nLen;
+
+      if(nXfers && (nXfers + pXacts[x].nSegs > SPIMAXSEGS * 4 ||
+		    nBytes + n > SPIDEVBATCH))
+	break;
+
+      nXfers += pXacts[x].nSegs;
+      nBytes += n;
+      last = x;
+      for(s = 0; s < pXacts[x].nSegs; s++)
+	if(pXacts[x].pSegs[s].pTx)
+	  nFlip += pXacts[x].pSegs[s].nLen;
+    }
+
+    if(last < 0)
+      continue;  // nothing left to send
+
+    // Most controllers can't do LSB-first, so reverse the bytes here
+    if(m_bLSBFirst && nFlip && (pFlip = (uint8_t *)malloc(nFlip)) == NULL)
+      res = para_outofmemory;
+    else {
+
+      memset(xfers, 0, nXfers * sizeof(xfers[0]));
+      nXfers = 0;
+      nFlip = 0;
+
+      for(x = first; x <= last; x++) {
+
+	const para_spiseg *pSegs = pXacts[x].pSegs;
+
+	if(pXacts[x].nResult != para_ok || pXacts[x].nSegs == 0)
+	  continue;
+
+	for(s = 0; s < pXacts[x].nSegs; s++, nXfers++) {
+
+	  xfers[nXfers].len = pSegs[s].nLen;
+	  xfers[nXfers].rx_buf = (unsigned long)pSegs[s].pRx;
+	  xfers[nXfers].tx_buf = (unsigned long)pSegs[s].pTx;
+	  if(pSegs[s].nWidth > 1) {
+	    xfers[nXfers].tx_nbits = pSegs[s].pTx ? pSegs[s].nWidth : 0;
+	    xfers[nXfers].rx_nbits = pSegs[s].pRx ? pSegs[s].nWidth : 0;
+	  }
+
+	  if(pFlip && pSegs[s].pTx) {
+	    for(n = 0; n < pSegs[s].nLen; n++)
+	      pFlip[nFlip + n] = SpiFlip(pSegs[s].pTx[n]);
+	    xfers[nXfers].tx_buf = (unsigned long)(pFlip + nFlip);
+	    nFlip += pSegs[s].nLen;
+	  }
+	}
+
+	// Enable off between transactions, not after the last one
+	if(x != last)
+	  xfers[nXfers - 1].cs_change = 1;
+      }
+
+      nIOCalls++;
+      res = DevMessage(xfers, nXfers);
+      free(pFlip);
+      pFlip = NULL;
+    }
+
+    for(x = first; x <= last; x++) {
+
+      if(pXacts[x].nResult != para_ok || pXacts[x].nSegs == 0)
+	continue;
+
+      pXacts[x].nResult = res;
+
+      for(s = 0; res == para_ok && m_bLSBFirst && s < pXacts[x].nSegs; s++)
+	for(n = 0; pXacts[x].pSegs[s].pRx && n < pXacts[x].pSegs[s].nLen; n++)
+	  pXacts[x].pSegs[s].pRx[n] = SpiFlip(pXacts[x].pSegs[s].pRx[n]);
+    }
+
+    x = last + 1;
+  }
+
+  for(x = 0; x < nXacts && ret == para_ok; x++)
+    ret = pXacts[x].nResult;
+
+  return ret;
+}
+
+// Shift bytes with enable already active
+int CParaSpi::ShiftBytes(const uint8_t *pTx, uint8_t *pRx, size_t nLen) {
+  unsigned wval, rval;
+  size_t n;
+  int res;
+
+  if(pTx == NULL) {
+    res = SetPin(SPIMOSIPIN, 0);
+    if(res)
+      return res;
+  }
+
+  for(n = 0; n < nLen; n++) {
+
+    // Read pTx[n] before pRx[n] is written, they may be the same byte
+    if(pTx)
+      wval = m_bLSBFirst ? SpiFlip(pTx[n]) : pTx[n];
+
+    rval = 0;
+    res = Shift(8, pTx ? &wval : NULL, pRx ? &rval : NULL);
+    if(res)
+      return res;
+
+    if(pRx)
+      pRx[n] = m_bLSBFirst ? SpiFlip(rval) : rval;
+  }
+
+  return para_ok;
+}
+
+// Tracing, see EnableTrace()
+
+CParaSpi *CParaSpi::spiTraced = NULL;
+pthread_mutex_t CParaSpi::spiTraceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// log2 histogram bin of v, see para_spitrace
+static int SpiBin(unsigned long long v) {
+  int n = 0;
+
+  while(v && n < SPITRACEBINS - 1) {
+    v >>= 1;
+    n++;
+  }
+
+  return n;
+}
+
+// Write the traces asked for at exit, once
+void CParaSpi::TraceExit() {
+  CParaSpi *p;
+
+  pthread_mutex_lock(&spiTraceMutex);
+
+  for(p = spiTraced; p; p = p->m_pTraceNext) {
+    p->DumpTrace(p->m_strDump);
+    free(p->m_strDump);
+    p->m_strDump = NULL;
+  }
+
+  spiTraced = NULL;
+
+  pthread_mutex_unlock(&spiTraceMutex);
+}
+
+void CParaSpi::TraceAdd(unsigned long long tStart, unsigned nBits,
+			unsigned long long nCalls, int nResult) {
+  unsigned long long nNS = SpiNow() - tStart;
+  para_spirec *pRec;
+
+  if(nNS > 0xFFFFFFFFULL)
+    nNS = 0xFFFFFFFFULL;
+
+  m_pTrace->nXacts++;
+  if(nResult)
+    m_pTrace->nErrors++;
+  m_pTrace->nTotalNS += nNS;
+  m_pTrace->nTotalBits += nBits;
+  m_pTrace->nTotalCalls += nCalls;
+  if(nNS > m_pTrace->nMaxNS)
+    m_pTrace->nMaxNS = nNS;
+  m_pTrace->nNSHist[SpiBin(nNS)]++;
+  m_pTrace->nBitsHist[SpiBin(nBits)]++;
+  m_pTrace->nCallsHist[SpiBin(nCalls)]++;
+
+  if(m_nRing) {
+    pRec = &m_pRing[m_nRingNext];
+    pRec->tStart = tStart;
+    pRec->nNS = nNS;
+    pRec->nBits = nBits;
+    pRec->nCalls = nCalls;
+    pRec->nResult = nResult;
+    m_nRingNext = (m_nRingNext + 1) % m_nRing;
+  }
+}
+
+// Clock pacing, see SetClockRate()
+
+// Schedule the first edge half a period after enable
+void CParaSpi::PaceStart() {
+
+  m_tNext = SpiNow() + m_nHalfNS;
+  m_tFirst = m_tLast = 0;
+  m_nXactEdges = 0;
+}
+
+// Wait for the scheduled time, sleeping while there is time to
+// spare, returns the time it was reached
+unsigned long long CParaSpi::PaceWait() {
+  struct timespec ts;
+  unsigned long long now;
+
+  now = SpiNow();
+  if(m_tNext > now + m_clk.nSleepNS) {
+    ts.tv_sec = (m_tNext - now - m_clk.nSleepNS) / 1000000000ULL;
+    ts.tv_nsec = (m_tNext - now - m_clk.nSleepNS) % 1000000000ULL;
+    nanosleep(&ts, NULL);
+  }
+
+  while((now = SpiNow()) < m_tNext)
+    ;
+
+  return now;
+}
+
+// Wait for the next clock edge and schedule the one after
+void CParaSpi::Pace() {
+  unsigned long long now, late;
+
+  now = PaceWait();
+  late = now - m_tNext;
+
+  m_clk.nEdges++;
+  m_dLateSq += (double)late * late;
+  if(late > m_clk.nLateMaxNS)
+    m_clk.nLateMaxNS = late;
+
+  if(!m_nXactEdges++)
+    m_tFirst = now;
+  m_tLast = now;
+
+  // Far behind, start again from here rather than rushing to catch up
+  m_tNext = (late > m_nHalfNS ? now : m_tNext) + m_nHalfNS;
+}
+
+// Hold enable for half a period after the last edge, add up the rate
+void CParaSpi::PaceEnd() {
+
+  PaceWait();
+
+  if(m_nXactEdges > 1) {
+    m_nPaceNS += m_tLast - m_tFirst;
+    m_nPaceHalves += m_nXactEdges - 1;
+  }
+}
+
+// Data pins that are outputs for single-bit transfers
+unsigned long long CParaSpi::SingleOut() {
+
+  if(m_nIO2Pin < 0)
+    return 1ULL << SPIMOSIPIN;
+
+  return (1ULL << SPIMOSIPIN) | (1ULL << m_nIO2Pin) | (1ULL << m_nIO3Pin);
+}
+
+// Turn data pins around so exactly those in nOut are outputs, only
+// touching the ones that change
+int CParaSpi::SetDataDir(unsigned long long nOut) {
+  unsigned long long nChange = nOut ^ m_nDataOut;
+  int res;
+
+  if(!nChange)
+    return para_ok;
+
+  if(nChange & ~nOut) {
+    res = SetDirection(nChange & ~nOut, para_dirin);
+    if(res) return res;
+  }
+
+  if(nChange & nOut) {
+    res = SetDirection(nChange & nOut, para_dirout);
+    if(res) return res;
+  }
+
+  m_nDataOut = nOut;
+
+  // Returning to single-bit, put IO2 / IO3 back to idle
+  if(nOut == SingleOut() && m_nIO2Pin >= 0)
+    return SetMasked((1ULL << m_nIO2Pin) | (1ULL << m_nIO3Pin), ~0ULL);
+
+  return para_ok;
+}
+
+// Shift bytes 2 or 4 bits per clock with enable already active, only
+// one of pTx / pRx may be given.  The data for each clock goes out in
+// the same SetMasked() as the clock edge before it.
+int CParaSpi::ShiftWide(const uint8_t *pTx, uint8_t *pRx, size_t nLen, int nWidth) {
+  unsigned long long nMask, nAll, nClk, nIdle, nActive, rval, v;
+  unsigned wval, nData, nMax = (1U << nWidth) - 1;
+  bool bTrail = false;
+  size_t n;
+  int b, res;
+
+  nMask = m_nWideOut[nMax];
+  nAll = SingleOut() | (1ULL << SPIMISOPIN);
+
+  // Turn the lines used to outputs to send or inputs to receive
+  res = SetDataDir(pTx ? nAll : nAll & ~nMask);
+  if(res)
+    return res;
+
+  if(eBackend == para_bkmmio && !m_nHalfNS && !m_bGeneric)
+    return ShiftWideM(pTx, pRx, nLen, nWidth);
+
+  nClk = 1ULL << SPICLKPIN;
+  nIdle = m_nCPOL ? nClk : 0;
+  nActive = m_nCPOL ? 0 : nClk;
+
+  for(n = 0; n < nLen; n++) {
+
+    if(pTx)
+      wval = m_bLSBFirst ? SpiFlip(pTx[n]) : pTx[n];
+
+    nData = 0;
+    for(b = 8 - nWidth; b >= 0; b -= nWidth) {
+
+      v = pTx ? m_nWideOut[(wval >> b) & nMax] : 0;
+
+      if(!m_nCPHA) {
+
+	// Trailing edge of the last clock with this one's data, or
+	// just the data for the first
+	if(bTrail) {
+	  if(m_nHalfNS)
+	    Pace();
+	  res = pTx ? SetMasked(nClk | nMask, nIdle | v) : SetMasked(nClk, nIdle);
+	} else
+	  res = pTx ? SetMasked(nMask, v) : para_ok;
+	if(res) return res;
+
+	if(m_nHalfNS)
+	  Pace();
+	res = SetMasked(nClk, nActive);
+	if(res) return res;
+	bTrail = true;
+
+      } else {
+
+	// Leading edge with the data, sampled on the trailing one
+	if(m_nHalfNS)
+	  Pace();
+	res = pTx ? SetMasked(nClk | nMask, nActive | v) : SetMasked(nClk, nActive);
+	if(res) return res;
+
+	if(m_nHalfNS)
+	  Pace();
+	res = SetMasked(nClk, nIdle);
+	if(res) return res;
+      }
+
+      if(pRx) {
+	res = GetMasked(nMask, &rval);
+	if(res) return res;
+	nData |= ((rval >> SPIMOSIPIN) & 1) << b;
+	nData |= ((rval >> SPIMISOPIN) & 1) << (b + 1);
+	if(nWidth == 4)
+	  nData |= (((rval >> m_nIO2Pin) & 1) << (b + 2)) |
+	    (((rval >> m_nIO3Pin) & 1) << (b + 3));
+      }
+    }
+
+    if(pRx)
+      pRx[n] = m_bLSBFirst ? SpiFlip(nData) : nData;
+  }
+
+  if(bTrail) {
+    if(m_nHalfNS)
+      Pace();
+    return SetMasked(nClk, nIdle);
+  }
+
+  return para_ok;
+}
+
+// ShiftWide() for para_bkmmio.  The MASK_DATA words for every clock
+// level and nibble are worked out once, so each edge is one store per
+// half-bank the clock and data lines use (one if they share it) and a
+// nibble is read with one DATA_RO load per bank.
+int CParaSpi::ShiftWideM(const uint8_t *pTx, uint8_t *pRx, size_t nLen, int nWidth) {
+  para_mmiobit pins[5];            // CLK, IO0..IO3
+  int lines[5] = { SPICLKPIN, SPIMOSIPIN, SPIMISOPIN, m_nIO2Pin, m_nIO3Pin };
+  volatile unsigned *pReg[5], *pRO[4];
+  unsigned words[2][16][5];        // by clock level, nibble, register
+  unsigned keep[5], ro[4], reg[5], vals[4];
+  unsigned wval, nData, nMax = (1U << nWidth) - 1, v = 0;
+  unsigned idle = m_nCPOL, active = 1 - m_nCPOL;
+  unsigned long long calls = 0;
+  int nRegs = 0, nRO = 0, i, r, c, b;
+  bool bTrail = false;
+  size_t n;
+
+  if(!(pMmio->nOutMask & (1ULL << SPICLKPIN)))
+    return para_nodir;
+
+  for(i = 0; i <= nWidth; i++) {
+
+    if(para_pinmmio(pMmio, lines[i], pins + i))
+      return para_nodir;
+
+    if(i > 0 && pTx && !(pMmio->nOutMask & (1ULL << lines[i])))
+      return para_nodir;
+
+    // Only the clock is written while receiving
+    if(i == 0 || pTx) {
+      for(r = 0; r < nRegs && pReg[r] != pins[i].pMaskData; r++)
+	;
+      if(r == nRegs) {
+	pReg[nRegs++] = pins[i].pMaskData;
+	keep[r] = ~0U;
+      }
+      keep[r] &= pins[i].nLow;  // write-mask bits of every line stored
+      reg[i] = r;
+    }
+
+    if(i > 0) {
+      for(r = 0; r < nRO && pRO[r] != pins[i].pDataRO; r++)
+	;
+      if(r == nRO)
+	pRO[nRO++] = pins[i].pDataRO;
+      ro[i - 1] = r;
+    }
+  }
+
+  // The clock shares register 0, storing only that moves just the clock
+  for(c = 0; c < 2; c++)
+    for(v = 0; v <= nMax; v++) {
+      for(r = 0; r < nRegs; r++)
+	words[c][v][r] = keep[r];
+      if(c)
+	words[c][v][reg[0]] |= pins[0].nHigh & 0xFFFF;
+      for(i = 1; pTx && i <= nWidth; i++)
+	if(v & (1U << (i - 1)))
+	  words[c][v][reg[i]] |= pins[i].nHigh & 0xFFFF;
+    }
+
+  v = 0;
+
+  for(n = 0; n < nLen; n++) {
+
+    if(pTx)
+      wval = m_bLSBFirst ? SpiFlip(pTx[n]) : pTx[n];
+
+    nData = 0;
+    for(b = 8 - nWidth; b >= 0; b -= nWidth) {
+
+      if(pTx)
+	v = (wval >> b) & nMax;
+
+      if(!m_nCPHA) {
+
+	// Trailing edge of the last clock with this one's data
+	if(pTx || bTrail) {
+	  for(r = 0; r < nRegs; r++)
+	    *pReg[r] = words[idle][v][r];
+	  calls += nRegs;
+	}
+	*pReg[reg[0]] = words[active][v][reg[0]];
+	calls++;
+	bTrail = true;
+
+      } else {
+
+	// Leading edge with the data, sampled on the trailing one
+	for(r = 0; r < nRegs; r++)
+	  *pReg[r] = words[active][v][r];
+	*pReg[reg[0]] = words[idle][v][reg[0]];
+	calls += nRegs + 1;
+      }
+
+      if(pRx) {
+	for(r = 0; r < nRO; r++)
+	  vals[r] = *pRO[r];
+	calls += nRO;
+	for(i = 1; i <= nWidth; i++)
+	  nData |= ((vals[ro[i - 1]] >> pins[i].nBit) & 1) << (b + i - 1);
+      }
+    }
+
+    if(pRx)
+      pRx[n] = m_bLSBFirst ? SpiFlip(nData) : nData;
+  }
+
+  if(bTrail) {
+    *pReg[reg[0]] = words[idle][v][reg[0]];
+    calls++;
+  }
+
+  // Keep the shadow in step with what was driven
+  nShadow = (nShadow & ~(1ULL << SPICLKPIN)) | ((unsigned long long)idle << SPICLKPIN);
+  nKnown |= 1ULL << SPICLKPIN;
+  for(i = 1; pTx && nLen && i <= nWidth; i++) {
+    nShadow = (nShadow & ~(1ULL << lines[i])) |
+      ((unsigned long long)((v >> (i - 1)) & 1) << lines[i]);
+    nKnown |= 1ULL << lines[i];
+  }
+  nIOCalls += calls;
+
+  return para_ok;
+}
+
+// Shift nBits bits MSB-first with enable already active, *pRVal must
+// be cleared by the caller
+int CParaSpi::Shift(int nBits, const unsigned *pWVal, unsigned *pRVal) {
+
+  if(m_bGeneric || m_nHalfNS)
+    return ShiftGeneric(nBits, pWVal, pRVal);
+
+  return (this->*m_pKernels[(pWVal ? 1 : 0) | (pRVal ? 2 : 0)])(nBits, pWVal, pRVal);
+}
+
+// The original bit loop, all decisions made for every bit
+int CParaSpi::ShiftGeneric(int nBits, const unsigned *pWVal, unsigned *pRVal) {
+  int n, clk, res;
+  int rval;
+
+  clk = m_nCPOL;
 
   for(n = nBits-1; n >= 0; n--) {
     
     //if slave is reading on second edge perform first edge now
     if(m_nCPHA) {
+      if(m_nHalfNS)
+	Pace();
       clk = 1-clk;
-      res = para_setgpio(pGpio[SPICLKPIN], clk);
+      res = SetPin(SPICLKPIN, clk);
       if(res) return res;
     }
 
     if(pWVal) {  // Send data if asked to do so
 
-      currentVal = ((*pWVal >> n) & 1);  // get next bit
-
-      // Only update the pin if this is the first bit or the bit has changed
-      if((n == nBits-1) || (currentVal != lastVal)) {
-        res = para_setgpio(pGpio[SPIMOSIPIN], currentVal);
-        if(res) return res;
-        lastVal=currentVal;
-      }
+      // The pin is only written if the bit has changed, see SetMasked()
+      res = SetPin(SPIMOSIPIN, (*pWVal >> n) & 1);
+      if(res) return res;
     }
 
     //advance the clock, device will read bit
+    if(m_nHalfNS)
+      Pace();
     clk = 1-clk;
-    res = para_setgpio(pGpio[SPICLKPIN], clk);
+    res = SetPin(SPICLKPIN, clk);
     if(res) return res;
 
     if(pRVal) { // Read data if there is a place to put it
-      res = para_getgpio(pGpio[SPIMISOPIN], &rval);
+      res = GetPin(SPIMISOPIN, &rval);
       if(res) return res;
       *pRVal |= rval << n;
     }
 
     // if slave is reading on the first edge send second edge now
     if(!m_nCPHA) {
+      if(m_nHalfNS)
+	Pace();
       clk = 1-clk;
-      res = para_setgpio(pGpio[SPICLKPIN], clk);
+      res = SetPin(SPICLKPIN, clk);
       if(res) return res;
     }
   }
 
-  // Enable = inactive
-  res = para_setgpio(pGpio[SPIENBPIN], 1-m_nEPOL);
-  if(res)
-    return res;
+  return para_ok;
+}
+
+// Mode-specific bit loop, CPOL/CPHA/DIR are constants so every test
+// below is resolved by the compiler
+template<int CPOL, int CPHA, int DIR>
+int CParaSpi::ShiftK(int nBits, const unsigned *pWVal, unsigned *pRVal) {
+  int n, res, rval;
+  unsigned wval = (DIR & 1) ? *pWVal : 0;
+  unsigned acc = 0;
+
+  // Decide on the backend once per call, not once per edge
+  if(eBackend == para_bkmmio) {
+    res = ShiftM<CPOL, CPHA, DIR>(nBits, pWVal, pRVal);
+    if(res != para_nodir)
+      return res;
+  }
+
+  for(n = nBits-1; n >= 0; n--) {
+
+    if(CPHA) {
+      res = SetPin(SPICLKPIN, 1-CPOL);
+      if(res) return res;
+    }
+
+    if(DIR & 1) {
+      res = SetPin(SPIMOSIPIN, (wval >> n) & 1);
+      if(res) return res;
+    }
+
+    res = SetPin(SPICLKPIN, CPHA ? CPOL : 1-CPOL);
+    if(res) return res;
+
+    if(DIR & 2) {
+      res = GetPin(SPIMISOPIN, &rval);
+      if(res) return res;
+      acc |= rval << n;
+    }
+
+    if(!CPHA) {
+      res = SetPin(SPICLKPIN, CPOL);
+      if(res) return res;
+    }
+  }
+
+  if(DIR & 2)
+    *pRVal |= acc;
+
+  return para_ok;
+}
+
+// Same as ShiftK for para_bkmmio, storing the precomputed MASK_DATA
+// words directly.  Returns para_nodir if CLK or MOSI is not a plain
+// output, the caller then falls back to SetPin().
+template<int CPOL, int CPHA, int DIR>
+int CParaSpi::ShiftM(int nBits, const unsigned *pWVal, unsigned *pRVal) {
+  para_mmiobit clk, mosi, miso;
+  unsigned wval = (DIR & 1) ? *pWVal : 0;
+  unsigned acc = 0, clkIdle, clkActive, bit, last, calls = 0;
+  int n;
+
+  if(!(pMmio->nOutMask & (1ULL << SPICLKPIN)) ||
+     ((DIR & 1) && !(pMmio->nOutMask & (1ULL << SPIMOSIPIN))))
+    return para_nodir;
+
+  if(para_pinmmio(pMmio, SPICLKPIN, &clk) ||
+     para_pinmmio(pMmio, SPIMOSIPIN, &mosi) ||
+     para_pinmmio(pMmio, SPIMISOPIN, &miso))
+    return para_nodir;
+
+  clkIdle = CPOL ? clk.nHigh : clk.nLow;
+  clkActive = CPOL ? clk.nLow : clk.nHigh;
+
+  // As SetMasked(), MOSI is only stored when the bit changes
+  last = (nKnown & (1ULL << SPIMOSIPIN)) ? (nShadow >> SPIMOSIPIN) & 1 : 2;
+
+  for(n = nBits-1; n >= 0; n--) {
+
+    if(CPHA) {
+      *clk.pMaskData = clkActive;
+      calls++;
+    }
+
+    if(DIR & 1) {
+      bit = (wval >> n) & 1;
+      if(bit != last) {
+	*mosi.pMaskData = bit ? mosi.nHigh : mosi.nLow;
+	last = bit;
+	calls++;
+      }
+    }
+
+    *clk.pMaskData = CPHA ? clkIdle : clkActive;
+    calls++;
+
+    if(DIR & 2) {
+      acc |= ((*miso.pDataRO >> miso.nBit) & 1) << n;
+      calls++;
+    }
+
+    if(!CPHA) {
+      *clk.pMaskData = clkIdle;
+      calls++;
+    }
+  }
+
+  if(DIR & 2)
+    *pRVal |= acc;
+
+  // Keep the shadow in step with what was driven
+  if(nBits > 0) {
+    nShadow = (nShadow & ~(1ULL << SPICLKPIN)) | ((unsigned long long)CPOL << SPICLKPIN);
+    nKnown |= 1ULL << SPICLKPIN;
+  }
+  if(last < 2) {
+    nShadow = (nShadow & ~(1ULL << SPIMOSIPIN)) | ((unsigned long long)last << SPIMOSIPIN);
+    nKnown |= 1ULL << SPIMOSIPIN;
+  }
+  nIOCalls += calls;
 
   return para_ok;
 }
 
+#define SPIKERNELS(pol, pha) \
+  { &CParaSpi::ShiftK<pol, pha, 0>, &CParaSpi::ShiftK<pol, pha, 1>, \
+    &CParaSpi::ShiftK<pol, pha, 2>, &CParaSpi::ShiftK<pol, pha, 3> }
+
+const CParaSpi::SpiKernel CParaSpi::spiKernels[2][2][4] = {
+  { SPIKERNELS(0, 0), SPIKERNELS(0, 1) },
+  { SPIKERNELS(1, 0), SPIKERNELS(1, 1) }
+};
@@ -50,9 +50,33 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     AssignPins(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder) -
       Assigns pins in the event that the empty constructor was used.
       It is an error to use this function if pins have already been assigned.
+      If the environment variable PARA_SPIDEV names a spidev device, that
+      device is opened instead (see OpenDevice) and the pins are not
+      touched.  If it can't be opened the pins are used as usual.
+
+    AddQuadPins(int nIO2, int nIO3, bool bPorcuOrder=false) - Adds the
+      two extra data lines needed for quad I/O, after AssignPins().  MOSI
+      and MISO are IO0 and IO1.  Outside of quad segments IO2 and IO3 are
+      driven high, as a flash needs for its WP# and HOLD# pins.
+
+    OpenDevice(const char *strDev=NULL, unsigned nSpeedHz=0) - Uses the
+      kernel spidev device strDev, e.g. "/dev/spidev1.0", for all
+      transfers instead of bit-banging GPIOs.  This is for FPGA images
+      that route a hardware SPI controller to the PEC pins.  strDev NULL
+      means $PARA_SPIDEV.  nSpeedHz 0 means $PARA_SPIHZ, default 1MHz.
+      The current mode is applied to the device, including the enable
+      polarity.  Returns an error and leaves the object as it was if the
+      device can't be used.
+
+    CloseDevice() - Stops using the spidev device, back to the GPIO pins
+      if any were assigned.
+
+    GetPath() - Returns para_spidev if transfers go through a spidev
+      device or para_spigpio if they are bit-banged on the GPIO pins.
 
     SetMode(int nCPOL=0, int nCPHA=0, int nEPOL=0) - Sets the various
-      polarities / phases as described below.
+      polarities / phases as described below.  Also selects the transfer
+      kernels for the mode, see Kernels below.
 
     Xfer(int nBits, unsigned *pWVal, unsigned *pRVal=NULL) - Transfers
       nBits bits, transmitting from the buffer pointed-to by pWVal and
@@ -60,14 +84,192 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
       pRVal may be null to either transmit 0s / discard incoming
       bits, respectively, as desired.
 
+    SetBitOrder(bool bLSBFirst) - Selects whether Transfer() shifts each
+      byte most-significant bit first (the default) or least-significant
+      bit first.  Xfer() is always MSB-first.
+
+    Transfer(const uint8_t *pTx, uint8_t *pRx, size_t nLen) - Transfers
+      nLen bytes as a single transaction, i.e. with one enable cycle,
+      sending from pTx and receiving into pRx.  Either may be NULL as
+      for Xfer().  pTx and pRx may point to the same buffer.
+
+    Transfer(const para_spiseg *pSegs, int nSegs) - Transfers the nSegs
+      segments of pSegs in order, holding enable active from the start
+      of the first to the end of the last.  Each segment has its own
+      pTx / pRx / nLen as for the single-buffer Transfer(), so e.g. a
+      flash read is one segment sending the command & address followed
+      by one receiving the data.
+
+    Transfer(CParaSpiXact &xact) - Same as above using the segments
+      collected by a CParaSpiXact builder.
+
+    TransferBatch(para_spibatch *pXacts, int nXacts) - Runs nXacts
+      transactions back-to-back, each with its own enable cycle, and
+      sets each one's nResult.  Returns the first error.  With spidev
+      they go out as few SPI_IOC_MESSAGEs as SPIDEVBATCH bytes allow,
+      with cs_change between transactions, so one failed message gives
+      all of its transactions the same error.  While tracing, each is
+      run and recorded on its own.
+
+      A segment with nWidth 2 or 4 moves 2 or 4 bits per clock (dual /
+      quad I/O), see Wide segments below.
+
+    SetClockRate(unsigned nHz) - Paces the clock at nHz instead of as
+      fast as the backend allows, 0 to go back to free-running.  Both
+      edges of each clock are scheduled on absolute times so the duty
+      cycle stays balanced and errors don't accumulate.  Waits longer
+      than the calibrated wake-up latency sleep first, then spin to the
+      edge.  The latency and the cost of one pin access are measured
+      here, so call it again if the load on the system changes.  With
+      spidev this just sets the controller's clock rate.
+
+    GetClockStats(para_spiclk *pStats) - Fills in the achieved clock
+      rate and the edge timing error of paced transfers since the last
+      ResetClockStats(), plus the calibration results (see below).
+
+    ResetClockStats() - Clears the paced-transfer statistics.
+
+    EnableTrace(int nRing=64, const char *strDump=NULL) - Starts recording
+      every Xfer() and Transfer() into the trace statistics and a ring of
+      the last nRing transactions, see Tracing below.  If strDump is given
+      the trace is written to that file ("-" for stderr) when the object
+      is destroyed or the program exits.  Returns para_noaccess if the
+      library was built without PARA_SPITRACE.
+
+    DisableTrace() - Stops recording and frees the trace.
+
+    ResetTrace() - Clears the statistics and the ring.
+
+    GetTrace(para_spitrace *pTrace) - Copies the statistics.
+
+    GetTraceRecs(para_spirec *pRecs, int *pnRecs) - Copies up to *pnRecs
+      of the most recent transactions, oldest first, setting *pnRecs to
+      the number copied.
+
+    DumpTrace(const char *strFile=NULL) - Writes the statistics,
+      histograms and ring as text to strFile, NULL or "-" for stderr.
+
+    SetGeneric(bool bGeneric) - Uses the original generic bit loop for all
+      transfers instead of the mode-specific kernels.  Only useful for
+      benchmarking the two against each other.
+
+  Clock pacing:
+
+    Each paced edge is written as soon as its scheduled time has been
+      reached, and its lateness (never negative) is recorded.  An edge
+      more than half a period late restarts the schedule from now rather
+      than bunching up the edges that follow.  para_spiclk has:
+
+      nTargetHz      - the rate asked for, 0 if not pacing
+      dAchievedHz    - clocks / time from first to last edge, averaged
+                       over all paced transactions
+      nEdges         - paced edges
+      nLateMaxNS     - worst lateness of any edge
+      dJitterNS      - RMS lateness of all edges
+      nSleepNS       - calibrated wake-up latency of nanosleep()
+      nPinNS         - calibrated cost of one pin access, so about
+                       1e9 / (2 * nPinNS) is the fastest clock possible
+
+    Pacing uses the generic bit loop, not the kernels.
+
+  Tracing:
+
+    The tracing code is only compiled with -DPARA_SPITRACE, otherwise
+      Xfer() and Transfer() go straight to the transfer and EnableTrace()
+      fails.  When built in but not enabled it costs one test per
+      transaction.  Each transaction records its start time, duration,
+      bits clocked, backend calls (CParaGpio::GetIOCalls(), or one per
+      spidev message) and result.  para_spitrace keeps the totals and
+      log2 histograms of each: bin 0 counts zeros and bin n counts values
+      from 2^(n-1) to 2^n - 1, the last bin everything larger.
+
+  Wide segments:
+
+    A dual (nWidth 2) segment uses MOSI/MISO as IO0/IO1, a quad (nWidth 4)
+      segment also uses IO2/IO3 from AddQuadPins().  Each clock carries
+      the high bits of the byte on the highest IO, i.e. IO3 = bit 7 on
+      the first quad clock.  Wide segments are half-duplex: the data
+      lines are turned to outputs for a segment with pTx or to inputs for
+      one without, which is also how to clock dummy cycles with the lines
+      released (e.g. Read(NULL, 2, 4) is 4 dummy clocks).  A segment with
+      both pTx and pRx is para_badarg, a quad segment without IO2/IO3 is
+      para_notopen.  The lines go back to single-bit use at the next
+      single segment or the end of the transaction.
+
+  spidev:
+
+    Xfer() of a multiple of 8 bits is sent as bytes MSB-first, other
+      sizes use the controller's bits-per-word setting, which many
+      controllers don't support.  A Transfer() is one SPI_IOC_MESSAGE, so
+      its total length is limited by the spidev bufsiz module parameter
+      (default 4096 bytes), returning para_outofrange if larger.  The
+      device calls are protected virtual functions DevOpen, DevConfig and
+      DevMessage, which a derived class may override to stand in for a
+      device, e.g. a loopback for testing (see spitest -L).  Wide
+      segments set tx_nbits / rx_nbits, the device tree must give the
+      device spi-tx-bus-width / spi-rx-bus-width to match.
+
+  Kernels:
+
+    The bit loop is a template, ShiftK<CPOL, CPHA, DIR>, instantiated for
+      all four clock modes and each direction (DIR bit 0 = send, bit 1 =
+      receive), so each of the 16 copies contains only the pin operations
+      that mode needs with no tests inside the loop.  SetMode() picks the
+      four kernels for the mode and each transfer then picks by direction.
+
+    With para_bkmmio each kernel looks up the CLK / MOSI MASK_DATA words
+      and the MISO DATA_RO register once per call (see para_pinmmio) and
+      then stores and loads them directly, so an edge is one register
+      store.  With the other backends the kernels still go through
+      SetPin() for every edge, where the system call per edge costs far
+      more than the loop around it, so there they are no faster than the
+      generic loop.
+
+    Wide segments do the same in ShiftWideM: the MASK_DATA words for
+      both clock levels and every nibble are built once per segment, so
+      with CLK and the IO lines in one half-bank each edge is one store
+      carrying the clock and the data together.  Elsewhere a wide clock
+      is two SetMasked() calls, the data going out with an edge.
+
+  Transaction builder:
+
+    CParaSpiXact collects up to SPIMAXSEGS segments for one transaction.
+      Its member functions return 0 or para_outofmemory if full.
+
+    Write(const uint8_t *pTx, size_t nLen, int nWidth=1) - Adds a
+      send-only segment, nWidth 2 or 4 for dual / quad.
+    Read(uint8_t *pRx, size_t nLen, int nWidth=1) - Adds a receive-only
+      segment, nWidth as above.
+    Duplex(const uint8_t *pTx, uint8_t *pRx, size_t nLen) - Adds a
+      full-duplex (single-bit) segment.
+    Clear() - Removes all segments so the builder may be re-used.
+
+    For example, reading 256 bytes from a SPI flash:
+
+      uint8_t cmd[4] = { 0x03, addr >> 16, addr >> 8, addr };
+      CParaSpiXact  xact;
+      xact.Write(cmd, 4);
+      xact.Read(buf, 256);
+      spi.Transfer(xact);
+
+    Or the same with a quad-output read (0x6B), 8 dummy clocks then
+      4 bits per clock:
+
+      uint8_t cmd[5] = { 0x6B, addr >> 16, addr >> 8, addr, 0 };
+      xact.Write(cmd, 5);
+      xact.Read(buf, 256, 4);
+
   Inherited functions:
 
+    SetBackend(para_gpiobackend eBackend) - Selects the pin access method,
+      see para_gpio.h.  Must be called before AssignPins().
+
     IsOK() - Checks that all pin assignments were successful, returns
       true if no errors have occurred during pin assignment, including
       if no pins have been asssigned, returns false otherwise.
 
-    Close() - Releases all pins from the object.  This happens automatically
-      when the object is destroyed.  New pins may be added with AddPin()
+    Close() - Releases all pins (and any spidev device) from the object.
+      This happens automatically when the object is destroyed.  New pins may be added with AddPin()
       after calling this functions.
 
   Modes:
@@ -105,12 +307,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
   Caveats:
 
-    There has been no attempt to make this thread-safe.  It is intended
-      (but as yet untested) that multiple objects may be created that share
-      clock and miso/mosi lines but have different enables.  This will only
-      work if only one object can have an active Read or Write operation at
-      any time.  The class itself does not enforce this, the application
-      must.
+    There has been no attempt to make this thread-safe.  To share the
+      clock and miso/mosi lines between several devices with different
+      enables, use CParaSpiBus (para_spibus.h) rather than several
+      CParaSpi objects, it serializes transactions between threads.
 
 */
 
@@ -118,23 +318,180 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PARA_SPI_H
 
 #include <stdlib.h>  // for NULL
+#include <stdint.h>
+#include <pthread.h>
+#include <linux/spi/spidev.h>
 #include "para_gpio.h"
 
+#define SPIMAXSEGS 16
+
+typedef struct {
+  const uint8_t *pTx;   // NULL to send 0s
+  uint8_t *pRx;         // NULL to discard
+  size_t nLen;
+  int nWidth;           // data lines used, 1 (or 0), 2 or 4
+} para_spiseg;
+
+#define SPIDEVBATCH 4096  // most bytes batched into one spidev message
+
+typedef struct {
+  const para_spiseg *pSegs;
+  int nSegs;
+  int nResult;          // set by TransferBatch()
+} para_spibatch;
+
+class CParaSpiXact {
+ protected:
+  para_spiseg m_segs[SPIMAXSEGS];
+  int m_nSegs;
+
+  int Add(const uint8_t *pTx, uint8_t *pRx, size_t nLen, int nWidth);
+
+ public:
+  CParaSpiXact() { m_nSegs = 0; }
+  int Duplex(const uint8_t *pTx, uint8_t *pRx, size_t nLen) { return Add(pTx, pRx, nLen, 1); }
+  int Write(const uint8_t *pTx, size_t nLen, int nWidth=1) { return Add(pTx, NULL, nLen, nWidth); }
+  int Read(uint8_t *pRx, size_t nLen, int nWidth=1) { return Add(NULL, pRx, nLen, nWidth); }
+  void Clear() { m_nSegs = 0; }
+  const para_spiseg *GetSegs() { return m_segs; }
+  int GetNSegs() { return m_nSegs; }
+};
+
+typedef struct {
+  unsigned nTargetHz;
+  double dAchievedHz;
+  unsigned long long nEdges;
+  unsigned nLateMaxNS;
+  double dJitterNS;
+  unsigned nSleepNS;
+  unsigned nPinNS;
+} para_spiclk;
+
+#define SPITRACEBINS 32
+
+typedef struct {
+  unsigned long long tStart;  // CLOCK_MONOTONIC nsec
+  unsigned nNS;
+  unsigned nBits;
+  unsigned nCalls;
+  int nResult;
+} para_spirec;
+
+typedef struct {
+  unsigned long long nXacts;
+  unsigned long long nErrors;
+  unsigned long long nTotalNS;
+  unsigned long long nTotalBits;
+  unsigned long long nTotalCalls;
+  unsigned nMaxNS;
+  unsigned long long nNSHist[SPITRACEBINS];
+  unsigned long long nBitsHist[SPITRACEBINS];
+  unsigned long long nCallsHist[SPITRACEBINS];
+} para_spitrace;
+
+typedef enum {
+  para_spigpio,
+  para_spidev
+} para_spipath;
+
 class CParaSpi : public CParaGpio {
  protected:
   int m_nCPOL;
   int m_nCPHA;
   int m_nEPOL;
+  int m_nCEPin;           // pin # of the enable in use, see CParaSpiBus
+  bool m_bLSBFirst;
+  bool m_bGeneric;
+
+  typedef int (CParaSpi::*SpiKernel)(int nBits, const unsigned *pWVal, unsigned *pRVal);
+  SpiKernel m_pKernels[4];   // by DIR, for the current mode
+  static const SpiKernel spiKernels[2][2][4];  // by CPOL, CPHA, DIR
+
+  template<int CPOL, int CPHA, int DIR>
+  int ShiftK(int nBits, const unsigned *pWVal, unsigned *pRVal);
+  template<int CPOL, int CPHA, int DIR>
+  int ShiftM(int nBits, const unsigned *pWVal, unsigned *pRVal);
+  int ShiftGeneric(int nBits, const unsigned *pWVal, unsigned *pRVal);
+  int Shift(int nBits, const unsigned *pWVal, unsigned *pRVal);
+  int ShiftBytes(const uint8_t *pTx, uint8_t *pRx, size_t nLen);
+
+  int m_nIO2Pin;            // pin #s of IO2 / IO3, -1 if not assigned
+  int m_nIO3Pin;
+  unsigned long long m_nDataOut;      // data pins currently outputs
+  unsigned long long m_nWideOut[16];  // pin values for each nibble
+  unsigned long long SingleOut();
+  int SetDataDir(unsigned long long nOut);
+  int ShiftWide(const uint8_t *pTx, uint8_t *pRx, size_t nLen, int nWidth);
+  int ShiftWideM(const uint8_t *pTx, uint8_t *pRx, size_t nLen, int nWidth);
+
+  unsigned m_nHalfNS;       // paced half-period, 0 = free-running
+  unsigned long long m_tNext;       // time of the next paced edge
+  unsigned long long m_tFirst;      // first & last edge of this transaction
+  unsigned long long m_tLast;
+  unsigned long long m_nXactEdges;
+  unsigned long long m_nPaceNS;     // sums over paced transactions
+  unsigned long long m_nPaceHalves;
+  double m_dLateSq;
+  para_spiclk m_clk;
+  void PaceStart();
+  unsigned long long PaceWait();
+  void Pace();
+  void PaceEnd();
+
+  int m_fdDev;
+  unsigned m_nSpeedHz;
+
+  para_spitrace *m_pTrace;  // NULL unless tracing
+  para_spirec *m_pRing;
+  int m_nRing;
+  int m_nRingNext;
+  char *m_strDump;
+  CParaSpi *m_pTraceNext;   // objects to dump at exit
+  static CParaSpi *spiTraced;
+  static pthread_mutex_t spiTraceMutex;  // guards spiTraced
+  static void TraceExit();
+  void TraceAdd(unsigned long long tStart, unsigned nBits,
+                unsigned long long nCalls, int nResult);
+  int XferBits(int nBits, unsigned *pWVal, unsigned *pRVal);
+  int TransferSegs(const para_spiseg *pSegs, int nSegs);
+  int CheckSegs(const para_spiseg *pSegs, int nSegs);
+
+  virtual int DevOpen(const char *strDev);
+  virtual int DevConfig();
+  virtual int DevMessage(struct spi_ioc_transfer *pXfers, int nXfers);
+  int DevXfer(int nBits, const unsigned *pWVal, unsigned *pRVal);
+  int DevTransfer(const para_spiseg *pSegs, int nSegs);
+  int DevBatch(para_spibatch *pXacts, int nXacts);
 
  public:
   CParaSpi();
   CParaSpi(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder,
         int nCPOL=0, int nCPHA=0, int nEPOL=0);
-  ~CParaSpi();
+  virtual ~CParaSpi();
   int AssignPins(int nClk, int nMOSI, int nMISO, int nCE, bool bPorcuOrder=false);
+  int AddQuadPins(int nIO2, int nIO3, bool bPorcuOrder=false);
   int SetMode(int nCPOL, int nCPHA, int nEPOL);
+  int OpenDevice(const char *strDev=NULL, unsigned nSpeedHz=0);
+  void CloseDevice();
+  para_spipath GetPath() { return m_fdDev >= 0 ? para_spidev : para_spigpio; }
+  void Close();
   int Xfer(int nBits, unsigned nWVal, unsigned *pRVal=NULL);
   int Xfer(int nBits, unsigned *pWVal, unsigned *pRVal=NULL);
+  void SetBitOrder(bool bLSBFirst) { m_bLSBFirst = bLSBFirst; }
+  void SetGeneric(bool bGeneric) { m_bGeneric = bGeneric; }
+  int SetClockRate(unsigned nHz);
+  int GetClockStats(para_spiclk *pStats);
+  void ResetClockStats();
+  int EnableTrace(int nRing=64, const char *strDump=NULL);
+  void DisableTrace();
+  void ResetTrace();
+  int GetTrace(para_spitrace *pTrace);
+  int GetTraceRecs(para_spirec *pRecs, int *pnRecs);
+  int DumpTrace(const char *strFile=NULL);
+  int Transfer(const uint8_t *pTx, uint8_t *pRx, size_t nLen);
+  int Transfer(const para_spiseg *pSegs, int nSegs);
+  int Transfer(CParaSpiXact &xact) { return Transfer(xact.GetSegs(), xact.GetNSegs()); }
+  int TransferBatch(para_spibatch *pXacts, int nXacts);
 
 };
 
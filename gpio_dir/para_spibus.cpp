@@ -0,0 +1,271 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_spibus.cpp
+  See the header file para_spibus.h for description & usage info.
+
+*/
+
+#include "para_spibus.h"
+
+#define SPICLKPIN  0
+#define SPIMOSIPIN 1
+#define SPIMISOPIN 2
+
+CParaSpiDev::CParaSpiDev(CParaSpiBus *pBus, int nCEPin, int nCPOL, int nCPHA,
+                         int nEPOL) {
+
+  m_pBus = pBus;
+  m_nCEPin = nCEPin;
+  m_bLSBFirst = false;
+  m_nCPOL = nCPOL ? 1 : 0;
+  m_nCPHA = nCPHA ? 1 : 0;
+  m_nEPOL = nEPOL ? 1 : 0;
+}
+
+// The mode is read by Acquire(), so change it only while holding the bus
+int CParaSpiDev::SetMode(int nCPOL, int nCPHA, int nEPOL) {
+
+  m_pBus->Lock();
+  m_nCPOL = nCPOL ? 1 : 0;
+  m_nCPHA = nCPHA ? 1 : 0;
+  m_nEPOL = nEPOL ? 1 : 0;
+  m_pBus->Release();
+
+  return para_ok;
+}
+
+void CParaSpiDev::SetBitOrder(bool bLSBFirst) {
+
+  m_pBus->Lock();
+  m_bLSBFirst = bLSBFirst;
+  m_pBus->Release();
+}
+
+int CParaSpiDev::Xfer(int nBits, unsigned nWVal, unsigned *pRVal/*=NULL*/) {
+
+  return Xfer(nBits, &nWVal, pRVal);
+}
+
+int CParaSpiDev::Xfer(int nBits, unsigned *pWVal, unsigned *pRVal/*=NULL*/) {
+  int res;
+
+  res = m_pBus->Acquire(this);
+  if(res == para_ok)
+    res = m_pBus->CParaSpi::Xfer(nBits, pWVal, pRVal);
+  m_pBus->Release();
+
+  return res;
+}
+
+int CParaSpiDev::Transfer(const uint8_t *pTx, uint8_t *pRx, size_t nLen) {
+  int res;
+
+  res = m_pBus->Acquire(this);
+  if(res == para_ok)
+    res = m_pBus->CParaSpi::Transfer(pTx, pRx, nLen);
+  m_pBus->Release();
+
+  return res;
+}
+
+int CParaSpiDev::Transfer(const para_spiseg *pSegs, int nSegs) {
+  int res;
+
+  res = m_pBus->Acquire(this);
+  if(res == para_ok)
+    res = m_pBus->CParaSpi::Transfer(pSegs, nSegs);
+  m_pBus->Release();
+
+  return res;
+}
+
+CParaSpiBus::CParaSpiBus() {
+
+  Init();
+}
+
+CParaSpiBus::CParaSpiBus(int nClk, int nMOSI, int nMISO, bool bPorcuOrder/*=false*/) {
+
+  Init();
+  AssignPins(nClk, nMOSI, nMISO, bPorcuOrder);
+}
+
+CParaSpiBus::~CParaSpiBus() {
+  int n;
+
+  for(n = 0; n < m_nDevs; n++)
+    delete m_pDevs[n];
+
+  pthread_cond_destroy(&m_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+int CParaSpiBus::AssignPins(int nClk, int nMOSI, int nMISO,
+                            bool bPorcuOrder/*=false*/) {
+  int ids[3] = { nClk, nMOSI, nMISO };
+  int res;
+
+  if(nPins)
+    return para_alreadyopen;
+
+  res = AddPins(ids, 3, bPorcuOrder);
+  if(res)
+    return res;
+
+  // The clock is set up with the first device's mode
+  res = SetDirection(1 << SPIMOSIPIN, para_dirout);
+  if(res)
+    return res;
+
+  return SetDirection(1 << SPIMISOPIN, para_dirin);
+}
+
+CParaSpiDev *CParaSpiBus::AddDevice(int nCE, int nCPOL/*=0*/, int nCPHA/*=0*/,
+                                    int nEPOL/*=0*/, bool bPorcuOrder/*=false*/) {
+  CParaSpiDev *pDev;
+  int pin;
+
+  if(nPins < 3 || m_nDevs >= SPIMAXDEVS)
+    return NULL;
+
+  if(AddPin(nCE, bPorcuOrder) != para_ok)
+    return NULL;
+
+  pin = nPins - 1;
+  pDev = new CParaSpiDev(this, pin, nCPOL, nCPHA, nEPOL);
+  m_pDevs[m_nDevs++] = pDev;
+
+  // Adding a pin may have re-requested the whole group, so set up
+  // every pin again
+  if(Restore() != para_ok) {
+    delete m_pDevs[--m_nDevs];
+    DropPins(pin);
+    Restore();  // and again for the group without it
+    return NULL;
+  }
+
+  return pDev;
+}
+
+// Internal functions
+void CParaSpiBus::Init() {
+
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_cond, NULL);
+  m_nTicket = m_nServing = 0;
+  m_nDevs = 0;
+  m_bModeSet = false;
+  m_nModeChanges = 0;
+}
+
+// Set all pins to their idle state, the bus in the first device's mode
+int CParaSpiBus::Restore() {
+  int n, res;
+
+  if(!m_nDevs) {
+    m_bModeSet = false;
+    res = SetDirection(1 << SPIMOSIPIN, para_dirout);
+    if(res) return res;
+    return SetDirection(1 << SPIMISOPIN, para_dirin);
+  }
+
+  for(n = 0; n < m_nDevs; n++) {
+
+    // Enable = inactive
+    res = SetDirection(1ULL << m_pDevs[n]->m_nCEPin, para_dirout);
+    if(res) return res;
+    res = SetPin(m_pDevs[n]->m_nCEPin, 1 - m_pDevs[n]->m_nEPOL);
+    if(res) return res;
+  }
+
+  m_nCEPin = m_pDevs[0]->m_nCEPin;
+  res = SetMode(m_pDevs[0]->m_nCPOL, m_pDevs[0]->m_nCPHA, m_pDevs[0]->m_nEPOL);
+  m_bModeSet = (res == para_ok);
+
+  return res;
+}
+
+// Wait for our turn on the bus, then set it up for pDev.  Must always
+// be followed by Release(), even on error.
+int CParaSpiBus::Acquire(CParaSpiDev *pDev) {
+  int n, res;
+
+  Lock();
+
+  m_nCEPin = pDev->m_nCEPin;
+  m_bLSBFirst = pDev->m_bLSBFirst;
+
+  // Only the clock's idle level needs a pin change, the phase just
+  // picks other kernels and the enable polarity which level we drive
+  // for this device
+  if(!m_bModeSet || pDev->m_nCPOL != m_nCPOL) {
+
+    res = SetPin(SPICLKPIN, pDev->m_nCPOL);
+    if(res)
+      return res;
+
+    if(m_bModeSet)
+      m_nModeChanges++;
+    m_bModeSet = true;
+  }
+
+  m_nCPOL = pDev->m_nCPOL;
+  m_nCPHA = pDev->m_nCPHA;
+  m_nEPOL = pDev->m_nEPOL;
+
+  for(n = 0; n < 4; n++)
+    m_pKernels[n] = spiKernels[m_nCPOL][m_nCPHA][n];
+
+  return para_ok;
+}
+
+// Wait for our turn on the bus without touching it, must be followed
+// by Release()
+void CParaSpiBus::Lock() {
+  unsigned ticket;
+
+  // Tickets are served strictly in order, so no thread can starve
+  pthread_mutex_lock(&m_mutex);
+  ticket = m_nTicket++;
+  while(ticket != m_nServing)
+    pthread_cond_wait(&m_cond, &m_mutex);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void CParaSpiBus::Release() {
+
+  pthread_mutex_lock(&m_mutex);
+  m_nServing++;
+  pthread_cond_broadcast(&m_cond);
+  pthread_mutex_unlock(&m_mutex);
+}
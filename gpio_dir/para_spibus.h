@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_spibus.h
+
+  Header file for the para_spibus library, which shares one set of SPI
+  clock / MOSI / MISO pins between several devices, each with its own
+  enable pin and mode.  The bus object owns the shared pins and hands
+  out a device handle per enable.  Transactions through the handles may
+  come from any number of threads, they are run one at a time in the
+  order they were requested, and the clock idle level is only changed
+  when a transaction needs a different mode than the one before.
+
+  CParaSpiBus member functions:
+
+    Except for the constructors and AddDevice, all functions return 0
+      (success) or an error code.
+
+    CParaSpiBus() - Constructs a bus with no pins assigned.
+
+    CParaSpiBus(int nClk, int nMOSI, int nMISO, bool bPorcuOrder=false) -
+      Constructs a bus on the given shared pins, see AssignPins.
+
+    AssignPins(int nClk, int nMOSI, int nMISO, bool bPorcuOrder=false) -
+      Assigns the shared pins.  Use SetBackend() (inherited from
+      CParaGpio) first to select the pin access method.
+
+    AddDevice(int nCE, int nCPOL=0, int nCPHA=0, int nEPOL=0,
+        bool bPorcuOrder=false) - Adds a device with its enable on pin
+      nCE and the given mode, see para_spi.h.  The enable is set
+      inactive at once.  Returns a handle owned by the bus, deleted with
+      it, or NULL on error.  Add all devices before starting any
+      threads that use the bus.
+
+    GetModeChanges() - Returns the number of times the clock's idle
+      level had to change for a device with a different CPOL.  A
+      different CPHA or enable polarity costs no pin changes and is not
+      counted.
+
+  CParaSpiDev member functions:
+
+    These are the same as for CParaSpi and work the same way, except that
+      each call is one complete transaction on the bus:
+
+    SetMode(int nCPOL, int nCPHA, int nEPOL) - Takes effect at the next
+      transaction, waiting for the bus if another is in progress.
+    SetBitOrder(bool bLSBFirst) - Same.
+    Xfer(int nBits, unsigned nWVal, unsigned *pRVal=NULL)
+    Xfer(int nBits, unsigned *pWVal, unsigned *pRVal=NULL)
+    Transfer(const uint8_t *pTx, uint8_t *pRx, size_t nLen)
+    Transfer(const para_spiseg *pSegs, int nSegs)
+    Transfer(CParaSpiXact &xact)
+
+  Caveats:
+
+    The bus is always bit-banged on the GPIO pins, $PARA_SPIDEV is not
+      used.  Don't call the CParaSpi transfer functions of the bus object
+      directly, they bypass the queue.
+
+*/
+
+#ifndef PARA_SPIBUS_H
+#define PARA_SPIBUS_H
+
+#include <pthread.h>
+#include "para_spi.h"
+
+#define SPIMAXDEVS  (MAXPINSPEROBJECT - 3)
+
+class CParaSpiBus;
+
+class CParaSpiDev {
+ protected:
+  CParaSpiBus *m_pBus;
+  int m_nCEPin;
+  int m_nCPOL;
+  int m_nCPHA;
+  int m_nEPOL;
+  bool m_bLSBFirst;
+
+  friend class CParaSpiBus;
+  CParaSpiDev(CParaSpiBus *pBus, int nCEPin, int nCPOL, int nCPHA, int nEPOL);
+
+ public:
+  int SetMode(int nCPOL, int nCPHA, int nEPOL);
+  void SetBitOrder(bool bLSBFirst);
+  int Xfer(int nBits, unsigned nWVal, unsigned *pRVal=NULL);
+  int Xfer(int nBits, unsigned *pWVal, unsigned *pRVal=NULL);
+  int Transfer(const uint8_t *pTx, uint8_t *pRx, size_t nLen);
+  int Transfer(const para_spiseg *pSegs, int nSegs);
+  int Transfer(CParaSpiXact &xact) { return Transfer(xact.GetSegs(), xact.GetNSegs()); }
+};
+
+class CParaSpiBus : public CParaSpi {
+ protected:
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_cond;
+  unsigned m_nTicket;       // next ticket to hand out
+  unsigned m_nServing;      // ticket allowed on the bus
+  CParaSpiDev *m_pDevs[SPIMAXDEVS];
+  int m_nDevs;
+  bool m_bModeSet;          // clock idle level set for the current mode
+  unsigned long long m_nModeChanges;
+
+  friend class CParaSpiDev;
+  void Init();
+  int Restore();
+  int Acquire(CParaSpiDev *pDev);
+  void Lock();
+  void Release();
+
+ public:
+  CParaSpiBus();
+  CParaSpiBus(int nClk, int nMOSI, int nMISO, bool bPorcuOrder=false);
+  ~CParaSpiBus();
+  int AssignPins(int nClk, int nMOSI, int nMISO, bool bPorcuOrder=false);
+  CParaSpiDev *AddDevice(int nCE, int nCPOL=0, int nCPHA=0, int nEPOL=0,
+                         bool bPorcuOrder=false);
+  unsigned long long GetModeChanges() { return m_nModeChanges; }
+};
+
+#endif  // PARA_SPIBUS_H
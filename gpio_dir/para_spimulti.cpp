@@ -0,0 +1,326 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_spimulti.cpp
+  See the header file para_spimulti.h for description & usage info.
+
+*/
+
+#include "para_spimulti.h"
+
+// Pin n of bus b is pin 4*b + n of the group
+#define SPICLKPIN  0
+#define SPIMOSIPIN 1
+#define SPIMISOPIN 2
+#define SPIENBPIN  3
+
+#define BUSBIT(b, pin)  (1ULL << (4 * (b) + (pin)))
+
+CParaSpiMulti::CParaSpiMulti() {
+
+  m_nCPOL = m_nCPHA = m_nEPOL = 0;
+  m_nBuses = 0;
+  m_nClkMask = m_nMosiMask = m_nMisoMask = m_nCEMask = 0;
+  m_bDirect = false;
+  m_nRegs = m_nClkRegs = m_nRO = 0;
+}
+
+CParaSpiMulti::~CParaSpiMulti() {
+
+}
+
+int CParaSpiMulti::AssignBuses(int *pPins, int nBuses, bool bPorcuOrder/*=false*/) {
+  int b, res;
+
+  if(m_nBuses || nPins)
+    return para_alreadyopen;
+
+  if(pPins == NULL || nBuses <= 0 || nBuses > SPIMULTIMAX)
+    return para_badarg;
+
+  res = AddPins(pPins, 4 * nBuses, bPorcuOrder);
+  if(res)
+    return res;
+
+  m_nBuses = nBuses;
+
+  for(b = 0; b < nBuses; b++) {
+    m_nClkMask  |= BUSBIT(b, SPICLKPIN);
+    m_nMosiMask |= BUSBIT(b, SPIMOSIPIN);
+    m_nMisoMask |= BUSBIT(b, SPIMISOPIN);
+    m_nCEMask   |= BUSBIT(b, SPIENBPIN);
+  }
+
+  if(eBackend == para_bkmmio)
+    MapMmio();
+
+  return SetMode(m_nCPOL, m_nCPHA, m_nEPOL);
+}
+
+int CParaSpiMulti::SetMode(int nCPOL/*=0*/, int nCPHA/*=0*/, int nEPOL/*=0*/) {
+  int res;
+
+  m_nCPOL = nCPOL ? 1 : 0;
+  m_nCPHA = nCPHA ? 1 : 0;
+  m_nEPOL = nEPOL ? 1 : 0;
+
+  if(!bIsOK || !m_nBuses)
+    return para_notopen;
+
+  res = SetDirection(m_nCEMask | m_nClkMask | m_nMosiMask, para_dirout);
+  if(res) return res;
+
+  // Enables inactive, clocks idle
+  res = SetMasked(m_nCEMask | m_nClkMask,
+                  (m_nEPOL ? 0 : m_nCEMask) | (m_nCPOL ? m_nClkMask : 0));
+  if(res) return res;
+
+  return SetDirection(m_nMisoMask, para_dirin);
+}
+
+int CParaSpiMulti::Xfer(int nBits, const unsigned *pWVals, unsigned *pRVals/*=NULL*/) {
+  int b, res, ret;
+
+  if(nBits <= 0 || nBits > 32)
+    return para_badarg;
+
+  if(!m_nBuses)
+    return para_notopen;
+
+  if(pRVals)
+    for(b = 0; b < m_nBuses; b++)
+      pRVals[b] = 0;
+
+  // Enables = active, all buses at once
+  res = SetMasked(m_nCEMask, m_nEPOL ? m_nCEMask : 0);
+  if(res)
+    return res;
+
+  ret = Shift(nBits, pWVals, pRVals);
+
+  // Enables = inactive, even after an error
+  res = SetMasked(m_nCEMask, m_nEPOL ? 0 : m_nCEMask);
+
+  return ret ? ret : res;
+}
+
+int CParaSpiMulti::Transfer(const uint8_t * const *ppTx, uint8_t * const *ppRx,
+                            size_t nLen) {
+  unsigned wvals[SPIMULTIMAX], rvals[SPIMULTIMAX];
+  size_t n;
+  int b, res, ret = para_ok;
+
+  if(!m_nBuses)
+    return para_notopen;
+
+  res = SetMasked(m_nCEMask, m_nEPOL ? m_nCEMask : 0);
+  if(res)
+    return res;
+
+  for(n = 0; n < nLen; n++) {
+
+    for(b = 0; b < m_nBuses; b++) {
+      wvals[b] = (ppTx && ppTx[b]) ? ppTx[b][n] : 0;
+      rvals[b] = 0;
+    }
+
+    ret = Shift(8, wvals, ppRx ? rvals : NULL);
+    if(ret)
+      break;
+
+    for(b = 0; ppRx && b < m_nBuses; b++)
+      if(ppRx[b])
+        ppRx[b][n] = rvals[b];
+  }
+
+  // Enables = inactive, even after an error
+  res = SetMasked(m_nCEMask, m_nEPOL ? 0 : m_nCEMask);
+
+  return ret ? ret : res;
+}
+
+// Internal functions
+
+// Look up the MASK_DATA word and bit of every clock and MOSI pin and the
+// DATA_RO word of every MISO pin, grouping pins that share a word, for
+// ShiftM().  Leaves m_bDirect false if any pin has no register bit.
+void CParaSpiMulti::MapMmio() {
+  para_mmiobit bit;
+  int b, p, r;
+
+  m_bDirect = false;
+  m_nRegs = m_nClkRegs = m_nRO = 0;
+
+  for(b = 0; b < m_nBuses; b++) {
+
+    for(p = SPICLKPIN; p <= SPIMOSIPIN; p++) {
+
+      if(para_pinmmio(pMmio, 4 * b + p, &bit))
+        return;
+
+      for(r = 0; r < m_nRegs && m_pReg[r] != bit.pMaskData; r++)
+        ;
+      if(r == m_nRegs) {
+        m_pReg[m_nRegs++] = bit.pMaskData;
+        m_nKeep[r] = m_nClkKeep[r] = ~0U;
+        m_nClkHigh[r] = 0;
+      }
+
+      // nLow is the inverted write mask with the data bit clear
+      m_nKeep[r] &= bit.nLow;
+      if(p == SPICLKPIN) {
+        if(!m_nClkHigh[r])
+          m_nClkRegs++;
+        m_nClkKeep[r] &= bit.nLow;
+        m_nClkHigh[r] |= bit.nHigh & 0xFFFF;
+      } else {
+        m_nMosiReg[b] = r;
+        m_nMosiHigh[b] = bit.nHigh & 0xFFFF;
+      }
+    }
+
+    if(para_pinmmio(pMmio, 4 * b + SPIMISOPIN, &bit))
+      return;
+
+    for(r = 0; r < m_nRO && m_pRO[r] != bit.pDataRO; r++)
+      ;
+    if(r == m_nRO)
+      m_pRO[m_nRO++] = bit.pDataRO;
+    m_nMisoRO[b] = r;
+    m_nMisoBit[b] = bit.nBit;
+  }
+
+  m_bDirect = true;
+}
+
+// Shift nBits on all buses with the enables already active, pRVals
+// must be cleared by the caller
+int CParaSpiMulti::Shift(int nBits, const unsigned *pWVals, unsigned *pRVals) {
+  unsigned long long mosi, miso, lead, trail;
+  int n, b, res;
+
+  if(m_bDirect && eBackend == para_bkmmio)
+    return ShiftM(nBits, pWVals, pRVals);
+
+  lead  = m_nCPOL ? 0 : m_nClkMask;   // clock level after the leading edge
+  trail = m_nCPOL ? m_nClkMask : 0;   // and after the trailing edge
+
+  for(n = nBits-1; n >= 0; n--) {
+
+    mosi = 0;
+    for(b = 0; pWVals && b < m_nBuses; b++)
+      if((pWVals[b] >> n) & 1)
+        mosi |= BUSBIT(b, SPIMOSIPIN);
+
+    // CPHA=0: data with the trailing edge (or idle clock), sample on leading
+    // CPHA=1: data with the leading edge, sample on trailing
+    res = SetMasked(m_nClkMask | m_nMosiMask, mosi | (m_nCPHA ? lead : trail));
+    if(res) return res;
+
+    res = SetMasked(m_nClkMask, m_nCPHA ? trail : lead);
+    if(res) return res;
+
+    if(pRVals) {
+      res = GetMasked(m_nMisoMask, &miso);
+      if(res) return res;
+
+      for(b = 0; b < m_nBuses; b++)
+        pRVals[b] |= ((miso & BUSBIT(b, SPIMISOPIN)) ? 1U : 0U) << n;
+    }
+  }
+
+  // Finish with the clock idle
+  if(!m_nCPHA)
+    return SetMasked(m_nClkMask, trail);
+
+  return para_ok;
+}
+
+// Shift() for para_bkmmio, storing the words MapMmio() found directly
+int CParaSpiMulti::ShiftM(int nBits, const unsigned *pWVals, unsigned *pRVals) {
+  unsigned words[2 * SPIMULTIMAX], vals[SPIMULTIMAX];
+  unsigned first, second;
+  unsigned long long mosi = 0, calls = 0;
+  int n, b, r;
+
+  if((pMmio->nOutMask & (m_nClkMask | m_nMosiMask)) != (m_nClkMask | m_nMosiMask))
+    return para_nodir;
+
+  // Clock level (1 = high) with the data, then on its own, as Shift()
+  first  = m_nCPHA ? 1 - m_nCPOL : m_nCPOL;
+  second = m_nCPHA ? m_nCPOL : 1 - m_nCPOL;
+
+  for(n = nBits-1; n >= 0; n--) {
+
+    for(r = 0; r < m_nRegs; r++)
+      words[r] = m_nKeep[r] | (first ? m_nClkHigh[r] : 0);
+    for(b = 0; pWVals && b < m_nBuses; b++)
+      if((pWVals[b] >> n) & 1)
+        words[m_nMosiReg[b]] |= m_nMosiHigh[b];
+
+    for(r = 0; r < m_nRegs; r++)
+      *m_pReg[r] = words[r];
+
+    for(r = 0; r < m_nRegs; r++)
+      if(m_nClkHigh[r])
+        *m_pReg[r] = m_nClkKeep[r] | (second ? m_nClkHigh[r] : 0);
+
+    calls += m_nRegs + m_nClkRegs;
+
+    if(pRVals) {
+      for(r = 0; r < m_nRO; r++)
+        vals[r] = *m_pRO[r];
+      calls += m_nRO;
+
+      for(b = 0; b < m_nBuses; b++)
+        pRVals[b] |= ((vals[m_nMisoRO[b]] >> m_nMisoBit[b]) & 1) << n;
+    }
+  }
+
+  // Finish with the clock idle
+  if(!m_nCPHA) {
+    for(r = 0; r < m_nRegs; r++)
+      if(m_nClkHigh[r])
+        *m_pReg[r] = m_nClkKeep[r] | (m_nCPOL ? m_nClkHigh[r] : 0);
+    calls += m_nClkRegs;
+  }
+
+  // Keep the shadow in step with what was driven
+  for(b = 0; pWVals && b < m_nBuses; b++)
+    if(pWVals[b] & 1)
+      mosi |= BUSBIT(b, SPIMOSIPIN);
+  nShadow = (nShadow & ~(m_nClkMask | m_nMosiMask)) | (m_nCPOL ? m_nClkMask : 0) | mosi;
+  nKnown |= m_nClkMask | m_nMosiMask;
+  nIOCalls += calls;
+
+  return para_ok;
+}
@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_spimulti.h
+
+  Header file for the para_spimulti library, which runs several
+  identical SPI buses in lock-step.  Each bus has its own clock, MOSI,
+  MISO and enable pins, all in one CParaGpio group, and every half
+  clock is a single SetMasked() of all the buses' clock and MOSI pins,
+  followed by a single read of all the MISO pins which is then split
+  back out per bus.  So N buses cost about the same backend calls as
+  one.  With para_bkmmio the clock and MOSI bits of every bus are
+  mapped to their MASK_DATA words once in AssignBuses(), and each half
+  clock is then one register store per half-bank used and each sample
+  one DATA_RO load per bank, see Kernels below.
+
+  This class is derived from the Parallella GPIO Class, Member functions:
+
+    Except for the constructors, all functions return 0 (success) or an
+      error code.
+
+    CParaSpiMulti() - Constructs an object with no buses.
+
+    AssignBuses(int *pPins, int nBuses, bool bPorcuOrder=false) - Assigns
+      nBuses buses (at most SPIMULTIMAX), pPins holding the clock, MOSI,
+      MISO and enable GPIO IDs of the first bus, then of the second, etc.
+
+    SetMode(int nCPOL=0, int nCPHA=0, int nEPOL=0) - Sets the mode of all
+      buses, see para_spi.h.
+
+    GetNBuses() - Returns the number of buses assigned.
+
+    Xfer(int nBits, const unsigned *pWVals, unsigned *pRVals=NULL) -
+      Transfers nBits bits (up to 32) MSB-first on every bus at once,
+      sending pWVals[b] on bus b and receiving into pRVals[b].  Either
+      array may be NULL as for CParaSpi::Xfer().
+
+    Transfer(const uint8_t * const *ppTx, uint8_t * const *ppRx,
+        size_t nLen) - Transfers nLen bytes on every bus at once as one
+      transaction, bus b sending from ppTx[b] and receiving into ppRx[b].
+      Either array, or any entry of it, may be NULL.
+
+  Timing:
+
+    Data changes on the same write as the clock edge the mode allows it
+      to, i.e. the trailing edge for CPHA=0 (the first bit is set up with
+      the clock idle) and the leading edge for CPHA=1.  With sysfs the
+      pins of one write are set in pin order, clock before MOSI.
+
+  Kernels:
+
+    The para_bkmmio path (ShiftM) builds each register word from the
+      bus' data bits directly, with no group mask to pack or unpack per
+      bit.  It is used when every clock, MOSI and MISO pin has a Zynq
+      GPIO register bit, otherwise Shift() goes through SetMasked() /
+      GetMasked() as for the other backends.  Buses whose pins share a
+      half-bank share its store, so the fewer half-banks the buses use
+      the better; how much faster N buses are than N CParaSpi objects
+      depends on that and is best measured with spimtest.
+
+*/
+
+#ifndef PARA_SPIMULTI_H
+#define PARA_SPIMULTI_H
+
+#include <stdlib.h>  // for NULL
+#include <stdint.h>
+#include "para_gpio.h"
+
+#define SPIMULTIMAX  (MAXPINSPEROBJECT / 4)
+
+class CParaSpiMulti : public CParaGpio {
+ protected:
+  int m_nCPOL;
+  int m_nCPHA;
+  int m_nEPOL;
+  int m_nBuses;
+  unsigned long long m_nClkMask;
+  unsigned long long m_nMosiMask;
+  unsigned long long m_nMisoMask;
+  unsigned long long m_nCEMask;
+
+  // para_bkmmio registers, see MapMmio()
+  bool m_bDirect;
+  int  m_nRegs;                                // MASK_DATA words written
+  int  m_nClkRegs;                             // of which hold a clock
+  volatile unsigned *m_pReg[2 * SPIMULTIMAX];
+  unsigned m_nKeep[2 * SPIMULTIMAX];           // write mask, clocks + MOSI
+  unsigned m_nClkKeep[2 * SPIMULTIMAX];        // write mask, clocks only
+  unsigned m_nClkHigh[2 * SPIMULTIMAX];        // data bits of the clocks
+  int  m_nMosiReg[SPIMULTIMAX];
+  unsigned m_nMosiHigh[SPIMULTIMAX];
+  int  m_nRO;                                  // DATA_RO words read
+  volatile unsigned *m_pRO[SPIMULTIMAX];
+  int  m_nMisoRO[SPIMULTIMAX];
+  unsigned m_nMisoBit[SPIMULTIMAX];
+
+  void MapMmio();
+  int Shift(int nBits, const unsigned *pWVals, unsigned *pRVals);
+  int ShiftM(int nBits, const unsigned *pWVals, unsigned *pRVals);
+
+ public:
+  CParaSpiMulti();
+  ~CParaSpiMulti();
+  int AssignBuses(int *pPins, int nBuses, bool bPorcuOrder=false);
+  int SetMode(int nCPOL=0, int nCPHA=0, int nEPOL=0);
+  int GetNBuses() { return m_nBuses; }
+  int Xfer(int nBits, const unsigned *pWVals, unsigned *pRVals=NULL);
+  int Transfer(const uint8_t * const *ppTx, uint8_t * const *ppRx, size_t nLen);
+};
+
+#endif  // PARA_SPIMULTI_H
@@ -0,0 +1,298 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_spiqueue.cpp
+  See the header file para_spiqueue.h for description & usage info.
+
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "para_spiqueue.h"
+
+static unsigned long long QueueNow() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int CParaSpiFuture::Wait(int nTimeoutMS/*=-1*/) {
+  struct timespec ts;
+  unsigned long long tEnd;
+  int res = 0;
+
+  if(IsDone())
+    return m_nResult;
+
+  tEnd = QueueNow() + nTimeoutMS * 1000000ULL;
+  ts.tv_sec = tEnd / 1000000000ULL;
+  ts.tv_nsec = tEnd % 1000000000ULL;
+
+  pthread_mutex_lock(&m_pQueue->m_mutex);
+  while(!m_nDone && res != ETIMEDOUT) {
+    if(nTimeoutMS < 0)
+      pthread_cond_wait(&m_pQueue->m_condDone, &m_pQueue->m_mutex);
+    else
+      res = pthread_cond_timedwait(&m_pQueue->m_condDone, &m_pQueue->m_mutex, &ts);
+  }
+  pthread_mutex_unlock(&m_pQueue->m_mutex);
+
+  return IsDone() ? m_nResult : para_timeout;
+}
+
+CParaSpiQueue::CParaSpiQueue(int nDepth/*=64*/) {
+  pthread_condattr_t attr;
+  unsigned size;
+
+  // Round up to a power of 2, so the free-running head & tail counters
+  // still index correctly when they wrap
+  for(size = 1; size < (unsigned)nDepth; size <<= 1)
+    ;
+
+  m_nSize = size;
+  m_pEntries = (para_spiqentry *)malloc(m_nSize * sizeof(para_spiqentry));
+  if(m_pEntries == NULL)
+    m_nSize = 0;
+  m_nHead = m_nTail = 0;
+  m_bRunning = m_bStop = false;
+  memset(&m_stats, 0, sizeof(m_stats));
+  m_nTotLatNS = 0;
+
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_condWork, NULL);
+
+  // Futures wait with a CLOCK_MONOTONIC deadline
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&m_condDone, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+CParaSpiQueue::~CParaSpiQueue() {
+
+  Stop();
+  pthread_cond_destroy(&m_condDone);
+  pthread_cond_destroy(&m_condWork);
+  pthread_mutex_destroy(&m_mutex);
+  free(m_pEntries);
+}
+
+int CParaSpiQueue::Start() {
+
+  if(m_bRunning)
+    return para_alreadyopen;
+
+  if(m_pEntries == NULL)
+    return para_outofmemory;
+
+  m_bStop = false;
+
+  if(pthread_create(&m_thread, NULL, ThreadProc, this))
+    return para_outofmemory;
+
+  m_bRunning = true;
+
+  return para_ok;
+}
+
+int CParaSpiQueue::Stop() {
+
+  if(!m_bRunning)
+    return para_ok;
+
+  pthread_mutex_lock(&m_mutex);
+  m_bStop = true;
+  pthread_cond_signal(&m_condWork);
+  pthread_mutex_unlock(&m_mutex);
+
+  pthread_join(m_thread, NULL);
+  m_bRunning = false;
+
+  return para_ok;
+}
+
+int CParaSpiQueue::Submit(CParaSpi *pSpi, const uint8_t *pTx, uint8_t *pRx,
+                          size_t nLen, CParaSpiFuture *pFuture/*=NULL*/,
+                          para_spicb pCallback/*=NULL*/, void *pUser/*=NULL*/) {
+  para_spiseg seg;
+
+  seg.pTx = pTx;
+  seg.pRx = pRx;
+  seg.nLen = nLen;
+  seg.nWidth = 1;
+
+  return Queue(pSpi, &seg, 1, pFuture, pCallback, pUser);
+}
+
+int CParaSpiQueue::Submit(CParaSpi *pSpi, CParaSpiXact &xact,
+                          CParaSpiFuture *pFuture/*=NULL*/,
+                          para_spicb pCallback/*=NULL*/, void *pUser/*=NULL*/) {
+
+  return Queue(pSpi, xact.GetSegs(), xact.GetNSegs(), pFuture, pCallback, pUser);
+}
+
+int CParaSpiQueue::GetStats(para_spiqstats *pStats) {
+
+  if(pStats == NULL)
+    return para_badarg;
+
+  pthread_mutex_lock(&m_mutex);
+  *pStats = m_stats;
+  pStats->nDepth = m_nHead - m_nTail;
+  pStats->nAvgLatNS = m_stats.nCompleted ? m_nTotLatNS / m_stats.nCompleted : 0;
+  pthread_mutex_unlock(&m_mutex);
+
+  return para_ok;
+}
+
+// Internal functions
+int CParaSpiQueue::Queue(CParaSpi *pSpi, const para_spiseg *pSegs, int nSegs,
+                         CParaSpiFuture *pFuture, para_spicb pCallback,
+                         void *pUser) {
+  para_spiqentry *p;
+  int depth;
+
+  if(pSpi == NULL || nSegs < 0 || nSegs > SPIMAXSEGS)
+    return para_badarg;
+
+  if(m_pEntries == NULL)
+    return para_outofmemory;
+
+  pthread_mutex_lock(&m_mutex);
+
+  if(m_nHead - m_nTail >= m_nSize) {
+    m_stats.nRejected++;
+    pthread_mutex_unlock(&m_mutex);
+    return para_outofmemory;
+  }
+
+  p = m_pEntries + (m_nHead & (m_nSize - 1));
+  p->pSpi = pSpi;
+  memcpy(p->segs, pSegs, nSegs * sizeof(para_spiseg));
+  p->nSegs = nSegs;
+  p->pFuture = pFuture;
+  p->pCallback = pCallback;
+  p->pUser = pUser;
+  p->nSubmitNS = QueueNow();
+
+  if(pFuture) {
+    pFuture->m_pQueue = this;
+    pFuture->m_nResult = para_ok;
+    __atomic_store_n(&pFuture->m_nDone, 0, __ATOMIC_RELEASE);
+  }
+
+  m_nHead++;
+  m_stats.nSubmitted++;
+  depth = m_nHead - m_nTail;
+  if(depth > m_stats.nMaxDepth)
+    m_stats.nMaxDepth = depth;
+
+  pthread_cond_signal(&m_condWork);
+  pthread_mutex_unlock(&m_mutex);
+
+  return para_ok;
+}
+
+void *CParaSpiQueue::ThreadProc(void *pArg) {
+
+  ((CParaSpiQueue *)pArg)->Run();
+
+  return NULL;
+}
+
+void CParaSpiQueue::Run() {
+  para_spibatch batch[SPIQBATCH];
+  para_spiqentry *p;
+  unsigned first, n, count;
+  unsigned long long lat;
+
+  pthread_mutex_lock(&m_mutex);
+
+  for(;;) {
+
+    while(m_nHead == m_nTail && !m_bStop)
+      pthread_cond_wait(&m_condWork, &m_mutex);
+
+    if(m_nHead == m_nTail)
+      break;  // stopping and nothing left to do
+
+    // Take the run of adjacent entries for the same device as one
+    // batch.  They stay ours until m_nTail moves past them, so Submit()
+    // may fill other slots meanwhile.
+    first = m_nTail;
+    p = m_pEntries + (first & (m_nSize - 1));
+    for(count = 1; count < SPIQBATCH && first + count != m_nHead; count++)
+      if(m_pEntries[(first + count) & (m_nSize - 1)].pSpi != p->pSpi)
+	break;
+
+    pthread_mutex_unlock(&m_mutex);
+
+    for(n = 0; n < count; n++) {
+      batch[n].pSegs = m_pEntries[(first + n) & (m_nSize - 1)].segs;
+      batch[n].nSegs = m_pEntries[(first + n) & (m_nSize - 1)].nSegs;
+    }
+
+    // Back-to-back, each with its own enable cycle
+    p->pSpi->TransferBatch(batch, count);
+
+    for(n = 0; n < count; n++) {
+      p = m_pEntries + ((first + n) & (m_nSize - 1));
+      p->nResult = batch[n].nResult;
+      p->nSubmitNS = QueueNow() - p->nSubmitNS;  // now the latency
+      if(p->pCallback)
+	p->pCallback(p->nResult, p->pUser);
+    }
+
+    pthread_mutex_lock(&m_mutex);
+
+    for(n = 0; n < count; n++) {
+      p = m_pEntries + ((first + n) & (m_nSize - 1));
+      if(p->pFuture) {
+	p->pFuture->m_nResult = p->nResult;
+	__atomic_store_n(&p->pFuture->m_nDone, 1, __ATOMIC_RELEASE);
+      }
+      lat = p->nSubmitNS;
+      m_nTotLatNS += lat;
+      if(lat > m_stats.nMaxLatNS)
+	m_stats.nMaxLatNS = lat;
+    }
+
+    m_nTail += count;
+    m_stats.nCompleted += count;
+    m_stats.nBatches++;
+    pthread_cond_broadcast(&m_condDone);
+  }
+
+  pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  para_spiqueue.h
+
+  Header file for the para_spiqueue library, which runs CParaSpi
+  transactions on a worker thread so the caller never waits for the
+  bits to be clocked out.  Transactions are queued with Submit(), run
+  back-to-back in the order submitted, and completion is reported
+  through a CParaSpiFuture the caller can poll or wait on, a callback,
+  or both.  Adjacent transactions to the same CParaSpi object, up to
+  SPIQBATCH of them, are taken from the queue as one batch and run with
+  CParaSpi::TransferBatch(), so with spidev a burst of requests to one
+  device is one SPI_IOC_MESSAGE rather than one per transaction.  Each
+  transaction in a batch still has its own chip-enable cycle and its
+  own result, and all of them complete, and their queue slots are
+  freed, when the batch has run.
+
+  CParaSpiQueue member functions:
+
+    Except for the constructors, all functions return 0 (success) or an
+      error code from para_gpio.h.
+
+    CParaSpiQueue(int nDepth=64) - Constructs a queue holding up to
+      nDepth transactions, rounded up to a power of 2.
+
+    Start() - Starts the worker thread.  Transactions may be submitted
+      before this, they will wait.
+
+    Stop() - Waits for all queued transactions to finish, then stops
+      the worker thread.  Called automatically when destroyed.
+
+    Submit(CParaSpi *pSpi, const uint8_t *pTx, uint8_t *pRx, size_t nLen,
+        CParaSpiFuture *pFuture=NULL, para_spicb pCallback=NULL,
+        void *pUser=NULL) - Queues pSpi->Transfer(pTx, pRx, nLen) and
+      returns at once, or para_outofmemory if the queue is full.  The
+      buffers must stay valid until the transaction completes.  When it
+      does, pCallback(nResult, pUser) is called on the worker thread and
+      then pFuture is marked done with the result.
+
+    Submit(CParaSpi *pSpi, CParaSpiXact &xact, ...) - Same for a
+      multi-segment transaction, the segment list is copied.
+
+    GetStats(para_spiqstats *pStats) - Fills in the counters below.
+      Latencies are from Submit() to completion, in nanoseconds.
+
+  CParaSpiFuture member functions:
+
+    IsDone() - Returns true once the transaction has completed.
+
+    Wait(int nTimeoutMS=-1) - Waits for completion up to nTimeoutMS msec
+      (-1 = forever) and returns the result of the transfer, or
+      para_timeout.
+
+    GetResult() - Returns the result of a completed transfer.
+
+    A future may be re-used for another Submit() once done.
+
+  Caveats:
+
+    The worker thread is the only one that may use a CParaSpi object
+      while it has transactions queued.
+
+*/
+
+#ifndef PARA_SPIQUEUE_H
+#define PARA_SPIQUEUE_H
+
+#include <pthread.h>
+#include "para_spi.h"
+
+#define SPIQBATCH 16  // most transactions run as one batch
+
+typedef void (*para_spicb)(int nResult, void *pUser);
+
+typedef struct {
+  unsigned long long nSubmitted;
+  unsigned long long nCompleted;
+  unsigned long long nRejected;   // queue full
+  unsigned long long nBatches;    // runs taken from the queue at once
+  unsigned long long nAvgLatNS;
+  unsigned long long nMaxLatNS;
+  int nDepth;                     // transactions waiting now
+  int nMaxDepth;                  // most ever waiting
+} para_spiqstats;
+
+class CParaSpiQueue;
+
+class CParaSpiFuture {
+ protected:
+  CParaSpiQueue *m_pQueue;
+  int m_nResult;
+  int m_nDone;
+
+  friend class CParaSpiQueue;
+
+ public:
+  CParaSpiFuture() { m_pQueue = NULL; m_nResult = para_ok; m_nDone = 1; }
+  bool IsDone() { return __atomic_load_n(&m_nDone, __ATOMIC_ACQUIRE) != 0; }
+  int Wait(int nTimeoutMS=-1);
+  int GetResult() { return m_nResult; }
+};
+
+typedef struct {
+  CParaSpi *pSpi;
+  para_spiseg segs[SPIMAXSEGS];
+  int nSegs;
+  CParaSpiFuture *pFuture;
+  para_spicb pCallback;
+  void *pUser;
+  unsigned long long nSubmitNS;
+  int nResult;
+} para_spiqentry;
+
+class CParaSpiQueue {
+ protected:
+  para_spiqentry *m_pEntries;
+  unsigned m_nSize;
+  unsigned m_nHead;     // next free entry
+  unsigned m_nTail;     // oldest queued entry
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_condWork;
+  pthread_cond_t m_condDone;
+  pthread_t m_thread;
+  bool m_bRunning;
+  bool m_bStop;
+  para_spiqstats m_stats;
+  unsigned long long m_nTotLatNS;
+
+  friend class CParaSpiFuture;
+  static void *ThreadProc(void *pArg);
+  void Run();
+  int Queue(CParaSpi *pSpi, const para_spiseg *pSegs, int nSegs,
+            CParaSpiFuture *pFuture, para_spicb pCallback, void *pUser);
+
+ public:
+  CParaSpiQueue(int nDepth=64);
+  ~CParaSpiQueue();
+  int Start();
+  int Stop();
+  int Submit(CParaSpi *pSpi, const uint8_t *pTx, uint8_t *pRx, size_t nLen,
+             CParaSpiFuture *pFuture=NULL, para_spicb pCallback=NULL,
+             void *pUser=NULL);
+  int Submit(CParaSpi *pSpi, CParaSpiXact &xact,
+             CParaSpiFuture *pFuture=NULL, para_spicb pCallback=NULL,
+             void *pUser=NULL);
+  int GetStats(para_spiqstats *pStats);
+};
+
+#endif  // PARA_SPIQUEUE_H
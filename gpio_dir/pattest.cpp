@@ -0,0 +1,211 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  pattest.cpp
+
+  Test of the para_pattern waveform player.  Plays a binary count on
+    one or more GPIO outputs, pin 0 toggling every step, and reports
+    how late each step started against its absolute schedule.
+
+  Build:
+  gcc -o pattest pattest.cpp para_pattern.cpp para_gpio.cpp para_gpio.c -lstdc++ -pthread -Wall
+
+  Notes:
+    With -m and PARA_GPIOMEM set to a 4kB file, no GPIO hardware is
+    needed, which still shows the scheduling performance of the machine.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <ctype.h>
+#include "para_pattern.h"
+
+#define MAXSTEPS 256
+
+void Usage() {
+
+  printf("Usage:  pattest -h  (show this help)\n");
+  printf("        pattest [-k | -m] [-p US] [-n N] [-r] [-l] [-v] PP [QQ ...]\n\n");
+
+  printf("    options:\n");
+  printf("        -k    : Use the GPIO character device\n");
+  printf("        -m    : Use the GPIO registers through /dev/mem (or $PARA_GPIOMEM)\n");
+  printf("        -p US : Step length in microseconds (default 100)\n");
+  printf("        -n N  : Number of times to play the pattern (default 100)\n");
+  printf("        -r    : Play at real-time priority (SCHED_FIFO)\n");
+  printf("        -l    : Lock memory while playing\n");
+  printf("        -v    : Verbose, print the worst lateness of every step\n\n");
+
+  printf("        PP QQ ... : GPIO IDs to drive, at most 8\n\n");
+
+  printf("Note: This application needs (probably root) access to /sys/class/gpio\n");
+  printf("\n");
+
+}
+
+int main(int argc, char *argv[]) {
+  int n, c, nPins=0, nStepUS=100, nRepeat=100, nFlags=0, verbose=0, res;
+  int nIDs[8], nSteps;
+  para_gpiobackend eBackend = para_bksysfs;
+  para_step steps[MAXSTEPS];
+  long long worst, late[MAXSTEPS];
+  unsigned long long played, overruns;
+  CParaGpio *gpio;
+  CParaPattern *pat;
+
+  printf("PATTEST - Test of Parallella GPIO pattern timing\n\n");
+
+  while ((c = getopt(argc, argv, "hkmp:n:rlv")) != -1) {
+    switch (c) {
+
+    case 'h':
+      Usage();
+      exit(0);
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'm':
+      eBackend = para_bkmmio;
+      break;
+
+    case 'p':
+      nStepUS = atoi(optarg);
+      if(nStepUS <= 0) {
+	fprintf(stderr, "Step length must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'n':
+      nRepeat = atoi(optarg);
+      if(nRepeat <= 0) {
+	fprintf(stderr, "Repeat count must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'r':
+      nFlags |= PARA_PATRT;
+      break;
+
+    case 'l':
+      nFlags |= PARA_PATLOCK;
+      break;
+
+    case 'v':
+      verbose = 1;
+      break;
+
+    case '?':
+      if (isprint (optopt))
+	fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+      else
+	fprintf (stderr,
+		 "Unknown option character `\\x%x'.\n",
+		 optopt);
+      exit(1);
+
+    default:
+      fprintf(stderr, "Unexpected result from getopt?? (%d:%c)\n", c, c);
+      exit(1);
+    }
+  }
+
+  for(nPins = 0; optind < argc && nPins < 8; optind++)
+    nIDs[nPins++] = atoi(argv[optind]);
+
+  if(!nPins) {
+    Usage();
+    exit(1);
+  }
+
+  gpio = new CParaGpio(nIDs, nPins, false, eBackend);
+  if(!gpio->IsOK()) {
+    fprintf(stderr, "Object creation failed, exiting\n");
+    delete gpio;
+    exit(2);
+  }
+
+  res = gpio->SetDirection(para_dirout);
+  if(res != para_ok) {
+    fprintf(stderr, "SetDirection() failed with code %d, exiting\n", res);
+    delete gpio;
+    exit(3);
+  }
+
+  nSteps = 1 << nPins;
+  for(n = 0; n < nSteps; n++) {
+    steps[n].nMask = nSteps - 1;
+    steps[n].nValue = n;
+    steps[n].nDelayNS = nStepUS * 1000ULL;
+  }
+
+  printf("Playing %d steps of %d us, %d times%s%s\n", nSteps, nStepUS, nRepeat,
+	 (nFlags & PARA_PATRT) ? ", real-time" : "",
+	 (nFlags & PARA_PATLOCK) ? ", memory locked" : "");
+
+  pat = new CParaPattern(gpio);
+
+  res = pat->PlayPattern(steps, nSteps, nRepeat, nFlags);
+  if(res != para_ok) {
+    fprintf(stderr, "PlayPattern() failed with code %d%s\n", res,
+	    res == para_noaccess ? " (run as root for -r / -l?)" : "");
+    delete pat;
+    delete gpio;
+    exit(4);
+  }
+
+  pat->Wait();
+
+  if(pat->GetError() != para_ok)
+    fprintf(stderr, "Playback stopped with code %d\n", pat->GetError());
+
+  pat->GetStats(&played, &overruns);
+  pat->GetLateness(&worst, late, nSteps);
+
+  if(verbose)
+    for(n = 0; n < nSteps; n++)
+      printf("  step %3d: worst %7lld ns late\n", n, late[n]);
+
+  printf("%llu steps played, %llu overran the next step\n", played, overruns);
+  printf("Worst lateness %lld ns (%.1f%% of a step)\n",
+	 worst, worst / (nStepUS * 10.));
+
+  delete pat;
+  delete gpio;
+
+  return 0;
+}
@@ -74,12 +74,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ctype.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 #include "para_gpio.h"
 
 void Usage() {
 
   printf("Usage:  porcutest -h  (show this help)\n");
-  printf("        gpiotest [-c N] [-v] [-d]\n\n");
+  printf("        gpiotest [-c N] [-i N] [-k | -m] [-v] [-d]\n\n");
 
   printf("    options:\n");
   printf("        -c N  - Send an incrementing count across the links,\n");
@@ -87,6 +88,19 @@ void Usage() {
   printf("                included because it takes a while.\n");
   printf("                Walking-1 & 0 tests are always used.\n\n");
 
+  printf("        -i N  - Instead of the pin tests, time N cycles of\n");
+  printf("                creating & closing both objects, pin-by-pin\n");
+  printf("                with AddPin() vs. batched with AddPins().\n");
+  printf("                Close() is the same either way so is shown once.\n");
+  printf("                With -k or -m every AddPin() re-opens the whole\n");
+  printf("                group, so pin-by-pin is O(n^2) in the pin count.\n\n");
+
+  printf("        -k    - Use the GPIO character device (/dev/gpiochip0)\n");
+  printf("                instead of sysfs, one ioctl per bus access.\n\n");
+
+  printf("        -m    - Access the GPIO controller registers directly\n");
+  printf("                through /dev/mem (or $PARA_GPIOMEM).\n\n");
+
   printf("        -v    - Verbose mode, shows each value written & read,\n");
   printf("                otherwise only errors are printed.\n\n");
 
@@ -109,8 +123,61 @@ int nRevArray[] = {
   37, 36, 39, 38, 41, 40, 43, 42, 45, 44, 47, 46
 };
 
+static double Seconds() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time nCycles of opening & closing both banks, opening either one
+// pin at a time (one export write & open per AddPin) or as a batch.
+// Fills in the average open & close times per cycle in seconds, the
+// close is the same batched Close() either way.
+static int InitTiming(int nCycles, bool bBatch, para_gpiobackend eBackend,
+		      double *pOpen, double *pClose) {
+  int     i, n;
+  double  t0, t1;
+  CParaGpio  gpioa, gpiob;
+
+  gpioa.SetBackend(eBackend);
+  gpiob.SetBackend(eBackend);
+  *pOpen = *pClose = 0.;
+
+  for(i = 0; i < nCycles; i++) {
+
+    t0 = Seconds();
+
+    if(bBatch) {
+      gpioa.AddPins(nSkipArray, NWIRES, true);
+      gpiob.AddPins(nRevArray, NWIRES, true);
+    } else {
+      for(n = 0; n < NWIRES; n++) {
+	gpioa.AddPin(nSkipArray[n], true);
+	gpiob.AddPin(nRevArray[n], true);
+      }
+    }
+
+    t1 = Seconds();
+    *pOpen += t1 - t0;
+
+    if(!gpioa.IsOK() || !gpiob.IsOK())
+      return -1;
+
+    gpioa.Close();
+    gpiob.Close();
+    *pClose += Seconds() - t1;
+  }
+
+  *pOpen /= nCycles;
+  *pClose /= nCycles;
+
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
-  int	n, dir, c, rc, pol, nCountInc=0, verbose=0, debug=0;
+  int	n, dir, c, rc, pol, nCountInc=0, nInitCycles=0, verbose=0, debug=0;
+  para_gpiobackend eBackend = para_bksysfs;
   unsigned wval, rval, cumAB=0, cumBA=0, errs=0, tests=0;
   unsigned onesAB=0, onesBA=0, zerosAB=0xFFFFFFFF, zerosBA=0xFFFFFFFF;
   CParaGpio  *gpioa, *gpiob;
@@ -118,7 +185,7 @@ int main(int argc, char *argv[]) {
 
   printf("PORCUTEST - Basic test of Porcupine GPIOs\n\n");
 
-  while ((c = getopt (argc, argv, "hc:dv")) != -1) {
+  while ((c = getopt (argc, argv, "hc:di:kmv")) != -1) {
     switch (c) {
 
     case 'h':
@@ -138,6 +205,22 @@ int main(int argc, char *argv[]) {
       verbose = 1;
       break;
 
+    case 'i':
+      nInitCycles = atoi(optarg);
+      if(nInitCycles <= 0) {
+	fprintf(stderr, "Number of init cycles must be positive, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'm':
+      eBackend = para_bkmmio;
+      break;
+
     case 'v':
       verbose = 1;
       break;
@@ -159,15 +242,43 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if(nInitCycles) {
+
+    double  tOpen, tClose, tCloseAll = 0.;
+
+    printf("Timing %d open/close cycles of %d pins...\n", nInitCycles, 2 * NWIRES);
+
+    for(n = 0; n < 2; n++) {
+
+      if(InitTiming(nInitCycles, n, eBackend, &tOpen, &tClose)) {
+	fprintf(stderr, "Object creation failed, exiting\n");
+	exit(1);
+      }
+
+      printf("%-10s open %8.3f ms\n", n ? "AddPins:" : "AddPin:", tOpen * 1e3);
+      tCloseAll += tClose / 2;
+    }
+
+    // Close() releases all pins in one call whichever way they were added
+    printf("%-10s      %8.3f ms\n", "Close():", tCloseAll * 1e3);
+
+    if(eBackend != para_bksysfs)
+      printf("Note: each AddPin() re-opens the whole %s, so pin-by-pin\n"
+	     "opening grows as the square of the pin count.\n",
+	     eBackend == para_bkcdev ? "line request" : "register mapping");
+
+    return 0;
+  }
+
   printf("Initializing objects...\n");
   //  gpioa = new CParaGpio(0, NWIRES, true);
-  gpioa = new CParaGpio(nSkipArray, NWIRES, true);
+  gpioa = new CParaGpio(nSkipArray, NWIRES, true, eBackend);
   if(!gpioa->IsOK()) {
     fprintf(stderr, "Object creation failed for GPIOA, exiting\n");
     exit(1);
   }
 
-  gpiob = new CParaGpio(nRevArray, NWIRES, true);
+  gpiob = new CParaGpio(nRevArray, NWIRES, true, eBackend);
   if(!gpiob->IsOK()) {
     fprintf(stderr, "Object creation failed for GPIOB, exiting\n");
     delete gpioa;
@@ -0,0 +1,247 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  spibustest.cpp
+
+  Test of the para_spibus shared SPI bus.  Runs one thread per device,
+    each polling its device as fast as it can, with the devices in
+    different SPI modes so the bus has to switch between them.
+
+  Build:
+  gcc -o spibustest spibustest.cpp para_spibus.cpp para_spi.cpp para_gpio.cpp para_gpio.c -lstdc++ -lm -pthread -Wall
+
+  Notes:
+    With MOSI wired to MISO, -l checks every byte that comes back, so
+    any transfer corrupted by another thread is caught.  With -m and
+    PARA_GPIOMEM set to a 4kB file, no GPIO hardware is needed (but
+    don't use -l then).
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include "para_spibus.h"
+
+void Usage() {
+
+  printf("Usage:  spibustest -h  (show this help)\n");
+  printf("        spibustest [-k | -m] [-n N] [-b N] [-l] CLK MOSI MISO CE1 [CE2 ...]\n\n");
+
+  printf("    options:\n");
+  printf("        -k    : Use the GPIO character device\n");
+  printf("        -m    : Use the GPIO registers through /dev/mem (or $PARA_GPIOMEM)\n");
+  printf("        -n N  : Transactions per device (default 1000)\n");
+  printf("        -b N  : Bytes per transaction (default 4)\n");
+  printf("        -l    : MOSI is looped back to MISO, check the data\n\n");
+
+  printf("        Device n uses mode CPOL = bit 1 of n, CPHA = bit 0 of n\n\n");
+
+  printf("Note: This application needs (probably root) access to /sys/class/gpio\n");
+  printf("\n");
+
+}
+
+typedef struct {
+  CParaSpiDev *pDev;
+  int nXacts;
+  int nBytes;
+  bool bCheck;
+  unsigned nSeed;
+  int nErrors;
+  int nRes;
+  double fMaxMS;
+  pthread_barrier_t *pStart;
+} DevThread;
+
+static double Seconds() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *Poll(void *pArg) {
+  DevThread *p = (DevThread *)pArg;
+  uint8_t *tx = (uint8_t *)malloc(p->nBytes), *rx = (uint8_t *)malloc(p->nBytes);
+  double t0, t;
+  int n, i;
+
+  // All threads start together, so they really contend for the bus
+  pthread_barrier_wait(p->pStart);
+
+  for(n = 0; n < p->nXacts && tx && rx; n++) {
+
+    for(i = 0; i < p->nBytes; i++)
+      tx[i] = rand_r(&p->nSeed);
+
+    t0 = Seconds();
+    p->nRes = p->pDev->Transfer(tx, rx, p->nBytes);
+    t = (Seconds() - t0) * 1e3;
+
+    if(p->nRes)
+      break;
+    if(t > p->fMaxMS)
+      p->fMaxMS = t;
+    if(p->bCheck && memcmp(tx, rx, p->nBytes))
+      p->nErrors++;
+  }
+
+  free(tx);
+  free(rx);
+
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  int n, c, nDevs, nXacts=1000, nBytes=4, bCheck=0, errs=0;
+  para_gpiobackend eBackend = para_bksysfs;
+  CParaSpiBus bus;
+  DevThread devs[SPIMAXDEVS];
+  pthread_t threads[SPIMAXDEVS];
+  pthread_barrier_t start;
+  double t0;
+
+  printf("SPIBUSTEST - Test of the Parallella shared SPI bus\n\n");
+
+  while ((c = getopt(argc, argv, "hkmn:b:l")) != -1) {
+    switch (c) {
+
+    case 'h':
+      Usage();
+      exit(0);
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'm':
+      eBackend = para_bkmmio;
+      break;
+
+    case 'n':
+      nXacts = atoi(optarg);
+      break;
+
+    case 'b':
+      nBytes = atoi(optarg);
+      if(nBytes <= 0) {
+	fprintf(stderr, "Bytes per transaction must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'l':
+      bCheck = 1;
+      break;
+
+    case '?':
+      if (isprint (optopt))
+	fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+      else
+	fprintf (stderr,
+		 "Unknown option character `\\x%x'.\n",
+		 optopt);
+      exit(1);
+
+    default:
+      fprintf(stderr, "Unexpected result from getopt?? (%d:%c)\n", c, c);
+      exit(1);
+    }
+  }
+
+  nDevs = argc - optind - 3;
+  if(nDevs < 1 || nDevs > SPIMAXDEVS) {
+    Usage();
+    exit(1);
+  }
+
+  bus.SetBackend(eBackend);
+  if(bus.AssignPins(atoi(argv[optind]), atoi(argv[optind+1]),
+		    atoi(argv[optind+2])) != para_ok) {
+    fprintf(stderr, "Unable to assign the bus pins, exiting\n");
+    exit(2);
+  }
+
+  for(n = 0; n < nDevs; n++) {
+
+    memset(devs + n, 0, sizeof(DevThread));
+    devs[n].pDev = bus.AddDevice(atoi(argv[optind+3+n]), (n >> 1) & 1, n & 1);
+    if(devs[n].pDev == NULL) {
+      fprintf(stderr, "Unable to add device %d, exiting\n", n);
+      exit(2);
+    }
+
+    devs[n].nXacts = nXacts;
+    devs[n].nBytes = nBytes;
+    devs[n].bCheck = bCheck;
+    devs[n].nSeed = n + 1;
+    devs[n].pStart = &start;
+  }
+
+  printf("%d devices x %d transactions of %d bytes\n", nDevs, nXacts, nBytes);
+
+  pthread_barrier_init(&start, NULL, nDevs + 1);
+
+  for(n = 0; n < nDevs; n++)
+    pthread_create(threads + n, NULL, Poll, devs + n);
+
+  pthread_barrier_wait(&start);
+  t0 = Seconds();
+
+  for(n = 0; n < nDevs; n++)
+    pthread_join(threads[n], NULL);
+
+  t0 = Seconds() - t0;
+  pthread_barrier_destroy(&start);
+
+  for(n = 0; n < nDevs; n++) {
+    printf("  device %d: mode %d%d, longest transaction %.3f ms", n,
+	   (n >> 1) & 1, n & 1, devs[n].fMaxMS);
+    if(devs[n].nRes)
+      printf(", stopped with code %d", devs[n].nRes);
+    if(bCheck)
+      printf(", %d bad", devs[n].nErrors);
+    printf("\n");
+    errs += devs[n].nErrors + (devs[n].nRes ? 1 : 0);
+  }
+
+  printf("%.0f transactions/s, %llu clock polarity changes\n",
+	 nDevs * nXacts / t0, bus.GetModeChanges());
+  printf("%s\n", errs ? "ERRORS" : "OK");
+
+  return errs ? 1 : 0;
+}
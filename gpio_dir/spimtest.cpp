@@ -0,0 +1,213 @@
+/*
+Copyright (c) 2014, Adapteva, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+  Redistributions in binary form must reproduce the above copyright notice, this
+  list of conditions and the following disclaimer in the documentation and/or
+  other materials provided with the distribution.
+
+  Neither the name of the copyright holders nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+
+  spimtest.cpp
+
+  Test of the para_spimulti lock-step multi-bus SPI engine.  Times a
+    transfer on every bus, first one bus after the other with a CParaSpi
+    object per bus, then all together with CParaSpiMulti, and compares.
+
+  Build:
+  gcc -o spimtest spimtest.cpp para_spimulti.cpp para_spi.cpp para_gpio.cpp para_gpio.c -lstdc++ -lm -Wall
+
+  Notes:
+    With MOSI wired to MISO on every bus, -l checks the data received.
+    With -m and PARA_GPIOMEM set to a 4kB file, no GPIO hardware is
+    needed (but don't use -l then).
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include "para_spimulti.h"
+#include "para_spi.h"
+
+void Usage() {
+
+  printf("Usage:  spimtest -h  (show this help)\n");
+  printf("        spimtest [-k | -m] [-n N] [-l] CLK MOSI MISO CE [CLK MOSI MISO CE ...]\n\n");
+
+  printf("    options:\n");
+  printf("        -k    : Use the GPIO character device\n");
+  printf("        -m    : Use the GPIO registers through /dev/mem (or $PARA_GPIOMEM)\n");
+  printf("        -n N  : Bytes per transfer (default 1000)\n");
+  printf("        -l    : MOSI is looped back to MISO on each bus, check the data\n\n");
+
+  printf("        Four GPIO IDs per bus, up to %d buses\n\n", SPIMULTIMAX);
+
+  printf("Note: This application needs (probably root) access to /sys/class/gpio\n");
+  printf("\n");
+
+}
+
+static double Seconds() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+  int n, b, c, nBuses, nLen=1000, bCheck=0, res, errs=0;
+  int nIDs[MAXPINSPEROBJECT];
+  para_gpiobackend eBackend = para_bksysfs;
+  uint8_t *pTx[SPIMULTIMAX], *pRx[SPIMULTIMAX];
+  double tSeq, tPar;
+  CParaSpiMulti multi;
+
+  printf("SPIMTEST - Test of the Parallella multi-bus SPI engine\n\n");
+
+  while ((c = getopt(argc, argv, "hkmn:l")) != -1) {
+    switch (c) {
+
+    case 'h':
+      Usage();
+      exit(0);
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'm':
+      eBackend = para_bkmmio;
+      break;
+
+    case 'n':
+      nLen = atoi(optarg);
+      if(nLen <= 0) {
+	fprintf(stderr, "Transfer length must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'l':
+      bCheck = 1;
+      break;
+
+    case '?':
+      if (isprint (optopt))
+	fprintf (stderr, "Unknown option `-%c'.\n", optopt);
+      else
+	fprintf (stderr,
+		 "Unknown option character `\\x%x'.\n",
+		 optopt);
+      exit(1);
+
+    default:
+      fprintf(stderr, "Unexpected result from getopt?? (%d:%c)\n", c, c);
+      exit(1);
+    }
+  }
+
+  nBuses = (argc - optind) / 4;
+  if(nBuses < 1 || nBuses > SPIMULTIMAX || (argc - optind) % 4) {
+    Usage();
+    exit(1);
+  }
+
+  for(n = 0; n < 4 * nBuses; n++)
+    nIDs[n] = atoi(argv[optind + n]);
+
+  for(b = 0; b < nBuses; b++) {
+    pTx[b] = (uint8_t *)malloc(nLen);
+    pRx[b] = (uint8_t *)malloc(nLen);
+    if(pTx[b] == NULL || pRx[b] == NULL) {
+      fprintf(stderr, "Out of memory, exiting\n");
+      exit(2);
+    }
+    for(n = 0; n < nLen; n++)
+      pTx[b][n] = rand();
+  }
+
+  printf("%d buses, %d bytes each\n", nBuses, nLen);
+
+  // One bus at a time
+  tSeq = Seconds();
+  for(b = 0; b < nBuses; b++) {
+
+    CParaSpi spi;
+
+    spi.SetBackend(eBackend);
+    res = spi.AssignPins(nIDs[4*b], nIDs[4*b+1], nIDs[4*b+2], nIDs[4*b+3]);
+    if(res == para_ok)
+      res = spi.Transfer(pTx[b], pRx[b], nLen);
+    if(res) {
+      fprintf(stderr, "CParaSpi on bus %d failed with code %d, exiting\n", b, res);
+      exit(3);
+    }
+    if(bCheck && memcmp(pTx[b], pRx[b], nLen))
+      errs++;
+  }
+  tSeq = Seconds() - tSeq;
+
+  // All buses together
+  for(b = 0; b < nBuses; b++)
+    memset(pRx[b], 0, nLen);
+
+  multi.SetBackend(eBackend);
+  res = multi.AssignBuses(nIDs, nBuses);
+  if(res) {
+    fprintf(stderr, "AssignBuses() failed with code %d, exiting\n", res);
+    exit(4);
+  }
+
+  tPar = Seconds();
+  res = multi.Transfer(pTx, pRx, nLen);
+  tPar = Seconds() - tPar;
+  if(res) {
+    fprintf(stderr, "Transfer() failed with code %d, exiting\n", res);
+    exit(5);
+  }
+
+  for(b = 0; bCheck && b < nBuses; b++)
+    if(memcmp(pTx[b], pRx[b], nLen))
+      errs++;
+
+  printf("CParaSpi x %d: %8.1f kb/s total (includes set-up)\n",
+	 nBuses, nBuses * nLen * 8e-3 / tSeq);
+  printf("CParaSpiMulti: %8.1f kb/s total, %.2fx\n",
+	 nBuses * nLen * 8e-3 / tPar, tSeq / tPar);
+
+  if(bCheck)
+    printf("Data check: %s\n", errs ? "FAILED" : "passed");
+
+  for(b = 0; b < nBuses; b++) {
+    free(pTx[b]);
+    free(pRx[b]);
+  }
+
+  return errs ? 1 : 0;
+}
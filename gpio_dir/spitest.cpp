@@ -38,7 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Allows any combination of read & write to one device
 
   Build:
-  gcc -o spitest spitest.cpp para_spi.cpp para_gpio.cpp para_gpio.c -lstdc++ -Wall
+  gcc -o spitest spitest.cpp para_spiqueue.cpp para_spi.cpp para_gpio.cpp para_gpio.c -lstdc++ -lm -pthread -Wall -DPARA_SPITRACE
 
   Notes:
 
@@ -49,12 +49,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
-#include "para_spi.h"
+#include <time.h>
+#include <fcntl.h>
+#include "para_spiqueue.h"
 
 void Usage() {
 
   printf("Usage:  spitest -h  (show this help)\n");
-  printf("        spitest [-m MNO] [PP QQ RR SS]\n\n");
+  printf("        spitest [-m MNO] [-l] [-k | -x | -D DEV | -L] [-b N] [-q P2,P3] [-f HZ] [-t N] [PP QQ RR SS]\n\n");
 
   printf("    options:\n");
   printf("        -m MNO  : Set SPI mode:\n");
@@ -63,6 +65,24 @@ void Usage() {
   printf("                     O = phase:\n");
   printf("                           0=sample on 1st clock edge\n");
   printf("                           1=sample on 2nd clock edge\n\n");
+  printf("        -l      : Send strings LSB-first\n");
+  printf("        -k      : Use the GPIO character device\n");
+  printf("        -x      : Use the GPIO registers through /dev/mem (or $PARA_GPIOMEM)\n");
+  printf("        -D DEV  : Use the spidev device DEV (e.g. /dev/spidev1.0) if\n");
+  printf("                  possible, otherwise the GPIO pins.  Setting\n");
+  printf("                  $PARA_SPIDEV does the same for any program.\n");
+  printf("        -L      : Use a loopback stand-in for a spidev device, MISO\n");
+  printf("                  returns what was sent on MOSI.  Runs a self-test.\n");
+  printf("        -b N    : Benchmark N-byte transfers with the mode-specific\n");
+  printf("                  kernels vs. the generic bit loop, then exit\n");
+  printf("        -q P2,P3: Add IO2 / IO3 for quad I/O, -b then also times\n");
+  printf("                  dual and quad segments\n");
+  printf("        -f HZ   : Pace the clock at HZ, shows the achieved rate\n");
+  printf("                  and edge jitter at the end\n");
+  printf("        -t N    : Trace all transactions, keeping the last N, and\n");
+  printf("                  show the trace at exit (needs -DPARA_SPITRACE)\n");
+  printf("        -a N    : Queue N 8-byte transfers on a CParaSpiQueue,\n");
+  printf("                  time the submits and show the queue statistics\n\n");
 
   printf("        PP : Clock signal GPIO ID (default 65)\n");
   printf("        QQ : MOSI signal GPIO ID (default 66)\n");
@@ -79,7 +99,8 @@ void Usage() {
   printf("     byte at a time.  Non-ASCII characters may be sent using \\xNN\n");
   printf("     (two hex digits), or a literal '\\' or '\"' may be sent with\n");
   printf("     '\\\\' or '\\\"' respectively.\n");
-  printf("     Any return data is discarded.\n\n");
+  printf("     The whole string is sent as one transaction and the bytes\n");
+  printf("     received are shown in hex.\n\n");
 
   printf("   Enter an empty line to repeat the last operation or 'q' to quit.\n\n");
 
@@ -104,16 +125,242 @@ int hextoi(char c) {
   return x;
 }
 
+static double Seconds() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Time nLen-byte transfers each way, generic loop vs. kernels
+static int Benchmark(CParaSpi *pSpi, int nLen, bool bQuad, bool bPaced) {
+  static const char *strDir[] = { "clock only", "write", "read", "full-duplex" };
+  uint8_t *pTx, *pRx;
+  double t0, t[3];
+  int n, dir, g, w, res;
+  CParaSpiXact  xact;
+
+  pTx = (uint8_t *)malloc(nLen);
+  pRx = (uint8_t *)malloc(nLen);
+  if(pTx == NULL || pRx == NULL) {
+    free(pTx);
+    free(pRx);
+    return para_outofmemory;
+  }
+
+  for(n = 0; n < nLen; n++)
+    pTx[n] = rand();
+
+  // A paced clock always runs the generic loop, see SetClockRate()
+  if(bPaced)
+    printf("Clock is paced (-f), both columns use the generic loop\n");
+  printf("%-12s %12s %12s %8s\n", "", "generic", bPaced ? "generic" : "kernel",
+	 "speedup");
+
+  for(dir = 0; dir < 4; dir++) {
+
+    for(g = 0; g < 2; g++) {
+
+      pSpi->SetGeneric(g == 0);
+      t0 = Seconds();
+      res = pSpi->Transfer((dir & 1) ? pTx : NULL, (dir & 2) ? pRx : NULL, nLen);
+      t[g] = Seconds() - t0;
+
+      if(res) {
+	free(pTx);
+	free(pRx);
+	return res;
+      }
+    }
+
+    printf("%-12s %8.1f kb/s %8.1f kb/s %7.2fx\n", strDir[dir],
+	   nLen * 8e-3 / t[0], nLen * 8e-3 / t[1], t[0] / t[1]);
+  }
+
+  pSpi->SetGeneric(false);
+
+  // Single vs. dual vs. quad segments
+  printf("\n%-12s %12s %12s %12s\n", "", "single", "dual", "quad");
+
+  for(dir = 1; dir < 3; dir++) {
+
+    for(g = 0, w = 1; w <= 4; g++, w *= 2) {
+
+      t[g] = 0;
+      if(w == 4 && !bQuad)
+	continue;
+
+      xact.Clear();
+      if(dir == 1)
+	xact.Write(pTx, nLen, w);
+      else
+	xact.Read(pRx, nLen, w);
+
+      t0 = Seconds();
+      res = pSpi->Transfer(xact);
+      t[g] = Seconds() - t0;
+
+      if(res) {
+	free(pTx);
+	free(pRx);
+	return res;
+      }
+    }
+
+    printf("%-12s %8.1f kb/s %8.1f kb/s ", strDir[dir],
+	   nLen * 8e-3 / t[0], nLen * 8e-3 / t[1]);
+    if(t[2] > 0)
+      printf("%8.1f kb/s\n", nLen * 8e-3 / t[2]);
+    else
+      printf("%12s\n", "-");
+  }
+
+  free(pTx);
+  free(pRx);
+
+  return para_ok;
+}
+
+// Report how well a paced clock kept to its rate
+static void ClockStats(CParaSpi *pSpi) {
+  para_spiclk clk;
+
+  if(pSpi->GetClockStats(&clk) || !clk.nTargetHz)
+    return;
+
+  printf("Clock: target %u Hz, achieved %.0f Hz over %llu edges\n",
+	 clk.nTargetHz, clk.dAchievedHz, clk.nEdges);
+  printf("  Edge lateness %.0f ns RMS, %u ns worst\n", clk.dJitterNS, clk.nLateMaxNS);
+  printf("  Calibration: sleep latency %u ns, pin access %u ns (max ~%u Hz)\n\n",
+	 clk.nSleepNS, clk.nPinNS, clk.nPinNS ? 500000000U / clk.nPinNS : 0);
+}
+
+// Stands in for a spidev device with MOSI looped back to MISO
+class CLoopSpi : public CParaSpi {
+ protected:
+  int DevOpen(const char *strDev) { return open("/dev/null", O_RDWR); }
+  int DevConfig() { return para_ok; }
+  int DevMessage(struct spi_ioc_transfer *pXfers, int nXfers) {
+    int n;
+
+    for(n = 0; n < nXfers; n++) {
+      if(!pXfers[n].rx_buf)
+	continue;
+      if(pXfers[n].tx_buf)
+	memmove((void *)(unsigned long)pXfers[n].rx_buf,
+		(void *)(unsigned long)pXfers[n].tx_buf, pXfers[n].len);
+      else
+	memset((void *)(unsigned long)pXfers[n].rx_buf, 0, pXfers[n].len);
+    }
+
+    return para_ok;
+  }
+};
+
+// Check that everything sent comes back through a loopback
+static int LoopTest(CParaSpi *pSpi) {
+  uint8_t tx[1000], rx[1000], cmd[4] = { 0x03, 0x12, 0x34, 0x56 };
+  unsigned wval, rval;
+  int n, bits, errs = 0;
+  CParaSpiXact  xact;
+
+  for(n = 0; n < (int)sizeof(tx); n++)
+    tx[n] = rand();
+
+  if(pSpi->Transfer(tx, rx, sizeof(tx)) || memcmp(tx, rx, sizeof(tx))) {
+    printf("  Transfer: FAIL\n");
+    errs++;
+  }
+
+  for(bits = 1; bits <= 32; bits++) {
+    wval = rand() & (bits < 32 ? (1U << bits) - 1 : ~0U);
+    if(pSpi->Xfer(bits, &wval, &rval) || rval != wval) {
+      printf("  Xfer(%d): sent 0x%08X, rcvd 0x%08X FAIL\n", bits, wval, rval);
+      errs++;
+    }
+  }
+
+  xact.Write(cmd, 4);
+  xact.Duplex(tx, rx, 100);
+  xact.Read(rx + 100, 100);
+  memset(rx + 100, 0xFF, 100);
+  if(pSpi->Transfer(xact) || memcmp(tx, rx, 100) || rx[100] || rx[199]) {
+    printf("  Segments: FAIL\n");
+    errs++;
+  }
+
+  printf("Loopback self-test: %s\n\n", errs ? "FAILED" : "passed");
+
+  return errs;
+}
+
+// Submit nXacts transfers to a queue, checking the data if looped back
+static int AsyncTest(CParaSpi *pSpi, int nXacts, bool bCheck) {
+  CParaSpiQueue  queue(nXacts);
+  CParaSpiFuture *pFutures = new CParaSpiFuture[nXacts];
+  uint8_t *pTx = (uint8_t *)malloc(nXacts * 8), *pRx = (uint8_t *)malloc(nXacts * 8);
+  para_spiqstats stats;
+  double t0, tSubmit, tTotal;
+  int n, res = para_ok, errs = 0;
+
+  if(pTx == NULL || pRx == NULL) {
+    res = para_outofmemory;
+    goto done;
+  }
+
+  for(n = 0; n < nXacts * 8; n++)
+    pTx[n] = rand();
+
+  queue.Start();
+
+  t0 = Seconds();
+  for(n = 0; n < nXacts && res == para_ok; n++)
+    res = queue.Submit(pSpi, pTx + 8 * n, pRx + 8 * n, 8, pFutures + n);
+  tSubmit = Seconds() - t0;
+
+  for(n = 0; n < nXacts; n++)
+    if(pFutures[n].Wait() != para_ok)
+      errs++;
+  tTotal = Seconds() - t0;
+
+  queue.Stop();
+  queue.GetStats(&stats);
+
+  if(bCheck && memcmp(pTx, pRx, nXacts * 8))
+    errs++;
+
+  printf("%d transfers: %.1f us to submit, %.1f us to complete\n",
+	 nXacts, tSubmit * 1e6, tTotal * 1e6);
+  printf("  %llu batches, max depth %d, latency avg %llu us max %llu us\n",
+	 stats.nBatches, stats.nMaxDepth, stats.nAvgLatNS / 1000,
+	 stats.nMaxLatNS / 1000);
+  printf("Async test: %s\n\n", errs ? "FAILED" : "passed");
+
+ done:
+  free(pTx);
+  free(pRx);
+  delete[] pFutures;
+
+  return res ? res : errs;
+}
+
 int main(int argc, char *argv[]) {
-  int nCLK=65, nMOSI=66, nMISO=68, nSS=64, n, c;
-  int nCPOL=0, nCPHA=0, nEPOL=0, res, sendstr=0, done=0;
+  int nCLK=65, nMOSI=66, nMISO=68, nSS=64, nIO2=-1, nIO3=-1, n, c;
+  int nCPOL=0, nCPHA=0, nEPOL=0, res, sendstr=0, done=0, len, nBench=0, nAsync=0;
   char str[256], strLast[256];
+  uint8_t buf[256];
   unsigned nbits=0, wval=0, rval=0;
-  CParaSpi  spi;
+  int bLSBFirst=0, bLoop=0;
+  unsigned nHz=0;
+  int nTrace=-1;
+  const char *strDev=NULL;
+  para_gpiobackend eBackend=para_bksysfs;
+  CParaSpi  spiGpio, *pSpi=&spiGpio;
+  CLoopSpi  spiLoop;
 
   printf("SPITEST - Basic test of Parallella SPI Module\n\n");
 
-  while ((c = getopt(argc, argv, "hm:")) != -1) {
+  while ((c = getopt(argc, argv, "hm:lkxD:Lb:a:q:f:t:")) != -1) {
     switch (c) {
 
     case 'h':
@@ -131,6 +378,58 @@ int main(int argc, char *argv[]) {
       nCPHA = n % 10;
       break;
 
+    case 'l':
+      bLSBFirst = 1;
+      break;
+
+    case 'k':
+      eBackend = para_bkcdev;
+      break;
+
+    case 'x':
+      eBackend = para_bkmmio;
+      break;
+
+    case 'D':
+      strDev = optarg;
+      break;
+
+    case 'L':
+      bLoop = 1;
+      pSpi = &spiLoop;
+      break;
+
+    case 'b':
+      nBench = atoi(optarg);
+      if(nBench <= 0) {
+	fprintf(stderr, "Benchmark length must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 'a':
+      nAsync = atoi(optarg);
+      if(nAsync <= 0) {
+	fprintf(stderr, "Number of async transfers must be > 0, exiting\n");
+	exit(1);
+      }
+      break;
+
+    case 't':
+      nTrace = atoi(optarg);
+      break;
+
+    case 'f':
+      nHz = strtoul(optarg, NULL, 0);
+      break;
+
+    case 'q':
+      if(sscanf(optarg, "%d,%d", &nIO2, &nIO3) != 2 || nIO2 < 0 || nIO3 < 0) {
+	fprintf(stderr, "Quad pins must be given as P2,P3, exiting\n");
+	exit(1);
+      }
+      break;
+
     case '?':
       if (optopt == 'w')
 	fprintf (stderr, "Option -%c requires an argument.\n", optopt);
@@ -163,20 +462,70 @@ int main(int argc, char *argv[]) {
 
   printf("Initializing object...\n");
 
-  spi.SetMode(nCPOL, nCPHA, nEPOL);
+  pSpi->SetBitOrder(bLSBFirst);
+  pSpi->SetBackend(eBackend);
+  pSpi->SetMode(nCPOL, nCPHA, nEPOL);
 
-  res = spi.AssignPins(nCLK, nMOSI, nMISO, nSS);
-  if(res) {
-    fprintf(stderr, "spi.AssignPins returned %d", res);
-    exit(1);
+  if(bLoop)
+    strDev = "loopback";
+
+  if(strDev && pSpi->OpenDevice(strDev) != para_ok)
+    fprintf(stderr, "Unable to use %s, falling back to GPIO pins\n", strDev);
+
+  if(pSpi->GetPath() == para_spigpio) {
+    res = pSpi->AssignPins(nCLK, nMOSI, nMISO, nSS);
+    if(res) {
+      fprintf(stderr, "spi.AssignPins returned %d", res);
+      exit(1);
+    }
+    if(nIO2 >= 0) {
+      res = pSpi->AddQuadPins(nIO2, nIO3);
+      if(res) {
+	fprintf(stderr, "spi.AddQuadPins returned %d", res);
+	exit(1);
+      }
+    }
   }
 
-  if(!spi.IsOK()) {
+  if(!pSpi->IsOK()) {
     fprintf(stderr, "SPI Object creation failed, exiting\n");
     exit(1);
   }
 
-  printf("Success\n");
+  printf("Success, using %s\n", pSpi->GetPath() == para_spidev ?
+	 "spidev" : "GPIO bit-bang");
+
+  if(nTrace >= 0 && pSpi->EnableTrace(nTrace, "-") != para_ok)
+    fprintf(stderr, "Tracing not available, build with -DPARA_SPITRACE\n");
+
+  if(nHz) {
+    res = pSpi->SetClockRate(nHz);
+    if(res) {
+      fprintf(stderr, "spi.SetClockRate returned %d, exiting\n", res);
+      exit(1);
+    }
+  }
+
+  if(bLoop && LoopTest(pSpi))
+    exit(1);
+
+  if(nAsync) {
+    res = AsyncTest(pSpi, nAsync, bLoop);
+    pSpi->Close();
+    return res ? 1 : 0;
+  }
+
+  if(nBench) {
+
+    printf("Mode %d%d%d, %d bytes per transfer\n", nEPOL, nCPOL, nCPHA, nBench);
+    res = Benchmark(pSpi, nBench, nIO2 >= 0 && pSpi->GetPath() == para_spigpio,
+		    nHz != 0);
+    if(res)
+      fprintf(stderr, "Transfer() returned %d\n", res);
+    ClockStats(pSpi);
+    pSpi->Close();
+    return res ? 1 : 0;
+  }
 
   strLast[0] = 0;  // Just in case someone gets sneaky
 
@@ -213,7 +562,7 @@ int main(int argc, char *argv[]) {
 
     if(sendstr) {
 
-      for(n=1; strLast[n] && strLast[n] != '"'; n++) {
+      for(len=0, n=1; strLast[n] && strLast[n] != '"'; n++) {
 
 	c = -1;
 
@@ -228,22 +577,23 @@ int main(int argc, char *argv[]) {
 	  }
 	}
 
-	if(c >= 0)
-	  res = spi.Xfer(8, c);
-	else
-	  res = spi.Xfer(8, strLast[n]);
+	buf[len++] = c >= 0 ? c : strLast[n];
+      }
 
-	if(res) {
-	  fprintf(stderr, "Xfer() returned %d, exiting\n", res);
-	  done = 1;
-	}
+      res = pSpi->Transfer(buf, buf, len);
+      if(res) {
+	fprintf(stderr, "Transfer() returned %d, exiting\n", res);
+	done = 1;
       }
 
-      printf("String sent.\n\n");
+      printf("String sent, Rcvd");
+      for(n = 0; n < len; n++)
+	printf(" %02X", buf[n]);
+      printf("\n\n");
 
     } else {
 
-      res = spi.Xfer(nbits, &wval, &rval);
+      res = pSpi->Xfer(nbits, &wval, &rval);
       if(res) {
 	fprintf(stderr, "Xfer() returned %d, exiting\n", res);
 	done = 1;
@@ -254,8 +604,9 @@ int main(int argc, char *argv[]) {
   }
 
   // done:
+  ClockStats(pSpi);
   printf("Closing\n");
-  spi.Close();
+  pSpi->Close();
 
   return 0;
 }